@@ -0,0 +1,65 @@
+/*****************************************************
+This is the demo sketch for the command line interface
+by FreakLabs. It's a simple command line interface
+where you can define your own commands and pass arguments
+to them. 
+*****************************************************/
+#include "cmdArduino.h"
+
+/* Initial Constructor for command line */
+Cmd cmd;
+
+// Forward declarations, so the functions can be placed in the table below
+void hello(int argCnt, char **args);
+void arg_display(int argCnt, char **args);
+
+// Declare the whole command table at compile time. The table (names and
+// function pointers) is stored in flash, so no RAM is used for it and
+// nothing is malloc'd when the sketch starts.
+//
+// The entries must be listed in alphabetical order. If they're not, the
+// sketch won't compile, which lets the library find commands with a fast
+// binary search.
+CMD_TABLE(cmd_table,
+  {"args",  arg_display},
+  {"hello", hello}
+);
+
+void setup()
+{
+  // init the command line and set it for a speed of 57600
+  cmd.begin(57600);
+  
+  // attach the flash-resident table. Commands can still be added with
+  // cmd.add() as well, and those take precedence over the table.
+  cmd.add_table(cmd_table);
+
+  Serial.println("Command Line Example 6 - Flash-Resident Command Table");
+}
+
+void loop()
+{
+  cmd.poll();
+}
+
+// Print "hello world" when called from the command line.
+// Usage: At the command line, type:
+// hello
+void hello(int argCnt, char **args)
+{
+  Serial.println("Hello world.");
+}
+
+// Print the arguments typed in at the command line.
+// Usage: At the command line, type:
+// args hello world
+void arg_display(int argCnt, char **args)
+{
+  for (int i=0; i<argCnt; i++)
+  {
+    Serial.print("Arg ");
+    Serial.print(i);
+    Serial.print(": ");
+    Serial.println(args[i]);
+  }
+}
@@ -0,0 +1,94 @@
+/*****************************************************
+This is the demo sketch for the command line interface
+by FreakLabs. It shows commands written as resumable
+tasks: the command returns to the prompt right away and
+the task keeps running from later cmd.poll() calls, so
+several long-running commands can make progress at once
+while you keep typing.
+*****************************************************/
+#include "cmdArduino.h"
+
+int led_pin = 13;
+
+/* Initial Constructor for command line */
+Cmd cmd;
+
+/* Job queue the tasks run from (CMD_JOB_QUEUE_SIZE slots) */
+CmdJobs<> jobs;
+
+void setup()
+{
+  // set the led pin as an output. its part of the demo.
+  pinMode(led_pin, OUTPUT);
+
+  // init the command line and set it for a speed of 57600
+  cmd.begin(57600);
+
+  // give the command line a job queue, tasks can't run without one
+  cmd.attach_jobs(&jobs);
+
+  // add the task commands to the command table. The functions need
+  // to have the format:
+  //
+  // uint8_t task_name(cmd_job_t *job)
+  //
+  // job->argc / job->argv are the arguments typed into the command line.
+  // job->state, job->wake and job->ctx belong to the task and are kept
+  // between calls (state starts out as 0). Return CMD_TASK_YIELD to be
+  // called again on the next poll(), or CMD_TASK_DONE when finished.
+  cmd.add_task("blink", led_blink);
+  cmd.add_task("count", count);
+
+  Serial.println("Command Line Example 7 - Tasks");
+}
+
+void loop()
+{
+  // poll() handles the input and gives every queued task one turn
+  cmd.poll();
+}
+
+// Blink the LED a number of times with the delay time specified in the args.
+//
+// Usage:
+// blink 10 100
+//
+// Blinks the LED 10 times with 100 msec on/off time
+uint8_t led_blink(cmd_job_t *job)
+{
+  if (job->argc < 3) {return CMD_TASK_DONE;}
+
+  // wait until it's time for the next toggle, without blocking the command line
+  if (job->state && (long)(millis() - job->wake) < 0) {return CMD_TASK_YIELD;}
+
+  // each blink is two toggles: even states turn the LED on, odd states turn it off
+  if (job->state >= 2 * cmd.conv(job->argv[1], 10))
+  {
+    digitalWrite(led_pin, LOW);
+    return CMD_TASK_DONE;
+  }
+
+  digitalWrite(led_pin, (job->state & 1) ? LOW : HIGH);
+  job->wake = millis() + cmd.conv(job->argv[2], 10);
+  job->state++;
+  return CMD_TASK_YIELD;
+}
+
+// Count from 0 up to the number given in the args, printing one number per second.
+//
+// Usage:
+// count 5
+uint8_t count(cmd_job_t *job)
+{
+  if (job->argc < 2) {return CMD_TASK_DONE;}
+  if (job->state && (long)(millis() - job->wake) < 0) {return CMD_TASK_YIELD;}
+
+  Serial.print("count: ");
+  Serial.println(job->state);
+
+  if (job->state >= cmd.conv(job->argv[1], 10)) {return CMD_TASK_DONE;}
+
+  job->wake = millis() + 1000;
+  job->state++;
+  return CMD_TASK_YIELD;
+}
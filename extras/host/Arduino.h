@@ -0,0 +1,45 @@
+/*******************************************************************
+    Host stand-in for <Arduino.h>
+
+    Provides just enough of the Arduino core for cmdArduino (and its
+    examples) to compile and run on a Linux host.  Add the directory
+    containing this file to the include path ahead of the library.
+*******************************************************************/
+#ifndef CMD_HOST_ARDUINO_H
+    #define CMD_HOST_ARDUINO_H
+
+    #include <stdint.h>
+    #include <stdlib.h>
+    #include <stdio.h>
+    #include <string.h>
+    #include <ctype.h>
+    #include <math.h>
+
+    #include "pgmspace.h"
+    #include "Print.h"
+    #include "Stream.h"
+    #include "HardwareSerial.h"
+
+    /* Lets library code tell the host build apart from a real core */
+    #define CMD_HOST_BUILD 1
+
+    #define HIGH 0x1
+    #define LOW  0x0
+    #define INPUT 0x0
+    #define OUTPUT 0x1
+
+    typedef bool boolean;
+    typedef uint8_t byte;
+
+    unsigned long millis(void);
+    unsigned long micros(void);
+    void delay(unsigned long ms);
+    void delayMicroseconds(unsigned int us);
+    void yield(void);
+
+    void pinMode(uint8_t pin, uint8_t mode);
+    void digitalWrite(uint8_t pin, uint8_t val);
+    int digitalRead(uint8_t pin);
+    void analogWrite(uint8_t pin, int val);
+
+#endif //CMD_HOST_ARDUINO_H
@@ -0,0 +1,70 @@
+/*******************************************************************
+    Host stand-in for the Arduino core HardwareSerial class
+
+    Instead of a UART, the host serial port is fed from a scripted byte
+    stream (inject()) and everything written to it is counted and,
+    optionally, captured so benchmarks and sketches can inspect it.
+*******************************************************************/
+#ifndef CMD_HOST_HARDWARESERIAL_H
+    #define CMD_HOST_HARDWARESERIAL_H
+
+    #include <stdint.h>
+    #include <string>
+    #include <vector>
+    #include "Stream.h"
+
+    #define SERIAL_8N1 0x06
+
+    class HardwareSerial : public Stream
+    {
+        public:
+            void begin(unsigned long baud, uint32_t config = SERIAL_8N1) {_baud = baud; (void)config;}
+            void end() {}
+            operator bool() {return true;}
+
+            /* Stream interface */
+            int available() override;
+            int read() override;
+            int peek() override;
+            size_t readBytes(char *buffer, size_t length) override;
+
+            /* Print interface */
+            size_t write(uint8_t c) override;
+            size_t write(const uint8_t *buffer, size_t size) override;
+            int availableForWrite() override {return 64;}
+            using Print::write;
+
+            /* Host only: queue bytes to be returned by read() */
+            void inject(const char *str);
+            void inject(const uint8_t *data, size_t len);
+
+            /* Host only: drop any un-read input */
+            void clear_input();
+
+            /* Host only: keep a copy of every byte written (off by default to keep benchmarks allocation free) */
+            void capture(bool enable) {_capture = enable;}
+
+            /* Host only: captured output (only valid when capture(true) is set) */
+            const std::string &output() const {return _output;}
+            void clear_output() {_output.clear();}
+
+            /* Host only: byte / call counters for the TX side */
+            uint64_t tx_bytes() const {return _tx_bytes;}
+            uint64_t tx_calls() const {return _tx_calls;}
+            void reset_counters() {_tx_bytes = 0; _tx_calls = 0;}
+
+        private:
+            std::vector<uint8_t> _input;
+            size_t _input_pos = 0;
+            std::string _output;
+            bool _capture = false;
+            uint64_t _tx_bytes = 0;
+            uint64_t _tx_calls = 0;
+            unsigned long _baud = 0;
+    };
+
+    extern HardwareSerial Serial;
+    extern HardwareSerial Serial1;
+    extern HardwareSerial Serial2;
+
+#endif //CMD_HOST_HARDWARESERIAL_H
@@ -0,0 +1,177 @@
+/*******************************************************************
+    Host stand-in implementation of the Arduino core subset declared
+    in Arduino.h / Print.h / Stream.h / HardwareSerial.h
+*******************************************************************/
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+
+/* Host serial ports */
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+
+/* Time base shared by millis() / micros() */
+static const std::chrono::steady_clock::time_point host_epoch = std::chrono::steady_clock::now();
+
+unsigned long millis(void) {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - host_epoch).count();
+}
+
+unsigned long micros(void) {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - host_epoch).count();
+}
+
+void delay(unsigned long ms) {std::this_thread::sleep_for(std::chrono::milliseconds(ms));}
+void delayMicroseconds(unsigned int us) {std::this_thread::sleep_for(std::chrono::microseconds(us));}
+void yield(void) {std::this_thread::yield();}
+
+/* GPIO has nowhere to go on the host */
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) {return LOW;}
+void analogWrite(uint8_t, int) {}
+
+/**************************************************************************/
+/*!
+    Print
+*/
+/**************************************************************************/
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++)) {n++;} else {break;}
+    }
+    return n;
+}
+
+size_t Print::print(const __FlashStringHelper *str) {return write((const char *)str);}
+size_t Print::print(const char str[]) {return write(str);}
+size_t Print::print(char c) {return write((uint8_t)c);}
+size_t Print::print(unsigned char n, int base) {return print((unsigned long)n, base);}
+size_t Print::print(int n, int base) {return print((long)n, base);}
+size_t Print::print(unsigned int n, int base) {return print((unsigned long)n, base);}
+
+size_t Print::print(long n, int base) {
+    if (base == 0) {return write((uint8_t)n);}
+    if (base == 10 && n < 0) {
+        size_t t = print('-');
+        return printNumber((unsigned long)(-n), 10) + t;
+    }
+    return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+    if (base == 0) {return write((uint8_t)n);}
+    return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+size_t Print::println(void) {return write("\r\n");}
+size_t Print::println(const __FlashStringHelper *str) {size_t n = print(str); return n + println();}
+size_t Print::println(const char str[]) {size_t n = print(str); return n + println();}
+size_t Print::println(char c) {size_t n = print(c); return n + println();}
+size_t Print::println(unsigned char b, int base) {size_t n = print(b, base); return n + println();}
+size_t Print::println(int num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(unsigned int num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(long num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(unsigned long num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(double num, int digits) {size_t n = print(num, digits); return n + println();}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+
+    *str = '\0';
+    if (base < 2) {base = 10;}
+
+    do {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+
+    return write(str);
+}
+
+/**************************************************************************/
+/*!
+    Stream
+*/
+/**************************************************************************/
+size_t Stream::readBytes(char *buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = read();
+        if (c < 0) {break;}
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
+
+/**************************************************************************/
+/*!
+    HardwareSerial
+*/
+/**************************************************************************/
+int HardwareSerial::available() {
+    return (int)(_input.size() - _input_pos);
+}
+
+int HardwareSerial::read() {
+    if (_input_pos >= _input.size()) {return -1;}
+    return _input[_input_pos++];
+}
+
+int HardwareSerial::peek() {
+    if (_input_pos >= _input.size()) {return -1;}
+    return _input[_input_pos];
+}
+
+size_t HardwareSerial::readBytes(char *buffer, size_t length) {
+    /* Bulk copy, like the ESP32 / RP2040 cores which read straight out of the driver's RX FIFO */
+    size_t count = _input.size() - _input_pos;
+    if (count > length) {count = length;}
+    if (!count) {return 0;}
+    memcpy(buffer, &_input[_input_pos], count);
+    _input_pos += count;
+    return count;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    _tx_bytes++;
+    _tx_calls++;
+    if (_capture) {_output.push_back((char)c);}
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    _tx_bytes += size;
+    _tx_calls++;
+    if (_capture) {_output.append((const char *)buffer, size);}
+    return size;
+}
+
+void HardwareSerial::inject(const char *str) {
+    inject((const uint8_t *)str, strlen(str));
+}
+
+void HardwareSerial::inject(const uint8_t *data, size_t len) {
+    /* Compact the consumed prefix so long-running benchmarks don't grow without bound */
+    if (_input_pos == _input.size()) {
+        _input.clear();
+        _input_pos = 0;
+    }
+    _input.insert(_input.end(), data, data + len);
+}
+
+void HardwareSerial::clear_input() {
+    _input.clear();
+    _input_pos = 0;
+}
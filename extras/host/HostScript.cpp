@@ -0,0 +1,22 @@
+/*******************************************************************
+    Host build helper: run a command script stored in a file
+*******************************************************************/
+#include <stdio.h>
+#include <string>
+#include "HostScript.h"
+
+uint8_t cmd_run_script_file(CmdBase &cmd, const char *path, cmd_script_result_t *result, uint8_t flags) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        if (result) {*result = cmd_script_result_t();}
+        return false;
+    }
+
+    std::string script;
+    char chunk[512];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {script.append(chunk, len);}
+    fclose(f);
+
+    return cmd.run_script(script.c_str(), result, flags);
+}
@@ -0,0 +1,20 @@
+/*******************************************************************
+    Host build helper: run a command script stored in a file
+
+    Reads the whole file and hands it to Cmd::run_script(), e.g. to
+    replay a provisioning script against the host build:
+
+        cmd_run_script_file(cmd, "provision.txt");
+*******************************************************************/
+#ifndef CMD_HOST_SCRIPT_H
+    #define CMD_HOST_SCRIPT_H
+
+    #include "cmdArduino.h"
+
+    /**
+     * @brief Run the script in a file (see Cmd::run_script())
+     * @retval true if the file was read and every line ran without error
+    */
+    uint8_t cmd_run_script_file(CmdBase &cmd, const char *path, cmd_script_result_t *result = NULL, uint8_t flags = CMD_SCRIPT_DEFAULT);
+
+#endif //CMD_HOST_SCRIPT_H
@@ -0,0 +1,62 @@
+/*******************************************************************
+    Host stand-in for the Arduino core Print class
+
+    Only the subset of the Arduino API used by cmdArduino and its
+    examples is provided.  All formatting funnels into the two virtual
+    write() calls, exactly like the Arduino core, so the per-call
+    overhead measured on the host is representative of the device.
+*******************************************************************/
+#ifndef CMD_HOST_PRINT_H
+    #define CMD_HOST_PRINT_H
+
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <string.h>
+
+    #define DEC 10
+    #define HEX 16
+    #define OCT 8
+    #define BIN 2
+
+    class __FlashStringHelper;
+    #define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+    class Print
+    {
+        public:
+            virtual ~Print() {}
+
+            virtual size_t write(uint8_t c) = 0;
+            virtual size_t write(const uint8_t *buffer, size_t size);
+            size_t write(const char *str) {return str ? write((const uint8_t *)str, strlen(str)) : 0;}
+            size_t write(const char *buffer, size_t size) {return write((const uint8_t *)buffer, size);}
+
+            virtual int availableForWrite() {return 0;}
+            virtual void flush() {}
+
+            size_t print(const __FlashStringHelper *str);
+            size_t print(const char str[]);
+            size_t print(char c);
+            size_t print(unsigned char n, int base = DEC);
+            size_t print(int n, int base = DEC);
+            size_t print(unsigned int n, int base = DEC);
+            size_t print(long n, int base = DEC);
+            size_t print(unsigned long n, int base = DEC);
+            size_t print(double n, int digits = 2);
+
+            size_t println(const __FlashStringHelper *str);
+            size_t println(const char str[]);
+            size_t println(char c);
+            size_t println(unsigned char n, int base = DEC);
+            size_t println(int n, int base = DEC);
+            size_t println(unsigned int n, int base = DEC);
+            size_t println(long n, int base = DEC);
+            size_t println(unsigned long n, int base = DEC);
+            size_t println(double n, int digits = 2);
+            size_t println(void);
+
+        private:
+            size_t printNumber(unsigned long n, uint8_t base);
+    };
+
+#endif //CMD_HOST_PRINT_H
@@ -0,0 +1,27 @@
+/*******************************************************************
+    Host stand-in for the Arduino core Stream class
+*******************************************************************/
+#ifndef CMD_HOST_STREAM_H
+    #define CMD_HOST_STREAM_H
+
+    #include "Print.h"
+
+    class Stream : public Print
+    {
+        public:
+            virtual int available() = 0;
+            virtual int read() = 0;
+            virtual int peek() = 0;
+
+            void setTimeout(unsigned long timeout) {_timeout = timeout;}
+            unsigned long getTimeout(void) {return _timeout;}
+
+            /* Same contract as the Arduino core: stops early when read() runs dry (no blocking on the host) */
+            virtual size_t readBytes(char *buffer, size_t length);
+            size_t readBytes(uint8_t *buffer, size_t length) {return readBytes((char *)buffer, length);}
+
+        protected:
+            unsigned long _timeout = 1000;
+    };
+
+#endif //CMD_HOST_STREAM_H
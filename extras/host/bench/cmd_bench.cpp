@@ -0,0 +1,1613 @@
+/*******************************************************************
+    cmdArduino host benchmark suite
+
+    Pushes scripted byte streams through Cmd::poll() on the host serial
+    stand-in and reports:
+        - ingest throughput (bytes/sec through poll())
+        - dispatch latency (CR received -> handler returned, per line)
+        - bytes echoed / print calls issued back to the terminal
+
+    Every scenario also checks its results; a failed check prints a
+    line starting with "!!" and makes the run exit non-zero (ctest runs
+    each build variant with a small iteration count for these checks).
+
+    Usage: cmd_bench [iterations] [filter]
+        iterations  lines / keystrokes per scenario (default 20000)
+        filter      only run scenarios whose name contains this string
+*******************************************************************/
+#include <atomic>
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include "cmdArduino.h"
+#include "HostScript.h"
+
+/* Number of commands registered for the dispatch scenarios (typical for our larger sketches) */
+#define BENCH_CMD_COUNT 64
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Shared result record printed by every scenario */
+typedef struct
+{
+    uint64_t bytes_in;      // bytes fed through poll()
+    uint64_t units;         // lines (or keystrokes) processed
+    double seconds;         // wall time spent inside poll()
+    uint64_t bytes_out;     // bytes written back to the stream
+    uint64_t write_calls;   // number of write() calls issued to the stream
+} bench_result_t;
+
+static uint32_t handler_calls = 0;
+static uint32_t json_calls = 0;
+
+/* Number of failed checks, the exit status of the run */
+static uint32_t bench_failures = 0;
+
+/* Report a failed check (printf() format) */
+static void bench_fail(const char *fmt, ...) {
+    va_list args;
+
+    bench_failures++;
+    printf("  !! ");
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+static void bench_handler(int argc, char **argv) {handler_calls++;}
+static void bench_json_handler(char *json_msg) {json_calls++;}
+
+/* Last JSON message received by bench_json_capture() */
+static std::string json_last;
+static void bench_json_capture(char *json_msg) {json_last = json_msg; json_calls++;}
+
+static char cmd_names[BENCH_CMD_COUNT][12];
+
+static double elapsed(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/* Register BENCH_CMD_COUNT commands: cmd00 .. cmdNN */
+static void bench_add_cmds(CmdBase &cmd) {
+    for (int i = 0; i < BENCH_CMD_COUNT; i++) {
+        snprintf(cmd_names[i], sizeof(cmd_names[i]), "cmd%02d", i);
+        cmd.add(cmd_names[i], bench_handler);
+    }
+}
+
+/* Feed the whole script in one go and time how long poll() takes to drain it */
+static bench_result_t bench_ingest(Cmd &cmd, const std::string &script, uint64_t units) {
+    bench_result_t r = {};
+
+    Serial.reset_counters();
+    Serial.inject((const uint8_t *)script.data(), script.size());
+
+    bench_clock::time_point start = bench_clock::now();
+    while (Serial.available()) {cmd.poll();}
+    r.seconds = elapsed(start);
+
+    r.bytes_in = script.size();
+    r.units = units;
+    r.bytes_out = Serial.tx_bytes();
+    r.write_calls = Serial.tx_calls();
+    return r;
+}
+
+/* Feed each line without its terminator (CR by default), then time only the poll() that sees the terminator */
+static bench_result_t bench_dispatch(CmdBase &cmd, const char *line, uint32_t iterations, const char *terminator = "\r") {
+    bench_result_t r = {};
+    size_t len = strlen(line) + strlen(terminator) - 1;
+
+    Serial.reset_counters();
+    for (uint32_t i = 0; i < iterations; i++) {
+        Serial.inject(line);
+        cmd.poll();
+
+        Serial.inject(terminator);
+        bench_clock::time_point start = bench_clock::now();
+        cmd.poll();
+        r.seconds += elapsed(start);
+    }
+
+    r.bytes_in = (uint64_t)(len + 1) * iterations;
+    r.units = iterations;
+    r.bytes_out = Serial.tx_bytes();
+    r.write_calls = Serial.tx_calls();
+    return r;
+}
+
+static void bench_report(const char *name, const char *unit, const bench_result_t &r) {
+    double mbps = r.seconds > 0 ? (r.bytes_in / r.seconds) / 1e6 : 0;
+    double ns_per_unit = r.units ? (r.seconds * 1e9) / r.units : 0;
+    printf("%-28s %10.2f MB/s %10.0f ns/%-5s %10.1f out B/%-5s %8.1f writes/%s\n",
+        name, mbps, ns_per_unit, unit,
+        r.units ? (double)r.bytes_out / r.units : 0, unit,
+        r.units ? (double)r.write_calls / r.units : 0, unit);
+}
+
+/* Print that keeps everything written to it */
+class BenchPrint : public Print
+{
+    public:
+        std::string out;
+        size_t write(uint8_t c) {out.push_back((char)c); return 1;}
+        using Print::write;
+};
+
+/**************************************************************************/
+/*!
+    Scenarios
+*/
+/**************************************************************************/
+
+/* CLI_MODE_STD: stream of short commands spread across the table */
+static void scn_std_ingest(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+
+    std::string script;
+    char line[64];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "cmd%02u arg1 0x1234 567\r", (unsigned)(i % BENCH_CMD_COUNT));
+        script += line;
+    }
+
+    handler_calls = 0;
+    bench_result_t r = bench_ingest(cmd, script, iterations);
+    bench_report("std_ingest", "line", r);
+    if (handler_calls != iterations) {bench_fail("expected %u handler calls, got %u\n", (unsigned)iterations, (unsigned)handler_calls);}
+}
+
+/* CLI_MODE_STD: CR -> handler latency for the first and last registered command */
+static void scn_std_dispatch(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+
+    char line[64];
+    snprintf(line, sizeof(line), "%s arg1 arg2", cmd_names[0]);
+    bench_report("std_dispatch_first_added", "line", bench_dispatch(cmd, line, iterations));
+
+    snprintf(line, sizeof(line), "%s arg1 arg2", cmd_names[BENCH_CMD_COUNT - 1]);
+    bench_report("std_dispatch_last_added", "line", bench_dispatch(cmd, line, iterations));
+
+    bench_report("std_dispatch_unknown", "line", bench_dispatch(cmd, "nosuchcmd arg1", iterations));
+}
+
+/* CLI_MODE_STD: same as std_dispatch, after freeze() has built the hashed index */
+static void scn_frozen_dispatch(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+    cmd.freeze();
+
+    char line[64];
+    snprintf(line, sizeof(line), "%s arg1 arg2", cmd_names[0]);
+    bench_report("frozen_dispatch_first_added", "line", bench_dispatch(cmd, line, iterations));
+
+    snprintf(line, sizeof(line), "%s arg1 arg2", cmd_names[BENCH_CMD_COUNT - 1]);
+    bench_report("frozen_dispatch_last_added", "line", bench_dispatch(cmd, line, iterations));
+
+    bench_report("frozen_dispatch_unknown", "line", bench_dispatch(cmd, "nosuchcmd arg1", iterations));
+
+    /* remove() / replace() must keep the index consistent */
+    handler_calls = 0;
+    cmd.remove(cmd_names[1]);
+    cmd.replace(cmd_names[2], bench_handler);
+    Serial.inject("cmd01\rcmd02\rcmd03\r");
+    cmd.poll();
+    if (handler_calls != 2) {bench_fail("remove/replace: expected 2 handler calls, got %u\n", (unsigned)handler_calls);}
+}
+
+/* CLI_MODE_STD: Up + CR re-runs the previous line from its cached parse result */
+static int last_argc = 0;
+static void bench_argc_handler(int argc, char **argv) {last_argc = argc; handler_calls++;}
+
+static void scn_history_recall(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    CmdHistory<> hist;
+    cmd.attach_history(&hist);
+    bench_add_cmds(cmd);
+    cmd.replace(cmd_names[0], bench_argc_handler);
+
+    Serial.inject("cmd00 poll 0x10 4\r");
+    cmd.poll();
+
+    handler_calls = 0;
+    bench_report("history_recall_dispatch", "line", bench_dispatch(cmd, "\e[A", iterations));
+    if (handler_calls != iterations || last_argc != 4) {bench_fail("expected %u calls with argc 4, got %u (argc %d)\n", (unsigned)iterations, (unsigned)handler_calls, last_argc);}
+
+    /* A cached handler must not survive 256 table changes (the generation used to be 8-bit) */
+    handler_calls = 0;
+    last_argc = 0;
+    cmd.remove(cmd_names[0]);
+    cmd.add(cmd_names[0], bench_handler);
+    for (int i = 0; i < 254; i++) {cmd.replace(cmd_names[1], bench_handler);}
+    Serial.inject("\e[A\r");
+    cmd.poll();
+    if (handler_calls != 1 || last_argc) {bench_fail("history ran a stale handler after 256 table changes\n");}
+
+    /* ... nor a switch to another table, whatever its generation */
+    CmdTable other;
+    Cmd fresh(&Serial);
+    CmdHistory<> fresh_hist;
+    fresh.attach_history(&fresh_hist);
+    fresh.add(cmd_names[0], bench_argc_handler);
+    other.add(cmd_names[0], bench_handler);
+    Serial.inject("cmd00 x\r");
+    fresh.poll();
+    handler_calls = 0;
+    last_argc = 0;
+    fresh.use_table(&other);
+    Serial.inject("\e[A\r");
+    fresh.poll();
+    if (handler_calls != 1 || last_argc) {bench_fail("history ran a handler of the previous table after use_table()\n");}
+
+    /* Without a history ring, Up does nothing */
+    Cmd plain(&Serial);
+    plain.add(cmd_names[0], bench_handler);
+    Serial.inject("cmd00\r");
+    plain.poll();
+    handler_calls = 0;
+    Serial.inject("\e[A\r");
+    plain.poll();
+    if (handler_calls) {bench_fail("Up recalled a line without a history ring\n");}
+}
+
+/* CLI_MODE_JSON: stream of flat JSON objects */
+static void scn_json_ingest(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    cmd.attach_json_callback(bench_json_handler);
+    cmd.mode(CLI_MODE_JSON);
+
+    std::string script;
+    char line[96];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "{\"cmd\":\"set\",\"reg\":%u,\"val\":\"0x%04X\"}\r", (unsigned)(i & 0xFF), (unsigned)(i & 0xFFFF));
+        script += line;
+    }
+
+    json_calls = 0;
+    bench_result_t r = bench_ingest(cmd, script, iterations);
+    bench_report("json_ingest", "msg", r);
+    if (json_calls != iterations) {bench_fail("expected %u json calls, got %u\n", (unsigned)iterations, (unsigned)json_calls);}
+
+    /* Backspace (BS or DEL) still edits the message, as it did before the bulk copy */
+    cmd.attach_json_callback(bench_json_capture);
+    Serial.inject("{\"reg\":12\b3,\"val\":5\x7f" "7}\r");
+    while (Serial.available()) {cmd.poll();}
+    if (json_last != "{\"reg\":13,\"val\":7}") {bench_fail("backspace in JSON mode: got '%s'\n", json_last.c_str());}
+}
+
+/* Token callback: look up a nested field, as a typical handler would */
+static int32_t json_reg_sum = 0;
+static void bench_json_tok_handler(char *json_msg, cmd_json_tok_t *toks, int16_t tok_count) {
+    int16_t args = cmd_json_find(json_msg, toks, tok_count, 0, "args");
+    int16_t reg = cmd_json_find(json_msg, toks, tok_count, args, "reg");
+    if (reg > 0) {json_reg_sum += cmd_json_int(json_msg, &toks[reg]);}
+    json_calls++;
+}
+
+/* CLI_MODE_JSON: nested messages through the built-in tokenizer */
+static void scn_json_tokens(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    CmdJsonState<> json;
+    cmd.attach_json_state(&json);
+    cmd.attach_json_callback(bench_json_tok_handler);
+    cmd.mode(CLI_MODE_JSON);
+
+    std::string script;
+    char line[128];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "{\"cmd\":\"set\",\"args\":{\"reg\":%u,\"val\":[1,2,\"x\\\"y\"]},\"ack\":true}\r", (unsigned)(i & 0xFF));
+        script += line;
+    }
+
+    /* malformed messages must be rejected without reaching the callback */
+    std::string malformed = "{\"cmd\":}\r{\"cmd\"}\r{\"a\":1}{\"b\":2}\r{\"a\":[1,2}\r{\"a\":[1}]\r[1]\r";
+    malformed += "{\"a\":1 \"b\":2}\r{\"a\":[1 2]}\r{\"a\" 1}\r{\"a\":1,}\r{\"a\":tru}\r{\"a\":-}\r{\"a\":1.2.3}\r{\"a\":0x}\r";
+    script += malformed;
+
+    /* every kind of primitive, including the hex extension */
+    script += "{\"args\":{\"reg\":0x10,\"val\":[-1.5e3,0.25,007,null,false]}}\r";
+
+    json_calls = 0;
+    json_reg_sum = 0;
+    bench_result_t r = bench_ingest(cmd, script, iterations);
+    bench_report("json_tokens_nested", "msg", r);
+    if (json_calls != iterations + 1) {bench_fail("expected %u json calls, got %u\n", (unsigned)(iterations + 1), (unsigned)json_calls);}
+
+    int32_t expected = 0x10;
+    for (uint32_t i = 0; i < iterations; i++) {expected += (i & 0xFF);}
+    if (json_reg_sum != expected) {bench_fail("expected reg sum %ld, got %ld\n", (long)expected, (long)json_reg_sum);}
+
+    /* Without a JSON state the messages are checked just as strictly, and only the plain callback runs */
+    Cmd plain(&Serial);
+    plain.attach_json_callback(bench_json_handler);
+    plain.mode(CLI_MODE_JSON);
+    json_calls = 0;
+    Serial.inject((malformed + "{\"a\":[1,{\"b\":null}]}\r").c_str());
+    while (Serial.available()) {plain.poll();}
+    if (json_calls != 1) {bench_fail("without a JSON state: expected 1 json call, got %u\n", (unsigned)json_calls);}
+}
+
+/* CLI_MODE_JSON_STREAM: back-to-back nested objects with no CR, dispatched on the closing brace */
+static void scn_json_stream(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    CmdJsonState<> json;
+    cmd.attach_json_state(&json);
+    cmd.attach_json_callback(bench_json_tok_handler);
+    cmd.mode(CLI_MODE_JSON_STREAM);
+
+    std::string script;
+    char line[128];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "{\"cmd\":\"set\",\"args\":{\"reg\":%u,\"val\":\"}{\\\"\"}}%s", (unsigned)(i & 0xFF), (i % 3) ? "" : "\r\n");
+        script += line;
+    }
+
+    json_calls = 0;
+    json_reg_sum = 0;
+    bench_result_t r = bench_ingest(cmd, script, iterations);
+    bench_report("json_stream_ingest", "msg", r);
+    if (json_calls != iterations) {bench_fail("expected %u json calls, got %u\n", (unsigned)iterations, (unsigned)json_calls);}
+
+    int32_t expected = 0;
+    for (uint32_t i = 0; i < iterations; i++) {expected += (i & 0xFF);}
+    if (json_reg_sum != expected) {bench_fail("expected reg sum %ld, got %ld\n", (long)expected, (long)json_reg_sum);}
+
+    bench_report("json_stream_dispatch", "msg", bench_dispatch(cmd, "{\"cmd\":\"get\",\"args\":{\"reg\":12}", iterations, "}"));
+
+    /* ESC ESC between messages requests an exit, ESC bytes that aren't back to back don't */
+    Serial.inject("\e{\"a\":1}\e \e");
+    while (Serial.available()) {cmd.poll();}
+    if (cmd.exit_cli()) {bench_fail("separated ESC bytes requested an exit\n");}
+    Serial.inject("\e\e");
+    while (Serial.available()) {cmd.poll();}
+    if (!cmd.exit_cli()) {bench_fail("double ESC did not request an exit in CLI_MODE_JSON_STREAM\n");}
+
+    /* A message too long for the buffer is dropped whole: nothing nested in its tail is dispatched on its own */
+    CmdT<32, 8> small(&Serial);
+    small.attach_json_callback(bench_json_capture);
+    small.mode(CLI_MODE_JSON_STREAM);
+    json_calls = 0;
+    json_last.clear();
+    Serial.inject(("{\"pad\":\"" + std::string(38, 'a') + "\",\"inner\":{\"cmd\":\"reboot\",\"s\":\"}{\\\"\"}}").c_str());
+    while (Serial.available()) {small.poll();}
+    if (json_calls) {bench_fail("oversized JSON message: its tail was dispatched as '%s'\n", json_last.c_str());}
+    Serial.inject("{\"cmd\":\"ok\"}");
+    while (Serial.available()) {small.poll();}
+    if (json_calls != 1 || json_last != "{\"cmd\":\"ok\"}") {bench_fail("after an oversized JSON message: expected 1 call with the next message, got %u / '%s'\n", (unsigned)json_calls, json_last.c_str());}
+}
+
+/* CLI_MODE_JSON: CR -> callback latency */
+static void scn_json_dispatch(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    cmd.attach_json_callback(bench_json_handler);
+    cmd.mode(CLI_MODE_JSON);
+
+    bench_report("json_dispatch", "msg", bench_dispatch(cmd, "{\"cmd\":\"get\",\"reg\":12}", iterations));
+}
+
+/* JSON replies: streaming writer vs snprintf into a stack buffer + print */
+static const char bench_reply_expected[] = "{\"ok\":true,\"reg\":12,\"name\":\"adc \\\"0\\\"\",\"vals\":[0,100,200,300]}\r\n";
+
+static void bench_reply_writer(char *json_msg) {
+    CmdJsonWriter out;
+    out.begin_object();
+    out.field("ok", true);
+    out.field("reg", 12);
+    out.field("name", "adc \"0\"");
+    out.begin_array("vals");
+    for (int i = 0; i < 4; i++) {out.value(i * 100);}
+    out.end_array();
+    out.end_object();
+}
+
+static void bench_reply_sprintf(char *json_msg) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "{\"ok\":%s,\"reg\":%d,\"name\":\"%s\",\"vals\":[%d,%d,%d,%d]}\r\n", "true", 12, "adc \\\"0\\\"", 0, 100, 200, 300);
+    CmdBase::stream()->print(buf);
+}
+
+static void scn_json_reply(uint32_t iterations) {
+    /* formatting: nesting, escapes, flash strings, non-finite numbers, and closing what the caller left open */
+    BenchPrint p;
+    {
+        CmdJsonWriter out(&p);
+        out.begin_object();
+        out.field("s", "tab\there\x01\\");
+        out.field("f", F("flash"));
+        out.field("pi", 3.14159, 3);
+        out.field("nan", NAN);
+        out.key("none");
+        out.value_null();
+        out.begin_array("list");
+        out.begin_object();
+        out.field("n", -5L);
+        out.end_object();
+        out.begin_array();
+        out.end_array();
+        out.raw("{\"pre\":1}");
+        out.field("bad", 1);
+        if (!out.error()) {bench_fail("key inside an array was not flagged\n");}
+    }
+    const char *expected = "{\"s\":\"tab\\there\\u0001\\\\\",\"f\":\"flash\",\"pi\":3.142,\"nan\":null,\"none\":null,"
+                           "\"list\":[{\"n\":-5},[],{\"pre\":1},\"bad\":1]}\r\n";
+    if (p.out != expected) {bench_fail("writer: expected\n     %s\n     got\n     %s\n", expected, p.out.c_str());}
+
+    /* replies go to the stream of the command being dispatched */
+    Cmd cmd(&Serial);
+    cmd.mode(CLI_MODE_JSON);
+    cmd.attach_json_callback(bench_reply_writer);
+    Serial.capture(true);
+    Serial.clear_output();
+    Serial.inject("{\"cmd\":\"get\",\"reg\":12}\r");
+    cmd.poll();
+    Serial.capture(false);
+    if (Serial.output() != bench_reply_expected) {bench_fail("reply: expected '%s', got '%s'\n", bench_reply_expected, Serial.output().c_str());}
+
+    bench_report("json_reply_writer", "msg", bench_dispatch(cmd, "{\"cmd\":\"get\",\"reg\":12}", iterations));
+
+    cmd.attach_json_callback(bench_reply_sprintf);
+    bench_report("json_reply_snprintf", "msg", bench_dispatch(cmd, "{\"cmd\":\"get\",\"reg\":12}", iterations));
+}
+
+/* JSON requests pipelined with an "id": replies carry the id, deferred requests are answered out of order */
+#if CMD_JSON_PENDING
+static uint8_t pipeline_tickets[CMD_JSON_PENDING];
+static uint8_t pipeline_deferred = 0;
+#endif
+
+static void bench_pipeline_handler(char *json_msg, cmd_json_tok_t *toks, int16_t tok_count) {
+    CmdJsonWriter out;
+
+    #if CMD_JSON_PENDING
+        int16_t slow = cmd_json_find(json_msg, toks, tok_count, 0, "slow");
+        if (slow >= 0) {
+            uint8_t ticket = CmdBase::active()->json_defer();
+            if (ticket != CMD_JSON_NO_TICKET) {
+                pipeline_tickets[pipeline_deferred++] = ticket;
+                return;
+            }
+            out.begin_object();
+            out.field("error", "busy");
+            out.end_object();
+            return;
+        }
+    #endif
+
+    out.begin_object();
+    out.field("ok", true);
+    out.end_object();
+}
+
+static void scn_json_pipeline(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    CmdJsonState<> json;
+    cmd.attach_json_state(&json);
+    cmd.mode(CLI_MODE_JSON);
+    cmd.attach_json_callback(bench_pipeline_handler);
+
+    /* several requests in flight; a too long id is rejected rather than answered without it */
+    Serial.capture(true);
+    Serial.clear_output();
+    Serial.inject("{\"id\":1,\"cmd\":\"get\"}\r{\"cmd\":\"get\",\"id\":\"b\\\"2\"}\r{\"cmd\":\"get\"}\r{\"id\":\"0123456789abcdef\",\"cmd\":\"get\"}\r");
+    while (Serial.available()) {cmd.poll();}
+    const char *expected = "{\"id\":1,\"ok\":true}\r\n{\"id\":\"b\\\"2\",\"ok\":true}\r\n{\"ok\":true}\r\n";
+    if (Serial.output() != expected) {bench_fail("pipelined replies: expected\n     %s\n     got\n     %s\n", expected, Serial.output().c_str());}
+
+    #if CMD_JSON_PENDING
+        /* deferred requests, answered in reverse order; one more than the queue holds is turned away */
+        pipeline_deferred = 0;
+        Serial.clear_output();
+        std::string script;
+        std::string busy;
+        char line[64];
+        for (uint32_t i = 0; i <= CMD_JSON_PENDING; i++) {
+            snprintf(line, sizeof(line), "{\"id\":%u,\"slow\":1}\r", (unsigned)(10 + i));
+            script += line;
+        }
+        Serial.inject((const uint8_t *)script.data(), script.size());
+        while (Serial.available()) {cmd.poll();}
+        snprintf(line, sizeof(line), "{\"id\":%u,\"error\":\"busy\"}\r\n", (unsigned)(10 + CMD_JSON_PENDING));
+        if (pipeline_deferred != CMD_JSON_PENDING || cmd.json_pending() != CMD_JSON_PENDING || Serial.output() != line) {
+            bench_fail("expected %u deferred + '%s', got %u / '%s'\n", (unsigned)CMD_JSON_PENDING, line, (unsigned)pipeline_deferred, Serial.output().c_str());
+        }
+
+        Serial.clear_output();
+        expected = "";
+        std::string replies;
+        for (int i = pipeline_deferred - 1; i >= 0; i--) {
+            CmdJsonWriter out(&cmd, pipeline_tickets[i]);
+            out.begin_object();
+            out.field("value", i);
+            out.end_object();
+            snprintf(line, sizeof(line), "{\"id\":%u,\"value\":%d}\r\n", (unsigned)(10 + i), i);
+            replies += line;
+        }
+        if (cmd.json_pending() || Serial.output() != replies) {bench_fail("deferred replies: expected\n     %s\n     got\n     %s\n", replies.c_str(), Serial.output().c_str());}
+    #endif
+    Serial.capture(false);
+
+    /* throughput of a pipelined burst, one reply per request */
+    std::string burst;
+    char req[64];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(req, sizeof(req), "{\"id\":%u,\"cmd\":\"get\"}\r", (unsigned)i);
+        burst += req;
+    }
+    bench_report("json_pipeline_ingest", "msg", bench_ingest(cmd, burst, iterations));
+}
+
+/* CLI_MODE_STD: cost of editing in the middle of a long line (insert + DEL), measured per keystroke */
+static std::string edit_argv;
+static void bench_edit_handler(int argc, char **argv) {
+    edit_argv.clear();
+    for (int i = 0; i < argc; i++) {
+        if (i) {edit_argv += '|';}
+        edit_argv += argv[i];
+    }
+}
+
+static void scn_std_edit_midline(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+    cmd.add("edit", bench_edit_handler);
+
+    /* The edited line is what gets dispatched: insert, BS, DEL, Home / End and cursor moves in the middle of the line */
+    std::string longarg(300, 'x');
+    std::string fullarg(CMD_MAX_MSG_SIZE - 1 - 5, 'z');
+    const std::string lines[][2] = {
+        {"edit wrld\e[D\e[D\e[Do\r",                          "edit|world"},
+        {"edit abXc\e[D\b\r",                                  "edit|abc"},
+        {"edit abXc\e[D\e[D\e[3~\r",                          "edit|abc"},
+        {"dit a\e[He\e[Fb c\r",                                "edit|ab|c"},
+        {"edit " + longarg + "\e[H\e[C\e[C\e[C\e[C\e[Cy \r",  "edit|y|" + longarg},
+        {"edit " + longarg + "\e[D\e[D\b\e[3~\e[Fyy\r",       "edit|" + longarg.substr(2) + "yy"},
+        {"edit " + fullarg + "\r",                               "edit|" + fullarg},
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        edit_argv.clear();
+        Serial.inject((const uint8_t *)lines[i][0].data(), lines[i][0].size());
+        while (Serial.available()) {cmd.poll();}
+        if (edit_argv != lines[i][1]) {bench_fail("edited line %u: expected argv '%.40s...', got '%.40s...' (%u bytes)\n", (unsigned)i, lines[i][1].c_str(), edit_argv.c_str(), (unsigned)edit_argv.size());}
+    }
+
+    /* 200 character line, cursor moved back to the middle */
+    std::string setup = "cmd00 ";
+    setup.append(194, 'x');
+    for (int i = 0; i < 100; i++) {setup += "\e[D";}
+    Serial.inject(setup.c_str());
+    cmd.poll();
+
+    /* alternate insert / delete so the line length stays constant */
+    std::string script;
+    for (uint32_t i = 0; i < iterations; i++) {
+        script += (i & 1) ? "\b" : "y";
+    }
+
+    bench_result_t r = bench_ingest(cmd, script, iterations);
+    bench_report("std_edit_midline", "key", r);
+
+    /* Only the tail after the cursor (100 characters) is redrawn, and the cursor goes back with a single
+       parameterized move: about 108 bytes in 2 writes per key (3 now and then, when a redraw straddles the tx buffer) */
+    if (r.bytes_out > 116 * (uint64_t)iterations || r.write_calls > 2 * (uint64_t)iterations + iterations / 32 + 16) {
+        bench_fail("mid-line editing: %.1f bytes in %.2f writes per key, expected <= 116 in <= 2.03\n",
+            (double)r.bytes_out / iterations, (double)r.write_calls / iterations);
+    }
+
+    /* Same for a single keystroke per poll() (the redraw is larger than CMD_TX_BUF_SIZE, hence up to 3 writes) */
+    static const char *const keys[] = {"y", "\b", "\e[3~"};
+    static const char *const back[] = {"\e[100D", "\e[101D", "\e[100D"};
+    Serial.capture(true);
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        Serial.clear_output();
+        Serial.reset_counters();
+        Serial.inject(keys[i]);
+        cmd.poll();
+        const std::string &out = Serial.output();
+        if (Serial.tx_bytes() > 100 + 16 || Serial.tx_calls() > 3 || out.find(back[i]) == std::string::npos || out.find("\e[D\e[D") != std::string::npos) {
+            bench_fail("redraw of key %u: %u bytes in %u writes, expected <= 116 in <= 3 ending in %s\n",
+                (unsigned)i, (unsigned)Serial.tx_bytes(), (unsigned)Serial.tx_calls(), back[i] + 1);
+        }
+    }
+    Serial.capture(false);
+
+    /* flush the line so the instance is left clean */
+    Serial.inject("\r");
+    cmd.poll();
+}
+
+/* Flash-resident equivalent of bench_add_cmds() */
+#define BENCH_ENTRY(n) {"cmd" #n, bench_handler}
+CMD_TABLE(bench_static_cmds,
+    BENCH_ENTRY(00), BENCH_ENTRY(01), BENCH_ENTRY(02), BENCH_ENTRY(03), BENCH_ENTRY(04), BENCH_ENTRY(05), BENCH_ENTRY(06), BENCH_ENTRY(07),
+    BENCH_ENTRY(08), BENCH_ENTRY(09), BENCH_ENTRY(10), BENCH_ENTRY(11), BENCH_ENTRY(12), BENCH_ENTRY(13), BENCH_ENTRY(14), BENCH_ENTRY(15),
+    BENCH_ENTRY(16), BENCH_ENTRY(17), BENCH_ENTRY(18), BENCH_ENTRY(19), BENCH_ENTRY(20), BENCH_ENTRY(21), BENCH_ENTRY(22), BENCH_ENTRY(23),
+    BENCH_ENTRY(24), BENCH_ENTRY(25), BENCH_ENTRY(26), BENCH_ENTRY(27), BENCH_ENTRY(28), BENCH_ENTRY(29), BENCH_ENTRY(30), BENCH_ENTRY(31),
+    BENCH_ENTRY(32), BENCH_ENTRY(33), BENCH_ENTRY(34), BENCH_ENTRY(35), BENCH_ENTRY(36), BENCH_ENTRY(37), BENCH_ENTRY(38), BENCH_ENTRY(39),
+    BENCH_ENTRY(40), BENCH_ENTRY(41), BENCH_ENTRY(42), BENCH_ENTRY(43), BENCH_ENTRY(44), BENCH_ENTRY(45), BENCH_ENTRY(46), BENCH_ENTRY(47),
+    BENCH_ENTRY(48), BENCH_ENTRY(49), BENCH_ENTRY(50), BENCH_ENTRY(51), BENCH_ENTRY(52), BENCH_ENTRY(53), BENCH_ENTRY(54), BENCH_ENTRY(55),
+    BENCH_ENTRY(56), BENCH_ENTRY(57), BENCH_ENTRY(58), BENCH_ENTRY(59), BENCH_ENTRY(60), BENCH_ENTRY(61), BENCH_ENTRY(62), BENCH_ENTRY(63)
+);
+
+/* CLI_MODE_STD: same as std_dispatch, but dispatching from the flash-resident table */
+static void scn_static_dispatch(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    cmd.add_table(bench_static_cmds);
+
+    handler_calls = 0;
+    bench_report("static_dispatch_first", "line", bench_dispatch(cmd, "cmd00 arg1 arg2", iterations));
+    bench_report("static_dispatch_last", "line", bench_dispatch(cmd, "cmd63 arg1 arg2", iterations));
+    bench_report("static_dispatch_unknown", "line", bench_dispatch(cmd, "nosuchcmd arg1", iterations));
+    if (handler_calls != 2 * iterations) {bench_fail("expected %u handler calls, got %u\n", (unsigned)(2 * iterations), (unsigned)handler_calls);}
+}
+
+/* CmdMux: three ports sharing one table, one of them flooded with input */
+static uint32_t mux_calls[3] = {0, 0, 0};
+static uint32_t mux_wrong_stream = 0;
+static void bench_mux_handler(int argc, char **argv) {
+    /* argv[1] names the port the line was injected on */
+    uint8_t port = (uint8_t)(argv[1][0] - '0');
+    Stream *expected = port == 0 ? (Stream *)&Serial : port == 1 ? (Stream *)&Serial1 : (Stream *)&Serial2;
+    if (Cmd::stream() != expected) {mux_wrong_stream++;}
+    if (port < 3) {mux_calls[port]++;}
+}
+
+static void scn_mux(uint32_t iterations) {
+    Cmd port0(&Serial), port1(&Serial1), port2(&Serial2);
+    CmdMux mux(CMD_MUX_BYTE_BUDGET);
+    mux.attach(&port0);
+    mux.attach(&port1);
+    mux.attach(&port2);
+    mux.add("mux", bench_mux_handler);
+    bench_add_cmds(port0);
+    mux.freeze();
+
+    std::string flood, quiet;
+    for (uint32_t i = 0; i < iterations; i++) {flood += "mux 1\r";}
+    for (uint32_t i = 0; i < iterations / 16 + 1; i++) {quiet += "mux 0\r";}
+
+    Serial.clear_input(); Serial1.clear_input(); Serial2.clear_input();
+    Serial1.inject(flood.c_str());
+    Serial.inject(quiet.c_str());
+    Serial2.inject("mux 2\r");
+
+    /* The flooded port must not delay the others by more than one round */
+    mux_calls[0] = mux_calls[1] = mux_calls[2] = 0;
+    mux_wrong_stream = 0;
+    mux.poll();
+    mux.poll();
+    if (!mux_calls[0] || !mux_calls[2]) {bench_fail("quiet ports starved by the flooded port\n");}
+
+    Serial.reset_counters(); Serial1.reset_counters(); Serial2.reset_counters();
+    uint32_t rounds = 2;
+    bench_clock::time_point start = bench_clock::now();
+    while (mux.poll()) {rounds++;}
+    double secs = elapsed(start);
+
+    bench_result_t r = {};
+    r.seconds = secs;
+    r.units = mux_calls[0] + mux_calls[1] + mux_calls[2];
+    r.bytes_in = flood.size() + quiet.size() + 6;
+    r.bytes_out = Serial.tx_bytes() + Serial1.tx_bytes() + Serial2.tx_bytes();
+    r.write_calls = Serial.tx_calls() + Serial1.tx_calls() + Serial2.tx_calls();
+    bench_report("mux_3port_flood", "line", r);
+
+    if (mux_calls[1] != iterations || mux_calls[0] != iterations / 16 + 1 || mux_calls[2] != 1) {
+        bench_fail("expected %u/%u/1 handler calls, got %u/%u/%u (%u rounds)\n", (unsigned)(iterations / 16 + 1), (unsigned)iterations,
+            (unsigned)mux_calls[0], (unsigned)mux_calls[1], (unsigned)mux_calls[2], (unsigned)rounds);
+    }
+    if (mux_wrong_stream) {bench_fail("Cmd::stream() didn't match the issuing port %u times\n", (unsigned)mux_wrong_stream);}
+}
+
+/* Bounded poll: a pasted burst of slow commands must not hold loop() longer than the budget + one handler */
+#define BENCH_SLOW_HANDLER_US   20
+#define BENCH_POLL_BUDGET_US    200
+
+static void bench_slow_handler(int argc, char **argv) {
+    unsigned long start = micros();
+    while (micros() - start < BENCH_SLOW_HANDLER_US) {}
+    handler_calls++;
+}
+
+static void scn_bounded_poll(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    cmd.add("slow", bench_slow_handler);
+
+    /* Keep the run short - every line costs BENCH_SLOW_HANDLER_US */
+    uint32_t lines = iterations / 10 + 1;
+    std::string script;
+    for (uint32_t i = 0; i < lines; i++) {script += "slow arg1 arg2\r";}
+
+    Serial.clear_input();
+    Serial.inject(script.c_str());
+    Serial.reset_counters();
+    handler_calls = 0;
+
+    uint32_t calls = 0;
+    double worst = 0;
+    uint32_t over = 0;
+    bench_clock::time_point start = bench_clock::now();
+    uint8_t pending = true;
+    while (pending) {
+        bench_clock::time_point call_start = bench_clock::now();
+        pending = cmd.poll(0, BENCH_POLL_BUDGET_US);
+        double t = elapsed(call_start);
+        if (t > worst) {worst = t;}
+        /* One handler may overrun the budget, plus some slack for the host scheduler */
+        if (t * 1e6 > BENCH_POLL_BUDGET_US + BENCH_SLOW_HANDLER_US + 1000) {over++;}
+        calls++;
+    }
+
+    bench_result_t r = {};
+    r.seconds = elapsed(start);
+    r.units = handler_calls;
+    r.bytes_in = script.size();
+    r.bytes_out = Serial.tx_bytes();
+    r.write_calls = Serial.tx_calls();
+    bench_report("bounded_poll_200us", "line", r);
+
+    if (handler_calls != lines) {bench_fail("expected %u handler calls, got %u\n", (unsigned)lines, (unsigned)handler_calls);}
+
+    /* A shared host can preempt any single call, so only a pattern of overruns counts as a failure */
+    if (over * 4 > calls) {
+        bench_fail("%u of %u poll() calls overran the budget (%u us, worst %.0f us)\n", (unsigned)over, (unsigned)calls, BENCH_POLL_BUDGET_US, worst * 1e6);
+    }
+
+    /* A partially received line must survive across bounded polls */
+    handler_calls = 0;
+    Serial.inject("slow a");
+    cmd.poll(3);
+    cmd.poll(3);
+    Serial.inject("rg1\r");
+    while (cmd.poll(2)) {}
+    if (handler_calls != 1) {bench_fail("split line: expected 1 handler call, got %u\n", (unsigned)handler_calls);}
+}
+
+/* Job queue: task commands yield back to poll() while other input keeps being handled */
+#define BENCH_TASK_STEPS 8
+static uint32_t task_steps = 0;
+static uint32_t task_done = 0;
+
+static uint8_t bench_task(cmd_job_t *job) {
+    task_steps++;
+    if (++job->state < BENCH_TASK_STEPS) {return CMD_TASK_YIELD;}
+    task_done++;
+    return CMD_TASK_DONE;
+}
+
+static void scn_jobs(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+    cmd.add_task("task", bench_task);
+
+    /* Without a job queue a task can't run */
+    handler_calls = task_steps = task_done = 0;
+    Serial.clear_input();
+    Serial.inject("task a\r");
+    cmd.poll();
+    if (task_steps || cmd.jobs_pending()) {bench_fail("a task ran without a job queue\n");}
+
+    /* Two tasks fill the default queue; plain commands typed meanwhile still run inline */
+    CmdJobs<> jobs;
+    cmd.attach_jobs(&jobs);
+    Serial.inject("task a\rtask b\rcmd00\r");
+    cmd.poll();
+    if (handler_calls != 1 || cmd.jobs_pending() != CMD_JOB_QUEUE_SIZE) {
+        bench_fail("expected 1 handler call and %u queued jobs, got %u / %u\n", (unsigned)CMD_JOB_QUEUE_SIZE, (unsigned)handler_calls, (unsigned)cmd.jobs_pending());
+    }
+    while (cmd.poll(0)) {}
+    if (task_done != 2 || task_steps != 2 * BENCH_TASK_STEPS) {bench_fail("expected 2 tasks / %u steps, got %u / %u\n", 2 * BENCH_TASK_STEPS, (unsigned)task_done, (unsigned)task_steps);}
+
+    /* Deferred mode: each line is queued by one poll() and run by the next */
+    cmd.exec_mode(CMD_EXEC_DEFERRED);
+    handler_calls = 0;
+    Serial.reset_counters();
+    bench_clock::time_point start = bench_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        Serial.inject("cmd00 arg1 arg2\r");
+        cmd.poll();
+    }
+    cmd.poll();
+
+    bench_result_t r = {};
+    r.seconds = elapsed(start);
+    r.units = iterations;
+    r.bytes_in = iterations * 16;
+    r.bytes_out = Serial.tx_bytes();
+    r.write_calls = Serial.tx_calls();
+    bench_report("jobs_deferred_dispatch", "line", r);
+    if (handler_calls != iterations) {bench_fail("expected %u handler calls, got %u\n", (unsigned)iterations, (unsigned)handler_calls);}
+}
+
+/* CLI_MODE_BIN: the same register write as json_ingest, as a COBS / CRC16 frame */
+static uint32_t bin_calls = 0;
+static uint32_t bin_sum = 0;
+static void bench_bin_handler(uint8_t *payload, uint16_t len) {
+    bin_calls++;
+    for (uint16_t i = 0; i < len; i++) {bin_sum += payload[i];}
+}
+
+/* Replies with the payload it was sent */
+static void bench_bin_echo(uint8_t *payload, uint16_t len) {
+    Cmd::active()->send_bin(0x21, payload, len);
+}
+
+static void scn_bin(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    cmd.add_bin(0x20, bench_bin_handler);
+    cmd.add_bin(0x21, bench_bin_echo);
+    cmd.mode(CLI_MODE_BIN);
+
+    /* reg (1 byte) + val (2 bytes, big endian) - zeros in the payload exercise the COBS blocks */
+    BenchPrint frames;
+    uint32_t expected_sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint8_t payload[3] = {(uint8_t)(i & 0xFF), (uint8_t)((i >> 8) & 0xFF), (uint8_t)(i & 0xFF)};
+        cmd_bin_write(&frames, 0x20, payload, sizeof(payload));
+        expected_sum += payload[0] + payload[1] + payload[2];
+    }
+
+    bin_calls = bin_sum = 0;
+    bench_result_t r = bench_ingest(cmd, frames.out, iterations);
+    bench_report("bin_ingest", "msg", r);
+    if (bin_calls != iterations || bin_sum != expected_sum) {
+        bench_fail("expected %u calls / sum %u, got %u / %u\n", (unsigned)iterations, (unsigned)expected_sum, (unsigned)bin_calls, (unsigned)bin_sum);
+    }
+
+    /* A corrupted frame is dropped, and the receiver resynchronizes on the next delimiter */
+    BenchPrint bad;
+    uint8_t reg[3] = {1, 2, 3};
+    cmd_bin_write(&bad, 0x20, reg, sizeof(reg));
+    bad.out[2] ^= 0x40;
+    cmd_bin_write(&bad, 0x20, reg, sizeof(reg));
+    bin_calls = 0;
+    Serial.inject((const uint8_t *)bad.out.data(), bad.out.size());
+    cmd.poll();
+    if (bin_calls != 1) {bench_fail("corrupted frame: expected 1 call, got %u\n", (unsigned)bin_calls);}
+
+    /* Round trip a payload with long zero-free runs and embedded zeros (COBS blocks longer than 254 bytes) */
+    uint8_t big[600];
+    for (uint16_t i = 0; i < sizeof(big); i++) {big[i] = (i % 300 == 299) ? 0 : (uint8_t)(i | 1);}
+    BenchPrint req;
+    cmd_bin_write(&req, 0x21, big, sizeof(big));
+    Serial.capture(true);
+    Serial.clear_output();
+    Serial.inject((const uint8_t *)req.out.data(), req.out.size());
+    cmd.poll();
+    Serial.capture(false);
+
+    std::string reply = Serial.output();
+    uint8_t id = 0, *payload = NULL;
+    uint16_t payload_len = 0;
+    uint8_t ok = !reply.empty() && reply.back() == 0 &&
+        cmd_bin_decode((uint8_t *)&reply[0], reply.size() - 1, &id, &payload, &payload_len) &&
+        id == 0x21 && payload_len == sizeof(big) && !memcmp(payload, big, sizeof(big));
+    if (!ok) {bench_fail("round trip of a %u byte payload failed\n", (unsigned)sizeof(big));}
+}
+
+/* Typed schemas: arguments arrive parsed and range checked, vs. the same work done by hand with conv() */
+static uint32_t typed_sum = 0;
+static void bench_typed_handler(int argc, cmd_arg_t *args) {
+    typed_sum += args[0].val.u + args[1].val.u + (uint32_t)args[2].val.i + (uint32_t)args[3].val.f + args[4].val.u + (uint32_t)strlen(args[5].val.s);
+}
+
+static Cmd *conv_cmd = NULL;
+static void bench_conv_handler(int argc, char **argv) {
+    if (argc != 7) {return;}
+    typed_sum += conv_cmd->conv(argv[1]) + conv_cmd->conv(argv[2]) + conv_cmd->conv(argv[3]) + (uint32_t)atof(argv[4]) + conv_cmd->conv(argv[5], 16) + (uint32_t)strlen(argv[6]);
+}
+
+static void scn_typed_dispatch(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    conv_cmd = &cmd;
+    bench_add_cmds(cmd);
+    cmd.add("set", "u8 u32 i16 f hex str", bench_typed_handler);
+    cmd.add("setc", bench_conv_handler);
+    cmd.freeze();
+
+    typed_sum = 0;
+    bench_report("typed_dispatch", "line", bench_dispatch(cmd, "set 200 4000000000 -1234 2.5 0xBEEF label", iterations));
+    uint32_t expected = (200 + 4000000000UL + (uint32_t)-1234 + 2 + 0xBEEF + 5) * iterations;
+    if (typed_sum != expected) {bench_fail("typed handler: expected sum %u, got %u\n", (unsigned)expected, (unsigned)typed_sum);}
+
+    bench_report("conv_dispatch", "line", bench_dispatch(cmd, "setc 200 4000000000 -1234 2.5 0xBEEF label", iterations));
+
+    /* Bad input is rejected before the handler runs */
+    static const char *const bad[] = {"set 256 1 1 1 1 x", "set 1 1 40000 1 1 x", "set 1 1 1 1.5x 1 x", "set 1 1 1 1 0xG x", "set 1 1 1 1 1", "set 1 1 1 1 1 x y",
+                                      "set 1 1 1 nan 1 x", "set 1 1 1 -inf 1 x", "set 1 1 1 infinity 1 x", "set 1 1 1 0x1p3 1 x", "set 1 1 1 1e39 1 x", "set 1 1 1 1e999 1 x"};
+    static const char *const msg[] = {"argument 1 (expected u8)", "argument 3 (expected i16)", "argument 4 (expected f)", "argument 5 (expected hex)", "Usage: set u8 u32 i16 f hex str", "Usage: set",
+                                      "argument 4 (expected f)", "argument 4 (expected f)", "argument 4 (expected f)", "argument 4 (expected f)", "argument 4 (expected f)", "argument 4 (expected f)"};
+    Serial.capture(true);
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        typed_sum = 0;
+        Serial.clear_output();
+        Serial.inject(bad[i]);
+        Serial.inject("\r");
+        cmd.poll();
+        if (typed_sum || Serial.output().find(msg[i]) == std::string::npos) {bench_fail("'%s' was not rejected with '%s'\n", bad[i], msg[i]);}
+    }
+    Serial.capture(false);
+}
+
+/* Per-instance sizing: a small CmdT keeps its buffers inside the object and clamps extra tokens */
+static int small_argc = 0;
+static void bench_small_handler(int argc, char **argv) {small_argc = argc;}
+
+static void scn_small_instance(uint32_t iterations) {
+    CmdT<64, 4> cmd(&Serial);
+    bench_add_cmds(cmd);
+    cmd.add("many", bench_small_handler);
+    cmd.freeze();
+
+    printf("%-28s %10u bytes (default Cmd: %u bytes)\n", "small_footprint", (unsigned)cmd.footprint(), (unsigned)Cmd::footprint());
+    if (cmd.footprint() >= Cmd::footprint()) {bench_fail("CmdT<64, 4> is not smaller than the default Cmd\n");}
+
+    #if !CMD_WORKER_QUEUE_SIZE
+        /* History, jobs and JSON tokens are attached separately, so an instance is little more than its buffers */
+        if (cmd.footprint() >= 1024) {bench_fail("CmdT<64, 4> takes %u bytes without any attached blocks\n", (unsigned)cmd.footprint());}
+    #endif
+
+    bench_report("small_dispatch", "line", bench_dispatch(cmd, "cmd00 arg1 arg2", iterations));
+
+    /* Tokens past MaxArgs are dropped instead of overrunning argv */
+    small_argc = 0;
+    Serial.inject("many a b c d e f g h\r");
+    cmd.poll();
+    if (small_argc != 4) {bench_fail("expected argc 4 with MaxArgs 4, got %d\n", small_argc);}
+}
+
+/* Flash-resident names (add_P() / F()), mixed with RAM names in one table (flash reads are plain reads on the host) */
+static uint32_t flash_calls = 0;
+static void bench_flash_handler(int argc, char **argv) {flash_calls++;}
+
+static void scn_flash_names(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    for (int i = 0; i < BENCH_CMD_COUNT; i++) {
+        snprintf(cmd_names[i], sizeof(cmd_names[i]), "cmd%02d", i);
+        if (i & 1) {cmd.add_P(cmd_names[i], bench_handler);} else {cmd.add(cmd_names[i], bench_handler);}
+    }
+    cmd.add(F("flash"), bench_flash_handler);
+
+    bench_report("flash_names_dispatch", "line", bench_dispatch(cmd, "cmd01 arg1 arg2", iterations));
+    cmd.freeze();
+    bench_report("flash_names_frozen", "line", bench_dispatch(cmd, "cmd01 arg1 arg2", iterations));
+
+    /* a RAM name added later shadows the flash entry with the same name, and remove() drops both */
+    handler_calls = 0;
+    flash_calls = 0;
+    cmd.add("cmd03", bench_flash_handler);
+    Serial.inject("flash\rcmd03\rcmd02\r");
+    cmd.poll();
+    cmd.remove("cmd03");
+    cmd.remove("flash");
+    Serial.inject("flash\rcmd03\r");
+    cmd.poll();
+    if (flash_calls != 2 || handler_calls != 1) {
+        bench_fail("mixed names: expected 2 flash / 1 RAM handler calls, got %u / %u\n", (unsigned)flash_calls, (unsigned)handler_calls);
+    }
+}
+
+/* Subcommand tree: "net wifi set ..." resolved in one pass, against the same handler dispatching on argv[1] / argv[2] by hand */
+static int sub_argc = 0;
+static char sub_name[16];
+static void bench_sub_handler(int argc, char **argv) {
+    sub_argc = argc;
+    snprintf(sub_name, sizeof(sub_name), "%s", argv[0]);
+}
+
+static void bench_sub_chain(int argc, char **argv) {
+    static const char *const groups[] = {"eth", "bt", "lte", "wifi"};
+    static const char *const cmds[] = {"show", "scan", "get", "set"};
+    if (argc < 3) {return;}
+    for (size_t i = 0; i < 4; i++) {
+        if (strcmp(argv[1], groups[i])) {continue;}
+        for (size_t j = 0; j < 4; j++) {
+            if (!strcmp(argv[2], cmds[j])) {bench_sub_handler(argc - 2, argv + 2);}
+        }
+    }
+}
+
+static void scn_subcmds(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+    static const char *const paths[] = {
+        "net eth show", "net eth scan", "net eth get", "net eth set", "net bt show", "net bt scan", "net bt get", "net bt set",
+        "net lte show", "net lte scan", "net lte get", "net lte set", "net wifi show", "net wifi scan", "net wifi get", "net wifi set"};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {cmd.add(paths[i], bench_sub_handler);}
+    cmd.add("sys", bench_sub_handler);
+    cmd.add("sys reboot", bench_sub_handler);
+    cmd.add("netc", bench_sub_chain);
+    cmd.freeze();
+
+    sub_argc = 0;
+    bench_report("subcmd_tree_dispatch", "line", bench_dispatch(cmd, "net wifi set ssid pass", iterations));
+    if (sub_argc != 3 || strcmp(sub_name, "set")) {bench_fail("subcommand: expected argc 3 / 'set', got %d / '%s'\n", sub_argc, sub_name);}
+    sub_argc = 0;
+    bench_report("subcmd_strcmp_chain", "line", bench_dispatch(cmd, "netc wifi set ssid pass", iterations));
+    if (sub_argc != 3) {bench_fail("strcmp chain: expected argc 3, got %d\n", sub_argc);}
+
+    /* words that aren't subcommands are arguments of the deepest match */
+    Serial.inject("sys now\r");
+    cmd.poll();
+    if (sub_argc != 2 || strcmp(sub_name, "sys")) {bench_fail("'sys now': expected argc 2 / 'sys', got %d / '%s'\n", sub_argc, sub_name);}
+
+    /* groups without a handler list their level, also once a subcommand is removed */
+    static const char *const lines[] = {"net\r", "net wifi\r", "net bt bogus\r", "net wifi set\r"};
+    static const char *const help[] = {"Subcommands: eth bt lte wifi", "Subcommands: show scan get\r", "Subcommands: show scan get set", "Subcommands: show scan get\r"};
+    cmd.remove("net wifi set");
+    Serial.capture(true);
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        Serial.clear_output();
+        Serial.inject(lines[i]);
+        cmd.poll();
+        if (Serial.output().find(help[i]) == std::string::npos) {bench_fail("'%s' did not list '%s'\n", lines[i], help[i]);}
+    }
+    Serial.capture(false);
+}
+
+#if CMD_PREFIX_INDEX
+/* Prefix index: unique abbreviations dispatch without the full name, Tab completes or lists command names */
+static uint32_t prefix_calls = 0;
+static void bench_prefix_handler(int argc, char **argv) {prefix_calls++;}
+
+CMD_TABLE(bench_prefix_cmds,
+    {"pwm",   bench_prefix_handler},
+    {"reset", bench_prefix_handler}
+);
+
+static void scn_prefix(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+    cmd.add("hello", bench_prefix_handler);
+    cmd.add("stats", bench_prefix_handler);
+    cmd.add_P("status", bench_prefix_handler);
+    cmd.add_table(bench_prefix_cmds);
+    cmd.freeze();
+
+    prefix_calls = 0;
+    bench_report("prefix_exact_dispatch", "line", bench_dispatch(cmd, "hello arg1 arg2", iterations));
+    bench_report("prefix_abbrev_dispatch", "line", bench_dispatch(cmd, "hel arg1 arg2", iterations));
+    if (prefix_calls != 2 * iterations) {bench_fail("expected %u handler calls, got %u\n", (unsigned)(2 * iterations), (unsigned)prefix_calls);}
+
+    /* ambiguous abbreviations aren't dispatched, flash-resident commands can be abbreviated too */
+    prefix_calls = 0;
+    handler_calls = 0;
+    Serial.inject("stat\rcmd\rres\rcmd4\rcmd63\r");
+    cmd.poll();
+    if (prefix_calls != 1 || handler_calls != 1) {
+        bench_fail("abbreviations: expected 1 / 1 handler calls, got %u / %u\n", (unsigned)prefix_calls, (unsigned)handler_calls);
+    }
+
+    /* Tab: a unique match is completed (plus a space), several matches are extended by their common part, then listed */
+    static const char *const keys[] = {"hel\t", "s\t", "\t", "c\t", "p\t"};
+    static const char *const echo[] = {"hello ", "stat", "stats  status  \r\nCMD >> stat", "cmd", "pwm "};
+    Serial.capture(true);
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        Serial.clear_output();
+        Serial.inject(keys[i]);
+        cmd.poll();
+        if (Serial.output().find(echo[i]) == std::string::npos) {bench_fail("Tab after '%s': expected '%s' in the output\n", keys[i], echo[i]);}
+        if (i != 1) {
+            Serial.inject("\r");
+            cmd.poll();
+        }
+    }
+    Serial.capture(false);
+
+    /* A removed command drops out of the name index right away (its entry is freed) */
+    cmd.remove("hello");
+    prefix_calls = 0;
+    Serial.inject("hel\r");
+    cmd.poll();
+    if (prefix_calls) {bench_fail("abbreviation of a removed command was dispatched\n");}
+}
+#endif
+
+/* Escape sequences: decoder cost per sequence, and that the decoded keys edit the line as expected */
+static std::string keys_line;
+static void bench_keys_handler(int argc, char **argv) {
+    keys_line.clear();
+    for (int i = 0; i < argc; i++) {
+        if (i) {keys_line += ' ';}
+        keys_line += argv[i];
+    }
+}
+
+static uint32_t keys_callback_calls = 0;
+#if CMD_KEY_BINDINGS
+static void bench_keys_callback(uint8_t key) {keys_callback_calls++;}
+#endif
+
+static void scn_keys(uint32_t iterations) {
+    typedef struct {const char *seq; uint8_t key;} bench_key_seq_t;
+    static const bench_key_seq_t seqs[] = {
+        {"\e[A", CMD_KEY_UP},       {"\eOB", CMD_KEY_DOWN},     {"\e[H", CMD_KEY_HOME},     {"\eOH", CMD_KEY_HOME},
+        {"\e[1~", CMD_KEY_HOME},    {"\e[7~", CMD_KEY_HOME},    {"\e[F", CMD_KEY_END},      {"\eOF", CMD_KEY_END},
+        {"\e[4~", CMD_KEY_END},     {"\e[8~", CMD_KEY_END},     {"\e[3~", CMD_KEY_DELETE},  {"\e[6~", CMD_KEY_PGDN},
+        {"\e[1;5D", CMD_KEY_CTRL | CMD_KEY_LEFT},   {"\e[1;3C", CMD_KEY_ALT | CMD_KEY_RIGHT},   {"\eOd", CMD_KEY_CTRL | CMD_KEY_LEFT},
+        {"\e[5C", CMD_KEY_CTRL | CMD_KEY_RIGHT},    {"\e[3;2~", CMD_KEY_SHIFT | CMD_KEY_DELETE}, {"\e[a", CMD_KEY_SHIFT | CMD_KEY_UP},
+        {"\e[15~", CMD_KEY_NONE},   {"\e[200~", CMD_KEY_NONE},  {"\e[[A", CMD_KEY_NONE},    {"\ex", CMD_KEY_NONE},
+    };
+    const size_t count = sizeof(seqs) / sizeof(seqs[0]);
+
+    /* every byte but the last must ask for more, the last one yields the key */
+    cmd_esc_t esc;
+    cmd_esc_reset(&esc);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(seqs[i].seq);
+        uint8_t key = CMD_ESC_MORE;
+        for (size_t j = 0; j < len; j++) {
+            key = cmd_esc_feed(&esc, (uint8_t)seqs[i].seq[j]);
+            if (j + 1 < len && key != CMD_ESC_MORE) {break;}
+        }
+        if (key != seqs[i].key || cmd_esc_active(&esc)) {bench_fail("sequence %u: expected key 0x%02X, got 0x%02X\n", (unsigned)i, seqs[i].key, key);}
+    }
+
+    std::string stream;
+    for (size_t i = 0; i < count; i++) {stream += seqs[i].seq;}
+    volatile uint32_t sink = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < stream.size(); i++) {sink += cmd_esc_feed(&esc, (uint8_t)stream[i]);}
+    }
+    bench_result_t r = {};
+    r.seconds = elapsed(start);
+    r.units = (uint64_t)count * iterations;
+    r.bytes_in = (uint64_t)stream.size() * iterations;
+    bench_report("esc_decode", "seq", r);
+
+    /* Editing through the decoded keys */
+    Cmd cmd(&Serial);
+    cmd.add("line", bench_keys_handler);
+#if CMD_KEY_BINDINGS
+    cmd.bind_key(CMD_KEY_PGUP, CMD_ACT_HOME);
+    cmd.attach_key_callback(CMD_KEY_INSERT, bench_keys_callback);
+#endif
+
+    static const char *const typed[] = {
+        "line a c\e[H\e[1;5C\e[1;5C b\e[Fd\r",    // Home, Ctrl+Right, End
+        "world\eOHline hello \eOF!\r",            // SS3 Home / End
+        "line b c\e[1;5Da \r",                    // Ctrl+Left
+        "line ab\e[D\e[3~\r",                     // Delete under the cursor
+        "line abc\e[15~\e[200~d\e[[A\r",          // unknown sequences are consumed whole
+        "world\e[5~line \r",                      // user binding: PgUp = Home
+        "line ab\e[2~c\r",                        // user callback on Insert
+    };
+    static const char *const expected[] = {"line a b cd", "line hello world!", "line b a c", "line a", "line abcd", "line world", "line abc"};
+
+    // the last two lines need the user key bindings
+    size_t lines = sizeof(typed) / sizeof(typed[0]) - (CMD_KEY_BINDINGS ? 0 : 2);
+
+    keys_callback_calls = 0;
+    Serial.capture(true);
+    for (size_t i = 0; i < lines; i++) {
+        keys_line.clear();
+        Serial.clear_output();
+        Serial.inject(typed[i]);
+        while (Serial.available()) {cmd.poll();}
+        if (keys_line != expected[i]) {bench_fail("keys %u: expected '%s', got '%s'\n", (unsigned)i, expected[i], keys_line.c_str());}
+    }
+    if (CMD_KEY_BINDINGS && keys_callback_calls != 1) {bench_fail("key callback: expected 1 call, got %u\n", (unsigned)keys_callback_calls);}
+
+    /* ESC ESC still asks to exit */
+    Serial.inject("\e\e");
+    cmd.poll();
+    Serial.capture(false);
+    if (!cmd.exit_cli()) {bench_fail("double ESC did not request an exit\n");}
+}
+
+/* Receive ring: a producer thread stands in for the RX interrupt while the main thread parses */
+static void scn_ring(uint32_t iterations) {
+    /* ring mechanics: sizing, full ring, wrap-around */
+    cmd_ring_t bad;
+    uint8_t bad_buf[100];
+    if (cmd_ring_init(&bad, bad_buf, sizeof(bad_buf))) {bench_fail("a 100 byte ring was accepted\n");}
+
+    CmdRing<64> small;
+    uint32_t stored = 0;
+    for (uint32_t i = 0; i < 70; i++) {stored += cmd_ring_push(&small, (uint8_t)i);}
+    if (stored != 64 || small.dropped != 6) {bench_fail("full ring: expected 64 stored / 6 dropped, got %u / %u\n", (unsigned)stored, (unsigned)small.dropped);}
+
+    uint8_t in[48], out[64];
+    uint8_t ok = (cmd_ring_read(&small, out, sizeof(out)) == 64) && !cmd_ring_available(&small);
+    for (uint32_t round = 0; round < 10 && ok; round++) {
+        // 48 doesn't divide 64, so the copies keep landing across the end of the buffer
+        for (uint32_t i = 0; i < sizeof(in); i++) {in[i] = (uint8_t)(round * 48 + i);}
+        ok = (cmd_ring_write(&small, in, sizeof(in)) == sizeof(in)) && (cmd_ring_available(&small) == sizeof(in));
+        ok = ok && (cmd_ring_read(&small, out, sizeof(out)) == sizeof(in)) && !memcmp(in, out, sizeof(in));
+    }
+    if (!ok) {bench_fail("ring contents were not preserved across the wrap\n");}
+
+    /* threaded: every line must arrive, with the consumer only ever calling poll() */
+    CmdRing<1024> rx;
+
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+    cmd.attach_ring(&rx);
+
+    std::string script;
+    char line[64];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "cmd%02u arg1 0x1234 567\r", (unsigned)(i % BENCH_CMD_COUNT));
+        script += line;
+    }
+
+    handler_calls = 0;
+    Serial.reset_counters();
+    bench_clock::time_point start = bench_clock::now();
+
+    std::thread producer([&script, &rx]() {
+        size_t pos = 0;
+        uint16_t piece = 1;
+        while (pos < script.size()) {
+            // uneven bursts, as a UART / USB packet would deliver them
+            uint16_t n = cmd_ring_free(&rx);
+            piece = (uint16_t)(piece * 7 + 3) % 61 + 1;
+            if (n > piece) {n = piece;}
+            if (n > script.size() - pos) {n = (uint16_t)(script.size() - pos);}
+            if (!n) {std::this_thread::yield(); continue;}
+            pos += cmd_ring_write(&rx, (const uint8_t *)script.data() + pos, n);
+        }
+    });
+
+    while (handler_calls < iterations) {
+        if (!cmd.poll(0)) {std::this_thread::yield();}
+        if (elapsed(start) > 60) {break;}
+    }
+    producer.join();
+
+    bench_result_t r = {};
+    r.seconds = elapsed(start);
+    r.bytes_in = script.size();
+    r.units = iterations;
+    r.bytes_out = Serial.tx_bytes();
+    r.write_calls = Serial.tx_calls();
+    bench_report("ring_threaded_ingest", "line", r);
+    if (handler_calls != iterations || rx.dropped) {bench_fail("expected %u handler calls / 0 dropped, got %u / %u\n", (unsigned)iterations, (unsigned)handler_calls, (unsigned)rx.dropped);}
+}
+
+#if CMD_WORKER_QUEUE_SIZE
+/* Worker thread: handlers run off the polling thread, their output comes back through poll() */
+static std::thread::id worker_main_id;
+static std::atomic<uint32_t> worker_calls(0);
+static std::atomic<uint32_t> worker_wrong_thread(0);
+
+static void bench_worker_handler(int argc, char **argv) {
+    // a few microseconds of "work", e.g. an I2C transaction
+    bench_clock::time_point start = bench_clock::now();
+    while (elapsed(start) < 5e-6) {}
+
+    Stream *out = CmdBase::stream();
+    if (std::this_thread::get_id() == worker_main_id || out == &Serial) {worker_wrong_thread++;}
+    out->print(F("done "));
+    out->println(argv[1]);
+    worker_calls++;
+}
+
+/* tries everything a worker handler mustn't do: change the table, write the stream directly */
+static std::atomic<uint32_t> worker_meddled(0);
+static std::atomic<bool> worker_table_changed(false);
+static const uint8_t worker_bin_reply[3] = {0x01, 0x00, 0x02};
+
+static void bench_worker_meddle(int argc, char **argv) {
+    CmdBase *cmd = CmdBase::active();
+    if (cmd->remove("work") || cmd->replace("work", bench_worker_handler) || cmd->freeze()) {worker_table_changed = true;}
+    cmd->add("extra", bench_worker_handler);
+    cmd->send_bin(0x21, worker_bin_reply, sizeof(worker_bin_reply));
+    worker_meddled++;
+}
+
+static double worker_poll_time(Cmd &cmd, const std::string &script, uint32_t iterations) {
+    worker_calls = 0;
+    Serial.clear_output();
+    Serial.inject((const uint8_t *)script.data(), script.size());
+
+    double busy = 0;
+    for (;;) {
+        bench_clock::time_point start = bench_clock::now();
+        uint8_t more = cmd.poll(0);
+        busy += elapsed(start);
+        if (!more && worker_calls == iterations) {break;}
+        std::this_thread::yield();
+    }
+    return busy;
+}
+
+static void scn_worker(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    cmd.add("work", bench_worker_handler);
+    cmd.add("meddle", bench_worker_meddle);
+    worker_main_id = std::this_thread::get_id();
+
+    std::string script;
+    char line[32];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "work %u\r", (unsigned)i);
+        script += line;
+    }
+
+    Serial.capture(true);
+
+    /* baseline: handlers on the polling thread */
+    bench_result_t r = {};
+    r.seconds = worker_poll_time(cmd, script, iterations);
+    r.bytes_in = script.size();
+    r.units = iterations;
+    bench_report("worker_inline_poll", "line", r);
+    worker_wrong_thread = 0;
+
+    /* worker: poll() only parses, queues and writes out */
+    std::atomic<bool> stop(false);
+    std::thread worker([&cmd, &stop]() {
+        while (!stop) {
+            if (!cmd.worker_run()) {std::this_thread::yield();}
+        }
+    });
+    cmd.exec_mode(CMD_EXEC_WORKER);
+    r.seconds = worker_poll_time(cmd, script, iterations);
+    bench_report("worker_offload_poll", "line", r);
+
+    /* the table can't be changed from the worker, and send_bin() goes out through poll() */
+    std::string replies = Serial.output();
+    Serial.clear_output();
+    worker_meddled = 0;
+    Serial.inject((const uint8_t *)"meddle\r", 7);
+    while (cmd.poll(0) || !worker_meddled) {std::this_thread::yield();}
+    while (cmd.worker_pending()) {cmd.poll(0);}
+    cmd.poll(0);
+    stop = true;
+    worker.join();
+
+    BenchPrint frame;
+    cmd_bin_write(&frame, 0x21, worker_bin_reply, sizeof(worker_bin_reply));
+    if (Serial.output().find(frame.out) == std::string::npos) {bench_fail("send_bin() from the worker: frame missing from the output\n");}
+    cmd.exec_mode(CMD_EXEC_INLINE);
+    if (worker_table_changed || cmd.remove("extra") || !cmd.remove("work")) {bench_fail("the worker changed the command table\n");}
+
+    /* every reply made it out whole and in order, from the worker thread */
+    const std::string &out = replies;
+    size_t pos = 0;
+    uint32_t found = 0;
+    for (; found < iterations; found++) {
+        snprintf(line, sizeof(line), "done %u\r\n", (unsigned)found);
+        pos = out.find(line, pos);
+        if (pos == std::string::npos) {break;}
+    }
+    Serial.capture(false);
+    if (found != iterations || worker_wrong_thread) {bench_fail("expected %u ordered replies from the worker, got %u (%u on the wrong thread)\n", (unsigned)iterations, (unsigned)found, (unsigned)worker_wrong_thread.load());}
+}
+#endif
+
+/* Batch scripts: the same lines as std_ingest, run from memory without echo or prompts */
+static void scn_script(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    bench_add_cmds(cmd);
+
+    std::string script = "# provisioning\n\n";
+    std::string typed;
+    char line[64];
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "cmd%02u arg1 0x1234 567", (unsigned)(i % BENCH_CMD_COUNT));
+        script += line;
+        script += '\n';
+        typed += line;
+        typed += '\r';
+    }
+
+    handler_calls = 0;
+    bench_report("script_typed", "line", bench_ingest(cmd, typed, iterations));
+
+    cmd_script_result_t res;
+    handler_calls = 0;
+    Serial.reset_counters();
+    bench_clock::time_point start = bench_clock::now();
+    uint8_t ok = cmd.run_script(script.c_str(), &res, 0);
+    bench_result_t r = {};
+    r.seconds = elapsed(start);
+    r.bytes_in = script.size();
+    r.units = iterations;
+    r.bytes_out = Serial.tx_bytes();
+    r.write_calls = Serial.tx_calls();
+    bench_report("script_run", "line", r);
+    if (!ok || res.lines != iterations || res.errors || handler_calls != iterations || r.bytes_out) {
+        bench_fail("expected %u lines / handler calls and no output, got %u / %u, %u errors, %u bytes out\n",
+            (unsigned)iterations, (unsigned)res.lines, (unsigned)handler_calls, (unsigned)res.errors, (unsigned)r.bytes_out);
+    }
+
+    /* stop on error, or carry on and count */
+    static const char bad[] PROGMEM = "cmd00\r\ncmd01\n  nosuch 1\ncmd02";
+    handler_calls = 0;
+    ok = cmd.run_script_P(bad, &res, CMD_SCRIPT_STOP_ON_ERROR);
+    if (ok || res.lines != 3 || res.errors != 1 || res.error_line != 3 || handler_calls != 2) {
+        bench_fail("stop on error: expected 3 lines / 1 error at line 3 / 2 calls, got %u / %u at %u / %u\n", (unsigned)res.lines, (unsigned)res.errors, (unsigned)res.error_line, (unsigned)handler_calls);
+    }
+    handler_calls = 0;
+    ok = cmd.run_script_P(bad, &res, 0);
+    if (ok || res.lines != 4 || res.errors != 1 || handler_calls != 3) {
+        bench_fail("continue on error: expected 4 lines / 1 error / 3 calls, got %u / %u / %u\n", (unsigned)res.lines, (unsigned)res.errors, (unsigned)handler_calls);
+    }
+
+    std::string long_line = "cmd00 " + std::string(CMD_SCRIPT_LINE_SIZE, 'x') + "\ncmd01\n";
+    handler_calls = 0;
+    ok = cmd.run_script(long_line.c_str(), &res, 0);
+    if (ok || res.error_line != 1 || handler_calls != 1) {bench_fail("overlong line: expected an error at line 1 and 1 call, got line %u / %u calls\n", (unsigned)res.error_line, (unsigned)handler_calls);}
+
+    /* the summary is all the terminal sees, and a half typed line survives the script */
+    Serial.capture(true);
+    Serial.inject("cmd0");
+    cmd.poll();
+    Serial.clear_output();
+    cmd.run_script("cmd00\nnosuch\n");
+    const char *summary = "CMD: Script: 2 lines, 1 errors (first at line 2)\r\n";
+    if (Serial.output() != summary) {bench_fail("summary: expected '%s', got '%s'\n", summary, Serial.output().c_str());}
+    Serial.clear_output();
+    handler_calls = 0;
+    Serial.inject("1 x\r");
+    cmd.poll();
+    Serial.capture(false);
+    if (handler_calls != 1) {bench_fail("the line typed before the script was lost\n");}
+
+    /* host file helper */
+    char path[] = "/tmp/cmd_bench_scriptXXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (f != NULL) {
+        fputs("cmd00 a\r\ncmd01 b\r\n# done\r\n", f);
+        fclose(f);
+        handler_calls = 0;
+        ok = cmd_run_script_file(cmd, path, &res, 0);
+        if (!ok || res.lines != 2 || handler_calls != 2) {bench_fail("script file: expected 2 lines / calls, got %u / %u\n", (unsigned)res.lines, (unsigned)handler_calls);}
+        remove(path);
+    }
+    if (cmd_run_script_file(cmd, "/nonexistent/script.txt", &res, 0)) {bench_fail("a missing script file was reported as run\n");}
+}
+
+#if CMD_STATS
+/* Runtime counters: cost of the accounting on the dispatch path, and that every counter moves */
+static void bench_self_remove(int argc, char **argv) {
+    CmdBase::active()->remove(argv[0]);
+    handler_calls++;
+}
+
+static void scn_stats(uint32_t iterations) {
+    Cmd cmd(&Serial);
+    CmdJobs<> jobs;
+    cmd.attach_jobs(&jobs);
+    bench_add_cmds(cmd);
+    cmd.add("set", "u8", bench_typed_handler);
+    cmd.add_stats_cmd();
+    cmd.freeze();
+
+    bench_report("stats_dispatch", "line", bench_dispatch(cmd, "cmd00 arg1 arg2", iterations));
+
+    const cmd_entry_stats_t *cmd00 = cmd.cmd_stats("cmd00");
+    if (!cmd00 || cmd00->calls != iterations || cmd00->time_max < cmd00->time_total / iterations) {
+        bench_fail("cmd00: expected %u calls, got %u\n", (unsigned)iterations, cmd00 ? (unsigned)cmd00->calls : 0);
+    }
+
+    /* the overlong line is dropped, and its last 10 characters then arrive as a second unknown command */
+    std::string long_line(CMD_MAX_MSG_SIZE + 10, 'x');
+    cmd.stats_reset();
+    Serial.inject("nosuchcmd\rset 300\r");
+    Serial.inject(long_line.c_str());
+    Serial.inject("\r");
+    cmd.poll();
+
+    const cmd_stats_t *stats = cmd.stats();
+    if (stats->unknown != 2 || stats->lines_dropped != 1 || cmd.cmd_stats("set")->errors != 1 || cmd00->calls != 0 || !stats->bytes_read || !stats->bytes_echoed) {
+        bench_fail("counters: unknown %u, dropped %u, set errors %u, cmd00 calls %u\n", (unsigned)stats->unknown,
+            (unsigned)stats->lines_dropped, (unsigned)cmd.cmd_stats("set")->errors, (unsigned)cmd00->calls);
+    }
+
+    cmd.mode(CLI_MODE_JSON);
+    Serial.inject("{\"cmd\":}\r");
+    cmd.poll();
+    if (stats->json_rejected != 1) {bench_fail("expected 1 rejected JSON message, got %u\n", (unsigned)stats->json_rejected);}
+
+    cmd.mode(CLI_MODE_STD);
+    Serial.capture(true);
+    Serial.clear_output();
+    Serial.inject("stats\r");
+    cmd.poll();
+    Serial.capture(false);
+    if (Serial.output().find("unknown commands: 2") == std::string::npos || Serial.output().find("set 0 0 0 1") == std::string::npos) {
+        bench_fail("stats command output is missing counters\n");
+    }
+
+    /* A command removed by its own handler, or while its job is queued, loses its counters (nothing is written to freed memory) */
+    handler_calls = 0;
+    task_done = 0;
+    cmd.add("selfrm", bench_self_remove);
+    cmd.add_task("slowrm", bench_task);
+    Serial.inject("selfrm\rslowrm\r");
+    cmd.poll();
+    cmd.remove("slowrm");
+    while (cmd.jobs_pending()) {cmd.jobs_run();}
+    if (handler_calls != 1 || task_done != 1 || cmd.cmd_stats("selfrm") || cmd.cmd_stats("slowrm")) {
+        bench_fail("removed commands: expected 1 handler call / 1 task and no counters, got %u / %u\n", (unsigned)handler_calls, (unsigned)task_done);
+    }
+
+    /* The stats command reads / clears the counters of the instance, so it is never queued */
+    static const uint8_t modes[] = {
+        CMD_EXEC_DEFERRED,
+    #if CMD_WORKER_QUEUE_SIZE
+        CMD_EXEC_WORKER,
+    #endif
+    };
+    for (size_t i = 0; i < sizeof(modes); i++) {
+        cmd.exec_mode(modes[i]);
+        Serial.capture(true);
+        Serial.clear_output();
+        Serial.inject("stats\r");
+        cmd.poll();
+        Serial.capture(false);
+        uint8_t queued = cmd.jobs_pending();
+        #if CMD_WORKER_QUEUE_SIZE
+            queued += cmd.worker_pending();
+        #endif
+        if (queued || Serial.output().find("unknown commands:") == std::string::npos) {bench_fail("stats was queued in exec mode %u\n", (unsigned)modes[i]);}
+    }
+    cmd.exec_mode(CMD_EXEC_INLINE);
+}
+#endif
+
+typedef struct
+{
+    const char *name;
+    void (*func)(uint32_t iterations);
+} bench_scenario_t;
+
+static const bench_scenario_t scenarios[] = {
+    {"std_ingest",          scn_std_ingest},
+    {"std_dispatch",        scn_std_dispatch},
+    {"frozen_dispatch",     scn_frozen_dispatch},
+    {"history_recall",      scn_history_recall},
+    {"json_ingest",         scn_json_ingest},
+    {"json_dispatch",       scn_json_dispatch},
+    {"json_tokens",         scn_json_tokens},
+    {"json_reply",          scn_json_reply},
+    {"json_pipeline",       scn_json_pipeline},
+    {"json_stream",         scn_json_stream},
+    {"std_edit_midline",    scn_std_edit_midline},
+    {"static_dispatch",     scn_static_dispatch},
+    {"mux",                 scn_mux},
+    {"bounded_poll",        scn_bounded_poll},
+    {"jobs",                scn_jobs},
+    {"bin",                 scn_bin},
+    {"typed_dispatch",      scn_typed_dispatch},
+    {"small_instance",      scn_small_instance},
+    {"flash_names",         scn_flash_names},
+#if CMD_PREFIX_INDEX
+    {"prefix",              scn_prefix},
+#endif
+    {"subcmds",             scn_subcmds},
+    {"keys",                scn_keys},
+    {"ring",                scn_ring},
+#if CMD_WORKER_QUEUE_SIZE
+    {"worker",              scn_worker},
+#endif
+    {"script",              scn_script},
+#if CMD_STATS
+    {"stats",               scn_stats},
+#endif
+};
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 20000;
+    const char *filter = argc > 2 ? argv[2] : NULL;
+
+    if (!iterations) {iterations = 1;}
+
+    printf("cmdArduino host benchmark: %u iterations, %d commands registered\n", (unsigned)iterations, BENCH_CMD_COUNT);
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (filter && !strstr(scenarios[i].name, filter)) {continue;}
+        scenarios[i].func(iterations);
+    }
+
+    if (bench_failures) {printf("%u check(s) failed\n", (unsigned)bench_failures);}
+    return bench_failures ? 1 : 0;
+}
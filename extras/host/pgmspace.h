@@ -0,0 +1,30 @@
+/*******************************************************************
+    Host stand-in for <avr/pgmspace.h>
+
+    On the host there is no separate flash address space, so every
+    PROGMEM accessor collapses to a plain RAM access.  This keeps the
+    library code identical between the device and the host builds.
+*******************************************************************/
+#ifndef CMD_HOST_PGMSPACE_H
+    #define CMD_HOST_PGMSPACE_H
+
+    #include <stdint.h>
+    #include <string.h>
+
+    #define PROGMEM
+    #define PGM_P                   const char *
+    #define PSTR(s)                 (s)
+
+    #define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+    #define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+    #define pgm_read_dword(addr)    (*(const uint32_t *)(addr))
+    #define pgm_read_ptr(addr)      (*(void * const *)(addr))
+
+    #define strcpy_P(dst, src)      strcpy((dst), (src))
+    #define strncpy_P(dst, src, n)  strncpy((dst), (src), (n))
+    #define strcmp_P(a, b)          strcmp((a), (b))
+    #define strncmp_P(a, b, n)      strncmp((a), (b), (n))
+    #define strlen_P(s)             strlen((s))
+    #define memcpy_P(dst, src, n)   memcpy((dst), (src), (n))
+
+#endif //CMD_HOST_PGMSPACE_H
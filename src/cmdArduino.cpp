@@ -42,18 +42,159 @@
 /* Included header file */
 #include "cmdArduino.h"
 
+/* Cmd instance currently polling / dispatching */
+CMD_THREAD_LOCAL CmdBase *CmdBase::_active = NULL;
+
+#if CMD_WORKER_QUEUE_SIZE
+/* Set while the calling thread runs worker_run() */
+thread_local uint8_t CmdBase::_in_worker = false;
+#endif
+
+/* FNV-1a hash of a command name (in RAM, or in flash if flash is set), folded to 16 bits for the command index */
+static uint16_t cmd_hash(const char *name, uint8_t flash = false) {
+    uint32_t hash = 2166136261UL;
+    uint8_t c;
+    while ((c = flash ? pgm_read_byte(name) : (uint8_t)*name) != 0) {
+        hash ^= c;
+        hash *= 16777619UL;
+        name++;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+/* cmd_name_eq() - true if name (in RAM) is the name of the command table entry */
+static uint8_t cmd_name_eq(const char *name, const cmd_t *entry) {
+    return (entry->flags & CMD_ENTRY_NAME_P) ? !strcmp_P(name, entry->cmd) : !strcmp(name, entry->cmd);
+}
+
+/* cmd_name_char() - character i of a command name in RAM, or in flash if flash is set */
+static inline uint8_t cmd_name_char(const char *name, uint8_t flash, uint16_t i) {
+    return flash ? pgm_read_byte(name + i) : (uint8_t)name[i];
+}
+
+/* cmd_name_ncmp() - strncmp() of two command names, either of which may be in flash */
+static int cmd_name_ncmp(const char *a, uint8_t a_flash, const char *b, uint8_t b_flash, uint16_t n) {
+    for (uint16_t i = 0; i < n; i++) {
+        uint8_t ca = cmd_name_char(a, a_flash, i);
+        uint8_t cb = cmd_name_char(b, b_flash, i);
+        if (ca != cb || ca == 0) {return (int)ca - (int)cb;}
+    }
+    return 0;
+}
+
+/* cmd_entry_cmp() - strcmp() of the names of two command table entries (either may be in flash) */
+static int cmd_entry_cmp(const cmd_t *a, const cmd_t *b) {
+    return cmd_name_ncmp(a->cmd, a->flags & CMD_ENTRY_NAME_P, b->cmd, b->flags & CMD_ENTRY_NAME_P, 0xFFFF);
+}
+
+/* cmd_print_str() - print a command name from flash or RAM */
+static void cmd_print_str(Print *out, const char *name, uint8_t flash) {
+    if (flash) {
+        out->print((const __FlashStringHelper *)name);
+    } else {
+        out->print(name);
+    }
+}
+
+/* cmd_print_name() - print the name of a command table entry */
+static void cmd_print_name(Print *out, const cmd_t *entry) {
+    cmd_print_str(out, entry->cmd, entry->flags & CMD_ENTRY_NAME_P);
+}
+
+/* cmd_find() - find a name in one level of the subcommand tree */
+static cmd_t *cmd_find(cmd_t *list, const char *name) {
+    for (cmd_t *entry = list; entry != NULL; entry = entry->next) {
+        if (cmd_name_eq(name, entry)) {return entry;}
+    }
+    return NULL;
+}
+
+/* cmd_free_entry() - release a command table entry, its name (unless it is in flash), schema and subcommands */
+static void cmd_free_entry(cmd_t *entry) {
+    while (entry->sub != NULL) {
+        cmd_t *sub = entry->sub;
+        entry->sub = sub->next;
+        cmd_free_entry(sub);
+    }
+    if (!(entry->flags & CMD_ENTRY_NAME_P)) {free(entry->cmd);}
+    free(entry->schema);
+    free(entry);
+}
+
+/* cmd_print_subs() - print the names of one level of subcommands, in the order they were added (the list is newest first) */
+static void cmd_print_subs(Print *out, const cmd_t *entry) {
+    if (entry == NULL) {return;}
+    cmd_print_subs(out, entry->next);
+    out->print(' ');
+    cmd_print_name(out, entry);
+}
+
+/* CmdTxBuffer - buffer a single character, flushing first if full */
+size_t CmdTxBuffer::write(uint8_t c) {
+    if (_len == CMD_TX_BUF_SIZE) {flush();}
+    _buf[_len++] = c;
+    return 1;
+}
+
+/* CmdTxBuffer - buffer a block of characters (blocks larger than the buffer go straight to the stream) */
+size_t CmdTxBuffer::write(const uint8_t *buffer, size_t size) {
+    if (_len + size > CMD_TX_BUF_SIZE) {flush();}
+
+    if (size >= CMD_TX_BUF_SIZE) {
+        return _stream->write(buffer, size);
+    }
+
+    memcpy(_buf + _len, buffer, size);
+    _len += size;
+    return size;
+}
+
+/* CmdTxBuffer - write out anything buffered */
+void CmdTxBuffer::flush() {
+    if (_len) {
+        _stream->write(_buf, _len);
+        _len = 0;
+    }
+}
+
+#if CMD_WORKER_QUEUE_SIZE
+/* CmdWorkerOut - queue a single character for poll(), waiting for room if the ring is full */
+size_t CmdWorkerOut::write(uint8_t c) {
+    while (!cmd_ring_free(_ring)) {yield();}
+    cmd_ring_push(_ring, c);
+    return 1;
+}
+
+/* CmdWorkerOut - queue a block of characters, in as many pieces as the ring has room for */
+size_t CmdWorkerOut::write(const uint8_t *buffer, size_t size) {
+    size_t left = size;
+    while (left) {
+        uint16_t room = cmd_ring_free(_ring);
+        if (!room) {
+            yield();
+            continue;
+        }
+        uint16_t n = (left < room) ? left : room;
+        cmd_ring_write(_ring, buffer, n);
+        buffer += n;
+        left -= n;
+    }
+    return size;
+}
+#endif
+
 /**************************************************************************/
 /*!
     constructor - no pointers provided to any streams
 */
 /**************************************************************************/
-Cmd::Cmd() {
+CmdBase::CmdBase(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args) {
 
     /* Pint to the Serial Stream to the default HW Serial interface */
     _Cereal = &Serial;
 
     /* init the buffers */
-    init_buffers();
+    init_buffers(msg_buf, msg_size, argv_buf, max_args);
 
 }
 
@@ -62,14 +203,14 @@ Cmd::Cmd() {
     constructor - pointers provided to a HardwareSerial stream
 */
 /**************************************************************************/
-Cmd::Cmd(HardwareSerial *stream) {
+CmdBase::CmdBase(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args, HardwareSerial *stream) {
 
     /* Point to the HardwareSerial Stream that the user passed */
     _hwStream = stream;
     set_stream();
 
     /* init the buffers */
-    init_buffers();
+    init_buffers(msg_buf, msg_size, argv_buf, max_args);
 
 }
 
@@ -79,14 +220,14 @@ Cmd::Cmd(HardwareSerial *stream) {
 */
 /**************************************************************************/
 #ifdef SoftwareSerial_h
-    Cmd::Cmd(SoftwareSerial *stream) {
+    CmdBase::CmdBase(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args, SoftwareSerial *stream) {
 
         /* Point to the HardwareSerial Stream that the user passed */
         _swStream = stream;
         set_stream();
 
         /* init the buffers */
-        init_buffers();
+        init_buffers(msg_buf, msg_size, argv_buf, max_args);
     }
 #endif
 
@@ -96,7 +237,7 @@ Cmd::Cmd(HardwareSerial *stream) {
     and initializes things. 
 */
 /**************************************************************************/
-void Cmd::begin(uint32_t speed, uint32_t config /*=SERIAL_8N1*/)
+void CmdBase::begin(uint32_t speed, uint32_t config /*=SERIAL_8N1*/)
 {
     #ifdef SoftwareSerial_h
         if (_hwStream) {
@@ -110,277 +251,1924 @@ void Cmd::begin(uint32_t speed, uint32_t config /*=SERIAL_8N1*/)
 
 }
 
+/**************************************************************************/
+/*!
+    constructor - empty command table
+*/
+/**************************************************************************/
+CmdTable::CmdTable() {
+    /* init the command table */
+    cmd_tbl_list = NULL;
+    cmd_tbl = NULL;
+    _cmd_count = 0;
+    _cmd_gen = 0;
+
+    /* no hashed index until freeze() is called */
+    _cmd_index = NULL;
+    _cmd_index_mask = 0;
+
+    /* no flash-resident command table until add_table() is called */
+    _static_tbl = NULL;
+    _static_tbl_size = 0;
+
+    #if CMD_PREFIX_INDEX
+        /* the sorted name index is built the first time it is needed */
+        _prefix_idx = NULL;
+        _prefix_count = 0;
+        _prefix_built = false;
+    #endif
+
+    /* no binary commands */
+    _bin_list = NULL;
+}
+
+/* gen() - generation counter, bumped whenever the table changes (used to invalidate cached handlers) */
+uint32_t CmdTable::gen() {
+    return _cmd_gen;
+}
+
+/* changed() - the command tables changed: invalidate cached handlers, and the sorted name index (rebuilt when next needed) */
+void CmdTable::changed() {
+    _cmd_gen++;
+    #if CMD_PREFIX_INDEX
+        _prefix_built = false;
+    #endif
+}
+
+/* list() - first command added at runtime (follow ->next for the rest) */
+cmd_t *CmdTable::list() {
+    return cmd_tbl_list;
+}
+
+#if CMD_STATS
+/* stats_reset() - clear the counters of every command in the table */
+void CmdTable::stats_reset() {
+    if (CmdBase::in_worker()) {return;}
+    stats_clear(cmd_tbl_list);
+}
+
+/* stats_clear() - clear the counters of one level of the command tree and everything below it */
+void CmdTable::stats_clear(cmd_t *list) {
+    for (cmd_t *entry = list; entry != NULL; entry = entry->next) {
+        memset(&entry->stats, 0, sizeof(entry->stats));
+        stats_clear(entry->sub);
+    }
+}
+
+/* has_entry() - whether entry is (still) in the table (only compares pointers, entry may already be freed) */
+uint8_t CmdTable::has_entry(const cmd_t *entry) {
+    return has_entry_in(cmd_tbl_list, entry);
+}
+
+/* has_entry_in() - whether entry is in one level of the command tree or below it */
+uint8_t CmdTable::has_entry_in(const cmd_t *list, const cmd_t *entry) {
+    for (; list != NULL; list = list->next) {
+        if (list == entry || has_entry_in(list->sub, entry)) {return true;}
+    }
+    return false;
+}
+#endif
+
 /**************************************************************************/
 /*!
     Add a command to the command table. The commands should be added in
     at the setup() portion of the sketch. 
 */
 /**************************************************************************/
-void Cmd::add(const char *name, void (*func)(int argc, char **argv))
+void CmdTable::add(const char *name, void (*func)(int argc, char **argv))
 {
-    // alloc memory for command struct
-    cmd_tbl = (cmd_t *)malloc(sizeof(cmd_t));
+    add_entry(name, func, NULL, 0);
+}
 
-    // alloc memory for command name
-    char *cmd_name = (char *)malloc(strlen(name)+1);
+/* add_task() - add a command whose handler is a resumable task, run from the job queue */
+void CmdTable::add_task(const char *name, cmd_task_t task)
+{
+    add_entry(name, NULL, task, 0);
+}
 
-    // copy command name
-    strcpy(cmd_name, name);
+/* add_P() - add a command whose name stays in flash instead of being copied to the heap */
+void CmdTable::add_P(const char *name, void (*func)(int argc, char **argv))
+{
+    add_entry(name, func, NULL, CMD_ENTRY_NAME_P);
+}
 
-    // terminate the command name
-    cmd_name[strlen(name)] = '\0';
+/* add_task_P() - add a task command whose name stays in flash */
+void CmdTable::add_task_P(const char *name, cmd_task_t task)
+{
+    add_entry(name, NULL, task, CMD_ENTRY_NAME_P);
+}
 
-    // fill out structure
-    cmd_tbl->cmd = cmd_name;
-    cmd_tbl->func = func;
-    cmd_tbl->next = cmd_tbl_list;
-    cmd_tbl_list = cmd_tbl;
+/* add_P() - add a command with a typed argument schema, whose name stays in flash */
+uint8_t CmdTable::add_P(const char *name, const char *schema, cmd_typed_func_t func)
+{
+    return add_typed(name, schema, func, CMD_ENTRY_NAME_P);
 }
 
 /**************************************************************************/
 /*!
-    Convert a string to a number. The base must be specified, ie: "32" is a
-    different value in base 10 (decimal) and base 16 (hexadecimal).
+    Add a command with a typed argument schema. The schema is compiled
+    here, once, so dispatch only walks one byte per argument.
 */
 /**************************************************************************/
-uint32_t Cmd::conv(char *str, uint8_t base)
+uint8_t CmdTable::add(const char *name, const char *schema, cmd_typed_func_t func)
 {
-    return strtol(str, NULL, base);
+    return add_typed(name, schema, func, 0);
 }
 
-/**
- * @brief Set the the interface mode to be standard (normal user input) or JSON programmatic
- *          Note: setting the mode will automatically clear the command buffer
- * @param mode CLI_MODE_STD = standard mode , CLI_MODE_JSON = JSON programmatic mode, CLI_MODE_JSON_MAN = JSON manual mode
-*/
-void Cmd::mode(uint8_t mode) {
-    /* Update the global tracker */
-    _mode = mode;
+/* add_typed() - compile the schema and add a typed command */
+uint8_t CmdTable::add_typed(const char *name, const char *schema, cmd_typed_func_t func, uint8_t flags)
+{
+    uint8_t compiled[CMD_SCHEMA_MAX_ARGS + 1];
+    int8_t count = cmd_schema_compile(schema, compiled);
+    if (count < 0) {return false;}
 
-    /* Reset the message pointers the message buffers */
-    rst_msg_ptr();
+    uint8_t *schema_copy = (uint8_t *)malloc(count + 1);
+    if (schema_copy == NULL) {return false;}
+    memcpy(schema_copy, compiled, count + 1);
 
-    /* Determine printback settings */
+    cmd_t *entry = add_entry(name, NULL, NULL, flags);
+    if (entry == NULL) {
+        free(schema_copy);
+        return false;
+    }
+    entry->typed_func = func;
+    entry->schema = schema_copy;
+    return true;
+}
 
-    switch(_mode) {
-        default:
-        case CLI_MODE_STD:
-            /* Enable printback to the terminal */
-            _print = true;
+/* add_entry() - allocate a command table entry for either a handler or a task (the name is copied unless it is in flash) */
+cmd_t *CmdTable::add_entry(const char *name, cmd_func_t func, cmd_task_t task, uint8_t flags)
+{
+    /* worker handlers can't change the table: poll() looks commands up at the same time, without a lock */
+    if (CmdBase::in_worker()) {return NULL;}
 
-            /* Display the command prompt */
-            display_prompt();
-            break;
-        case CLI_MODE_JSON:
-            /* Disable printback to the terminal and don't display the prompt */
-            _print = false;
-            break;
-        case CLI_MODE_JSON_MAN:
-            /* Enable printback to the terminal, but don't print a new prompt */
-            _print = true;
-            break;
-    }
+    /* single words (and flash names, which aren't split) go straight into the table */
+    if ((flags & CMD_ENTRY_NAME_P) || !strchr(name, ' ')) {return link_entry(&cmd_tbl_list, name, func, task, flags);}
+
+    /* a multi-word path: the last word goes under the group entries named by the words before it */
+    char *path = (char *)malloc(strlen(name) + 1);
+    if (path == NULL) {return NULL;}
+    strcpy(path, name);
+
+    char *leaf;
+    cmd_t **list = path_list(path, &leaf, true);
+    cmd_t *entry = list ? link_entry(list, leaf, func, task, flags) : NULL;
+
+    free(path);
+    return entry;
 }
 
-/**
- * @brief Allows the user to attach a callback function to be called after receivng a JSON message
- * @param *json_func() pointer to a callFback function provided by the user to be triggered when a JSON message is available
+/**************************************************************************/
+/*!
+    Walk a multi-word command path ("net wifi set") down the subcommand
+    tree, optionally creating group entries (no handler) for words that
+    don't exist yet. path is split in place and *leaf set to its last word.
+    Returns the list the last word lives in, or NULL if a group is missing
+    (or there wasn't enough memory to create it).
 */
-void Cmd::attach_json_callback(void (*json_func)(char *json_msg)) {
-    _json_func = json_func;
-}
+/**************************************************************************/
+cmd_t **CmdTable::path_list(char *path, char **leaf, uint8_t create)
+{
+    cmd_t **list = &cmd_tbl_list;
+    char *word = path;
+    char *space;
+
+    while (*word == ' ') {word++;}
+    while ((space = strchr(word, ' ')) != NULL) {
+        *space = '\0';
+
+        cmd_t *node = (list == &cmd_tbl_list) ? lookup(word) : cmd_find(*list, word);
+        if (node == NULL) {
+            if (!create) {return NULL;}
+            node = link_entry(list, word, NULL, NULL, 0);
+            if (node == NULL) {return NULL;}
+        }
+        list = &node->sub;
 
-/* user can poll this function to check whether or not the exit character has been passed, allowing them to terminate the command line if desired */
-uint8_t Cmd::exit_cli() {
+        word = space + 1;
+        while (*word == ' ') {word++;}
+    }
 
-    if (_exit_cli) {
-        /* Clear flag - to prevent infinitely sending the exit flag */
-        _exit_cli = false;
+    if (!*word) {return NULL;}
+    *leaf = word;
+    return list;
+}
 
-        /* reset the command buffer pointer, essentially dropping any in-progress commands */
-        rst_msg_ptr();
+/* lookup_path() - find a command by its name, or by its multi-word path for subcommands */
+cmd_t *CmdTable::lookup_path(const char *path)
+{
+    if (!strchr(path, ' ')) {return lookup(path);}
 
-        /* Return the true flag once per trigger */
-        return true;
-    } else {
-        return false;
-    }
+    char *copy = (char *)malloc(strlen(path) + 1);
+    if (copy == NULL) {return NULL;}
+    strcpy(copy, path);
 
+    char *leaf;
+    cmd_t **list = path_list(copy, &leaf, false);
+    cmd_t *entry = list ? cmd_find(*list, leaf) : NULL;
+
+    free(copy);
+    return entry;
 }
 
-/* terminate the msg buffer as a string and cleanup pointers */
-void Cmd::return_key() {
-    /* If this is the first character (i.e. - user hit 'enter' on a blank line), print a new line and do nothing */
-    if (msg_ptr == msg) {
-        /* print the command prompt */
-        display_prompt();
+/* link_entry() - allocate an entry and add it to a list: the table itself, or the subcommands of a group */
+cmd_t *CmdTable::link_entry(cmd_t **list, const char *name, cmd_func_t func, cmd_task_t task, uint8_t flags)
+{
+    // alloc memory for command struct
+    cmd_t *entry = (cmd_t *)malloc(sizeof(cmd_t));
+    if (entry == NULL) {return NULL;}
+
+    char *cmd_name = (char *)name;
+    if (!(flags & CMD_ENTRY_NAME_P)) {
+        // alloc memory for command name
+        cmd_name = (char *)malloc(strlen(name)+1);
+        if (cmd_name == NULL) {
+            free(entry);
+            return NULL;
+        }
 
-        /* Break early - no other processing needed for a blank line */
-        return;
+        // copy command name
+        strcpy(cmd_name, name);
+
+        // terminate the command name
+        cmd_name[strlen(name)] = '\0';
     }
 
-    /* make the Command buffer a null-terminated string */
-    *msg_ptr = '\0';
+    // fill out structure
+    entry->cmd = cmd_name;
+    entry->func = func;
+    entry->task = task;
+    entry->typed_func = NULL;
+    entry->schema = NULL;
+    entry->flags = flags;
+    entry->sub = NULL;
+    #if CMD_STATS
+        memset(&entry->stats, 0, sizeof(entry->stats));
+    #endif
+    entry->next = *list;
+    *list = entry;
+    changed();
 
-    /* Clear the terminal line for printing */
-    cli_println("");
+    // subcommands aren't part of the table's indexes
+    if (list != &cmd_tbl_list) {return entry;}
 
-    /* Pass the command buffer to the appropriate parser */
-    switch(_mode) {
-        default:
-        case CLI_MODE_STD:
-            parse_std((char *)msg);
-            break;
-        case CLI_MODE_JSON:
-            parse_json((char *)msg);
-            break;
-        case CLI_MODE_JSON_MAN:
-            parse_json((char *)msg);
-            break;
+    cmd_tbl = entry;
+    _cmd_count++;
+
+    // keep the hashed index (if any) up to date, growing it once it gets 2/3 full
+    if (_cmd_index) {
+        if ((uint32_t)_cmd_count * 3 > ((uint32_t)_cmd_index_mask + 1) * 2) {
+            index_build();
+        } else {
+            index_insert(cmd_tbl, true);
+        }
     }
 
-    /* reset the pointers back to their starting positions to prepare for next entries */
-    rst_msg_ptr();
+    return cmd_tbl;
 }
 
 /**************************************************************************/
 /*!
-    Generate the main command prompt
+    Add, replace or (func == NULL) remove the handler of a binary command.
 */
 /**************************************************************************/
-void Cmd::display()
+void CmdTable::add_bin(uint8_t id, cmd_bin_func_t func)
 {
-    /* temporary RAM buffer for displaying the command banner + command prompt */
-    char buf[CMD_BUF_SIZE];
+    if (CmdBase::in_worker()) {return;}
 
-    cli_println();
+    cmd_bin_t **link = &_bin_list;
+
+    while (*link != NULL && (*link)->id != id) {link = &(*link)->next;}
+
+    if (*link != NULL) {
+        if (func != NULL) {
+            (*link)->func = func;
+        } else {
+            cmd_bin_t *entry = *link;
+            *link = entry->next;
+            free(entry);
+        }
+        return;
+    }
+
+    if (func == NULL) {return;}
+
+    cmd_bin_t *entry = (cmd_bin_t *)malloc(sizeof(cmd_bin_t));
+    if (entry == NULL) {return;}
 
-    /* Copy banner from flash to RAM buffer */
-    strcpy_P(buf, cmd_banner);
-    cli_println(buf);
+    entry->id = id;
+    entry->func = func;
+    entry->next = _bin_list;
+    _bin_list = entry;
+}
 
-    /* Copy prompt from flash to RAM buffer */
-    strcpy_P(buf, cmd_prompt);
-    cli_print(buf);
+/* lookup_bin() - find the handler of a binary command (NULL if there is none) */
+cmd_bin_func_t CmdTable::lookup_bin(uint8_t id)
+{
+    for (cmd_bin_t *entry = _bin_list; entry != NULL; entry = entry->next) {
+        if (entry->id == id) {return entry->func;}
+    }
+    return NULL;
 }
 
 /**************************************************************************/
 /*!
-    Generate the main banner
+    Remove a command from the command table. Every entry with a matching
+    name is unlinked and its memory released, along with its subcommands.
+    A multi-word name removes just that subcommand.
 */
 /**************************************************************************/
-void Cmd::display_banner()
+uint8_t CmdTable::remove(const char *name)
 {
-    /* temporary RAM buffer for displaying the command banner */
-    char buf[CMD_BUF_SIZE];
+    if (CmdBase::in_worker()) {return false;}
+
+    uint8_t found = false;
+    cmd_t **link = &cmd_tbl_list;
+    char *path = NULL;
+    char *leaf = (char *)name;
+
+    if (strchr(name, ' ')) {
+        path = (char *)malloc(strlen(name) + 1);
+        if (path == NULL) {return false;}
+        strcpy(path, name);
+
+        link = path_list(path, &leaf, false);
+        if (link == NULL) {
+            free(path);
+            return false;
+        }
+    }
 
-    cli_println();
+    cmd_t **list = link;
+    while (*link != NULL) {
+        cmd_t *entry = *link;
+        if (cmd_name_eq(leaf, entry)) {
+            // unlink and release the node + its name (unless it is in flash), schema and subcommands
+            *link = entry->next;
+            cmd_free_entry(entry);
+            if (list == &cmd_tbl_list) {_cmd_count--;}
+            found = true;
+        } else {
+            link = &entry->next;
+        }
+    }
+    free(path);
+
+    if (found) {
+        changed();
+
+        if (list == &cmd_tbl_list) {
+            // the last added entry may have just been freed
+            cmd_tbl = cmd_tbl_list;
 
-    /* Copy banner from flash to RAM buffer */
-    strcpy_P(buf, cmd_banner);
-    cli_println(buf);
+            // open addressing can't simply drop a slot, so rebuild the index
+            if (_cmd_index) {index_build();}
+        }
+    }
+
+    return found;
 }
 
 /**************************************************************************/
 /*!
-    Generate the main prompt
+    Replace the callback of an existing command in place (no allocation),
+    or add it if it doesn't exist yet.
 */
 /**************************************************************************/
-void Cmd::display_prompt()
+uint8_t CmdTable::replace(const char *name, void (*func)(int argc, char **argv))
 {
-    /* temporary RAM buffer for displaying the command prompt */
-    char buf[CMD_BUF_SIZE];
+    if (CmdBase::in_worker()) {return false;}
 
-    cli_println("");
+    cmd_t *entry = lookup_path(name);
+
+    if (entry == NULL) {
+        add(name, func);
+        return false;
+    }
 
-    /* Copy banner from flash to RAM buffer */
-    strcpy_P(buf, cmd_prompt);
-    cli_print(buf);
+    entry->func = func;
+    entry->task = NULL;
+    entry->typed_func = NULL;
+    free(entry->schema);
+    entry->schema = NULL;
+    changed();
+    return true;
 }
 
 /**************************************************************************/
 /*!
-    Parse the command line. This function tokenizes the command input, then
-    searches for the command table entry associated with the commmand. Once found,
-    it will jump to the corresponding function.
+    Build the hashed command index. After this, dispatch is a hash probe
+    plus one strcmp regardless of how many commands are registered.
 */
 /**************************************************************************/
-void Cmd::parse_std(char *cmd)
+uint8_t CmdTable::freeze()
 {
-    uint8_t argc, i = 0;
-    char *argv[CMD_MAX_ARGS];
-    char buf[CMD_BUF_SIZE];
-    cmd_t *cmd_entry;
-
-    fflush(stdout);
-
-    // parse the command line statement and break it up into space-delimited
-    // strings. the array of strings will be saved in the argv array.
-    argv[i] = strtok(cmd, " ");
-    do
-    {
-        argv[++i] = strtok(NULL, " ");
-    } while ((i < CMD_MAX_ARGS) && (argv[i] != NULL));
-    
-    // save off the number of arguments for the particular command.
-    argc = i;
+    if (CmdBase::in_worker()) {return false;}
+    return index_build();
+}
 
-    // parse the command table for valid command. used argv[0] which is the
-    // actual command name typed in at the prompt
-    for (cmd_entry = cmd_tbl; cmd_entry != NULL; cmd_entry = cmd_entry->next)
-    {
-        if (!strcmp(argv[0], cmd_entry->cmd))
-        {
-            cmd_entry->func(argc, argv);
-            display();
-            return;
-        }
+/* index_build() - (re)allocate and fill the hashed command index */
+uint8_t CmdTable::index_build() {
+    /* size the table to a power of 2, keeping the load factor at or below 2/3 */
+    uint32_t size = 4;
+    while (size * 2 < (uint32_t)_cmd_count * 3) {size <<= 1;}
+
+    free(_cmd_index);
+    _cmd_index = (cmd_index_t *)calloc(size, sizeof(cmd_index_t));
+    if (_cmd_index == NULL) {
+        /* not enough memory - lookup() falls back to walking the list */
+        _cmd_index_mask = 0;
+        return false;
     }
+    _cmd_index_mask = size - 1;
 
-    // command not recognized. print message and re-generate prompt.
-    strcpy_P(buf, cmd_unrecog);
-    cli_println(buf);
+    /* the list is newest first, so keep the first entry seen for any duplicate names */
+    for (cmd_t *entry = cmd_tbl_list; entry != NULL; entry = entry->next) {
+        index_insert(entry, false);
+    }
 
-    display();
+    return true;
 }
 
-/* parse_json() - performs the buffer parsing based on JSON formatting */
-void Cmd::parse_json(char *cmd) {
-    /* Verify the string is actually in a JSON format (should be enclosed in {}, without any other brackets contained in the string ) */
-    if(strchr(cmd, '{') == cmd && strchr(cmd + 1, '{') == NULL && strchr(cmd, '}') == cmd + strlen(cmd) - 1) {
-        /* Valid JSON message --> call the users function */
-        _json_func((char *)msg);
+/* index_insert() - add a command to the hashed command index (an existing entry with the same name is only replaced if requested) */
+void CmdTable::index_insert(cmd_t *entry, uint8_t replace_existing) {
+    uint16_t hash = cmd_hash(entry->cmd, entry->flags & CMD_ENTRY_NAME_P);
+    uint16_t i = hash & _cmd_index_mask;
+
+    /* linear probe until a free slot (or the same name) is found */
+    while (_cmd_index[i].entry != NULL) {
+        if (_cmd_index[i].hash == hash && !cmd_entry_cmp(entry, _cmd_index[i].entry)) {
+            if (replace_existing) {_cmd_index[i].entry = entry;}
+            return;
+        }
+        i = (i + 1) & _cmd_index_mask;
     }
+
+    _cmd_index[i].hash = hash;
+    _cmd_index[i].entry = entry;
 }
 
 /**************************************************************************/
 /*!
-    This function processes the individual characters typed into the command
-    prompt. It saves them off into the message buffer unless its a "backspace"
-    or "enter" key. 
+    Attach a flash-resident command table. The table must be sorted by name
+    (CMD_TABLE verifies this at compile time) so it can be binary searched
+    straight out of flash, without copying anything to RAM.
 */
 /**************************************************************************/
-void Cmd::handler()
-{   
-    char c = _Cereal->read();
+void CmdTable::add_table(const cmd_static_t *tbl, uint16_t count)
+{
+    if (CmdBase::in_worker()) {return;}
 
-    /* See if we're tracking an esc command code, or standart text character */
-    if (_esc_cmd_ptr - _esc_cmd) {
-        handle_esc_cmd_char(c);
-    } else {
-        switch (c) {
-            case CLI_ASCII_ESC:
-                // escape
-                esc_key();
-                break;
+    _static_tbl = tbl;
+    _static_tbl_size = tbl ? count : 0;
+    changed();
+}
 
-            case CLI_ASCII_LF:
-                // Do Nothing - only handle CR, ignore LF, but clear escape fl
-                break;
+/* add() - allows the user to add command + callback functions to be triggered when the command is seen */
+void CmdBase::add(const char *name, void (*func)(int argc, char **argv)) {
+    _table->add(name, func);
+}
 
-            case CLI_ASCII_CR:
-                // enter
-                return_key();
+/* add() - add a command with a typed argument schema */
+uint8_t CmdBase::add(const char *name, const char *schema, cmd_typed_func_t func) {
+    return _table->add(name, schema, func);
+}
+
+/* add_task() - add a command whose handler is a resumable task, run from the job queue */
+void CmdBase::add_task(const char *name, cmd_task_t task) {
+    _table->add_task(name, task);
+}
+
+/* add_P() - add a command whose name stays in flash */
+void CmdBase::add_P(const char *name, void (*func)(int argc, char **argv)) {
+    _table->add_P(name, func);
+}
+
+/* add_P() - add a command with a typed argument schema, whose name stays in flash */
+uint8_t CmdBase::add_P(const char *name, const char *schema, cmd_typed_func_t func) {
+    return _table->add_P(name, schema, func);
+}
+
+/* add_task_P() - add a task command whose name stays in flash */
+void CmdBase::add_task_P(const char *name, cmd_task_t task) {
+    _table->add_task_P(name, task);
+}
+
+/* add_bin() - add (or replace) the handler of a binary command */
+void CmdBase::add_bin(uint8_t id, cmd_bin_func_t func) {
+    _table->add_bin(id, func);
+}
+
+/* send_bin() - send a binary frame on this instance's stream */
+void CmdBase::send_bin(uint8_t id, const uint8_t *payload, uint16_t len) {
+    #if CMD_WORKER_QUEUE_SIZE
+        // on the worker, the frame goes back to poll() with the rest of the handler output
+        if (_in_worker) {
+            cmd_bin_write(stream(), id, payload, len);
+            return;
+        }
+    #endif
+    cmd_bin_write(&_tx, id, payload, len);
+    _tx.flush();
+}
+
+/* remove() - remove a command from the command table */
+uint8_t CmdBase::remove(const char *name) {
+    return _table->remove(name);
+}
+
+/* replace() - replace the callback of an existing command, or add it */
+uint8_t CmdBase::replace(const char *name, void (*func)(int argc, char **argv)) {
+    return _table->replace(name, func);
+}
+
+/* freeze() - build a hashed index over the command table */
+uint8_t CmdBase::freeze() {
+    return _table->freeze();
+}
+
+/* add_table() - attach a flash-resident command table */
+void CmdBase::add_table(const cmd_static_t *tbl, uint16_t count) {
+    _table->add_table(tbl, count);
+}
+
+/* attach_ring() - take input from a receive ring instead of the stream (NULL = back to the stream) */
+void CmdBase::attach_ring(cmd_ring_t *ring) {
+    _ring = ring;
+}
+
+#if CMD_HISTORY_DEPTH
+/* attach_history() - keep the command history in the given ring (NULL = no history) */
+void CmdBase::attach_history(cmd_history_t *hist) {
+    _hist = hist;
+    _hist_browse = 0;
+    _hist_recalled = CMD_HIST_NONE;
+    _hist_cache_slot = CMD_HIST_NONE;
+}
+#endif
+
+#if CMD_JOB_QUEUE_SIZE
+/* attach_jobs() - queue tasks / deferred handlers in the given job queue */
+void CmdBase::attach_jobs(cmd_jobs_t *jobs) {
+    _jobs = jobs;
+}
+#endif
+
+/* attach_json_state() - token storage and request ids of the JSON modes (NULL = none) */
+void CmdBase::attach_json_state(cmd_json_state_t *json) {
+    _json = json;
+}
+
+/* use_table() - dispatch from a command table shared with other Cmd instances (NULL = back to our own table) */
+void CmdBase::use_table(CmdTable *tbl) {
+    _table = tbl ? tbl : &_own_table;
+
+    #if CMD_HISTORY_DEPTH
+        /* cached handlers belong to the previous table, and its generation says nothing about the new one */
+        if (_hist) {
+            for (uint8_t i = 0; i < _hist->depth; i++) {_hist->slots[i].argc = 0;}
+        }
+    #endif
+}
+
+/* table() - the command table this instance dispatches from */
+CmdTable *CmdBase::table() {
+    return _table;
+}
+
+/* stream() - the stream of the Cmd instance currently dispatching a command */
+Stream *CmdBase::stream() {
+    if (_active == NULL) {return NULL;}
+    #if CMD_WORKER_QUEUE_SIZE
+        // handlers on the worker reply through the output ring
+        if (_in_worker) {return &_active->_worker_out;}
+    #endif
+    return _active->_Cereal;
+}
+
+/* in_worker() - true on the thread running worker_run() (while it runs a command) */
+uint8_t CmdBase::in_worker() {
+    #if CMD_WORKER_QUEUE_SIZE
+        return _in_worker;
+    #else
+        return false;
+    #endif
+}
+
+/* active() - the Cmd instance currently polling / dispatching */
+CmdBase *CmdBase::active() {
+    return _active;
+}
+
+/**************************************************************************/
+/*!
+    Convert a string to a number. The base must be specified, ie: "32" is a
+    different value in base 10 (decimal) and base 16 (hexadecimal).
+*/
+/**************************************************************************/
+uint32_t CmdBase::conv(char *str, uint8_t base)
+{
+    return strtol(str, NULL, base);
+}
+
+/**
+ * @brief Set the the interface mode to be standard (normal user input) or JSON programmatic
+ *          Note: setting the mode will automatically clear the command buffer
+ * @param mode CLI_MODE_STD = standard mode , CLI_MODE_JSON = JSON programmatic mode, CLI_MODE_JSON_MAN = JSON manual mode
+*/
+void CmdBase::mode(uint8_t mode) {
+    /* Update the global tracker */
+    _mode = mode;
+
+    /* Reset the message pointers the message buffers */
+    rst_msg_ptr();
+
+    /* Determine printback settings */
+
+    switch(_mode) {
+        default:
+        case CLI_MODE_STD:
+            /* Enable printback to the terminal */
+            _print = true;
+
+            /* Display the command prompt */
+            display_prompt();
+            break;
+        case CLI_MODE_JSON:
+            /* Disable printback to the terminal and don't display the prompt */
+            _print = false;
+            break;
+        case CLI_MODE_JSON_MAN:
+            /* Enable printback to the terminal, but don't print a new prompt */
+            _print = true;
+            break;
+        case CLI_MODE_JSON_STREAM:
+            /* Disable printback to the terminal and don't display the prompt */
+            _print = false;
+            break;
+        case CLI_MODE_BIN:
+            /* Disable printback to the terminal and don't display the prompt */
+            _print = false;
+            break;
+    }
+
+    /* Push out the prompt (if any) right away */
+    _tx.flush();
+}
+
+/**
+ * @brief Allows the user to attach a callback function to be called after receivng a JSON message
+ * @param *json_func() pointer to a callFback function provided by the user to be triggered when a JSON message is available
+*/
+void CmdBase::attach_json_callback(void (*json_func)(char *json_msg)) {
+    _json_func = json_func;
+}
+
+/**
+ * @brief Allows the user to attach a callback function to be called with a tokenized JSON message
+ * @param *json_func() pointer to a callback function provided by the user to be triggered when a JSON message is available
+*/
+void CmdBase::attach_json_callback(void (*json_func)(char *json_msg, cmd_json_tok_t *toks, int16_t tok_count)) {
+    _json_tok_func = json_func;
+}
+
+/* user can poll this function to check whether or not the exit character has been passed, allowing them to terminate the command line if desired */
+uint8_t CmdBase::exit_cli() {
+
+    if (_exit_cli) {
+        /* Clear flag - to prevent infinitely sending the exit flag */
+        _exit_cli = false;
+
+        /* reset the command buffer pointer, essentially dropping any in-progress commands */
+        rst_msg_ptr();
+
+        /* Return the true flag once per trigger */
+        return true;
+    } else {
+        return false;
+    }
+
+}
+
+/* terminate the msg buffer as a string and cleanup pointers */
+void CmdBase::return_key() {
+    /* If this is the first character (i.e. - user hit 'enter' on a blank line), print a new line and do nothing */
+    if (line_len() == 0) {
+        /* print the command prompt */
+        display_prompt();
+
+        /* Break early - no other processing needed for a blank line */
+        return;
+    }
+
+    /* close the edit gap, making the Command buffer a contiguous null-terminated string */
+    uint16_t len = line_close();
+
+    /* Clear the terminal line for printing */
+    cli_println("");
+
+    /* Pass the command buffer to the appropriate parser */
+    switch(_mode) {
+        default:
+        case CLI_MODE_STD:
+            #if CMD_HISTORY_DEPTH
+                /* An unchanged recalled line can be re-run from its cached parse result */
+                if (hist_exec()) {break;}
+
+                /* Remember the line before parse_std() tokenizes it in place */
+                hist_push((char *)msg, len);
+            #endif
+            parse_std((char *)msg);
+            break;
+        case CLI_MODE_JSON:
+            parse_json((char *)msg);
+            break;
+        case CLI_MODE_JSON_MAN:
+            parse_json((char *)msg);
+            break;
+        case CLI_MODE_JSON_STREAM:
+            parse_json((char *)msg);
+            break;
+    }
+
+    /* reset the pointers back to their starting positions to prepare for next entries */
+    rst_msg_ptr();
+
+    /* Bounded poll: once the time budget is spent, stop handler() right after this command */
+    if (poll_expired()) {_rx_end = _rx_pos;}
+}
+
+/**************************************************************************/
+/*!
+    Generate the main command prompt
+*/
+/**************************************************************************/
+void CmdBase::display()
+{
+    cli_println();
+
+    /* Banner + prompt are printed straight from flash (no RAM copy on the stack) */
+    cli_println_P(cmd_banner);
+    cli_print_P(cmd_prompt);
+}
+
+/**************************************************************************/
+/*!
+    Generate the main banner
+*/
+/**************************************************************************/
+void CmdBase::display_banner()
+{
+    cli_println();
+
+    /* Banner is printed straight from flash (no RAM copy on the stack) */
+    cli_println_P(cmd_banner);
+}
+
+/**************************************************************************/
+/*!
+    Generate the main prompt
+*/
+/**************************************************************************/
+void CmdBase::display_prompt()
+{
+    cli_println("");
+
+    /* Prompt is printed straight from flash (no RAM copy on the stack) */
+    cli_print_P(cmd_prompt);
+}
+
+/**************************************************************************/
+/*!
+    Parse the command line. This function tokenizes the command input, then
+    searches for the command table entry associated with the commmand. Once found,
+    it will jump to the corresponding function.
+*/
+/**************************************************************************/
+void CmdBase::parse_std(char *cmd)
+{
+    uint8_t argc, i = 0;
+    char **argv = _argv;
+    cmd_t *cmd_entry;
+    cmd_func_t func;
+    cmd_task_t task;
+
+    fflush(stdout);
+
+    // parse the command line statement and break it up into space-delimited
+    // strings. the array of strings will be saved in the argv array (which
+    // has _max_args + 1 entries, so it is always NULL terminated)
+    argv[i] = strtok(cmd, " ");
+    while ((argv[i] != NULL) && (i < _max_args))
+    {
+        argv[++i] = strtok(NULL, " ");
+    }
+    argv[i] = NULL;
+    
+    // save off the number of arguments for the particular command.
+    argc = i;
+
+    // a line made only of spaces has no command in it
+    if (argv[0] == NULL)
+    {
+        display_prompt();
+        return;
+    }
+
+    // search the command tables for valid command. used argv[0] which is the
+    // actual command name typed in at the prompt
+    cmd_entry = _table->lookup(argv[0]);
+    func = cmd_entry ? cmd_entry->func : _table->lookup_static(argv[0]);
+
+    #if CMD_PREFIX_INDEX
+        // not a full command name, but it may be the start of exactly one
+        if (cmd_entry == NULL && func == NULL) {cmd_entry = _table->lookup_abbrev(argv[0], &func);}
+    #endif
+
+    // subcommands: follow the words that name them down the tree, the deepest one gets the rest of the line
+    if (cmd_entry && cmd_entry->sub)
+    {
+        cmd_t *sub;
+        while (argc > 1 && cmd_entry->sub && (sub = cmd_find(cmd_entry->sub, argv[1])) != NULL)
+        {
+            cmd_entry = sub;
+            argc--;
+            argv++;
+        }
+        func = cmd_entry->func;
+
+        // a group without a handler of its own lists what it contains
+        if (func == NULL && cmd_entry->task == NULL && cmd_entry->schema == NULL)
+        {
+            cli_print_P(cmd_subcmds);
+            if (_print) {cmd_print_subs(&_tx, cmd_entry->sub);}
+            cli_println("");
+            display();
+            return;
+        }
+    }
+
+    // commands with an argument schema are validated before they run
+    if (cmd_entry && cmd_entry->schema)
+    {
+        dispatch_typed(cmd_entry, argc, argv);
+        return;
+    }
+
+    task = cmd_entry ? cmd_entry->task : NULL;
+    if (func != NULL || task != NULL)
+    {
+        #if CMD_HISTORY_DEPTH
+            // remember the parse result so recalling this line skips the tokenizer + lookup
+            hist_cache(argc, argv, func, task, cmd_entry);
+        #endif
+
+        dispatch(argc, argv, func, task, cmd_entry);
+        return;
+    }
+
+    #if CMD_STATS
+        _stats.unknown++;
+    #endif
+    _cmd_failed = true;
+
+    // command not recognized. print message and re-generate prompt.
+    cli_println_P(cmd_unrecog);
+
+    display();
+}
+
+/**************************************************************************/
+/*!
+    Parse the arguments of a typed command against its schema. Any bad
+    argument is reported here, so the handler only ever sees valid values.
+*/
+/**************************************************************************/
+void CmdBase::dispatch_typed(cmd_t *cmd_entry, uint8_t argc, char **argv)
+{
+    cmd_arg_t args[CMD_SCHEMA_MAX_ARGS];
+
+    // argv[0] is the command name
+    uint8_t bad = cmd_args_parse(cmd_entry->schema, argc - 1, argv + 1, args);
+
+    #if CMD_STATS
+        if (bad) {cmd_entry->stats.errors++;}
+    #endif
+    if (bad) {_cmd_failed = true;}
+
+    if (bad == argc)
+    {
+        // wrong number of arguments: show what the schema expects
+        cli_print_P(cmd_usage);
+        if (_print) {cmd_print_name(&_tx, cmd_entry);}
+        for (const uint8_t *type = cmd_entry->schema; *type != CMD_ARG_NONE; type++)
+        {
+            cli_print(' ');
+            cli_print_P(cmd_arg_type_name(*type));
+            if (*type & CMD_ARG_OPTIONAL) {cli_print('?');}
+        }
+        cli_println("");
+        display();
+        return;
+    }
+
+    if (bad)
+    {
+        cli_print_P(cmd_badarg);
+        cli_print(bad);
+        cli_print(F(" (expected "));
+        cli_print_P(cmd_arg_type_name(cmd_entry->schema[bad - 1]));
+        cli_println(F(")"));
+        display();
+        return;
+    }
+
+    // anything the handler prints must come after our own output
+    _tx.flush();
+    #if CMD_STATS
+        uint32_t gen = _table->gen();
+        uint32_t start = micros();
+    #endif
+    cmd_entry->typed_func(argc - 1, args);
+    #if CMD_STATS
+        stat_call(cmd_entry, gen, start);
+    #endif
+    display();
+}
+
+#if CMD_STATS
+    /* Built-ins that read / clear the counters of the instance only run on the poll() thread, never queued */
+    #define CMD_FUNC_INLINE(func)   ((func) == CmdBase::stats_cmd)
+#else
+    #define CMD_FUNC_INLINE(func)   false
+#endif
+
+/**************************************************************************/
+/*!
+    Run a parsed command, or queue it as a job if it is a task (or plain
+    handlers are deferred), then print the prompt.
+*/
+/**************************************************************************/
+void CmdBase::dispatch(uint8_t argc, char **argv, cmd_func_t func, cmd_task_t task, cmd_t *entry)
+{
+    #if CMD_WORKER_QUEUE_SIZE
+        if (task == NULL && func != NULL && _exec_mode == CMD_EXEC_WORKER && CMD_FUNC_INLINE(func)) {
+            // runs right here, after the commands typed before it (so their output and counters come first)
+            worker_wait();
+        } else if (task == NULL && func != NULL && _exec_mode == CMD_EXEC_WORKER) {
+            if (worker_push(argc, argv, func, entry)) {
+                display_prompt();
+                return;
+            }
+
+            // running it here instead would race the handlers on the worker
+            #if CMD_STATS
+                if (entry) {entry->stats.errors++;}
+            #endif
+            _cmd_failed = true;
+            cli_println_P(cmd_job_full);
+            display();
+            return;
+        }
+    #endif
+
+    #if CMD_JOB_QUEUE_SIZE
+        if (task != NULL || (_exec_mode == CMD_EXEC_DEFERRED && !CMD_FUNC_INLINE(func))) {
+            if (job_push(argc, argv, func, task, entry)) {
+                display_prompt();
+                return;
+            }
+
+            // no room for a task. a plain handler can still run right away
+            if (task != NULL) {
+                #if CMD_STATS
+                    if (entry) {entry->stats.errors++;}
+                #endif
+                _cmd_failed = true;
+                cli_println_P(cmd_job_full);
+                display();
+                return;
+            }
+        }
+    #else
+        // without a job queue there is nowhere for a task to run
+        if (func == NULL) {
+            _cmd_failed = true;
+            cli_println_P(cmd_unrecog);
+            display();
+            return;
+        }
+    #endif
+
+    // anything the handler prints must come after our own output
+    _tx.flush();
+    #if CMD_STATS
+        uint32_t gen = _table->gen();
+        uint32_t start = micros();
+    #endif
+    func(argc, argv);
+    #if CMD_STATS
+        stat_call(entry, gen, start);
+    #endif
+    display();
+}
+
+#if CMD_STATS
+/* stat_add() - add one handler call / task step to the counters of an entry */
+static void stat_add(cmd_t *entry, uint32_t elapsed, uint8_t call)
+{
+    // flash-resident (or since removed) commands have nowhere to keep counters
+    if (entry == NULL) {return;}
+
+    if (call) {entry->stats.calls++;}
+    entry->stats.time_total += elapsed;
+    if (elapsed > entry->stats.time_max) {entry->stats.time_max = elapsed;}
+}
+
+/**************************************************************************/
+/*!
+    stat_entry() - a handler (or anything else since the lookup) may have
+    removed its own command, so an entry is only trusted while the table
+    generation is unchanged, or once it is found in the table again
+*/
+/**************************************************************************/
+cmd_t *CmdBase::stat_entry(cmd_t *entry, uint32_t gen)
+{
+    if (entry != NULL && gen != _table->gen() && !_table->has_entry(entry)) {return NULL;}
+    return entry;
+}
+
+/* stat_call() - account one handler call that started at micros() == start */
+void CmdBase::stat_call(cmd_t *entry, uint32_t gen, uint32_t start)
+{
+    stat_add(stat_entry(entry, gen), micros() - start, true);
+}
+#endif
+
+#if CMD_JOB_QUEUE_SIZE || CMD_WORKER_QUEUE_SIZE
+/* job_copy() - copy the parsed tokens of a command line into a job, false if they don't fit */
+static uint8_t job_copy(cmd_job_t *job, uint8_t argc, char **argv)
+{
+    if (argc > CMD_JOB_MAX_ARGS) {return false;}
+
+    // the tokens are still back to back (NULL separated) in the command buffer, so copy them as one block
+    uint16_t len = (argv[argc - 1] + strlen(argv[argc - 1]) + 1) - argv[0];
+    if (len > CMD_JOB_LINE_SIZE) {return false;}
+
+    memcpy(job->line, argv[0], len);
+    for (uint8_t i = 0; i < argc; i++) {job->argv[i] = job->line + (argv[i] - argv[0]);}
+    job->argv[argc] = NULL;
+    job->argc = argc;
+    return true;
+}
+#endif
+
+#if CMD_JOB_QUEUE_SIZE
+/* job_push() - copy a parsed command into a free job queue slot */
+uint8_t CmdBase::job_push(uint8_t argc, char **argv, cmd_func_t func, cmd_task_t task, cmd_t *entry)
+{
+    if (_jobs == NULL || _jobs->count >= _jobs->size) {return false;}
+
+    for (uint8_t slot = 0; slot < _jobs->size; slot++) {
+        cmd_job_t *job = &_jobs->slots[slot];
+        if (job->task != NULL || job->func != NULL) {continue;}
+
+        if (!job_copy(job, argc, argv)) {return false;}
+        job->state = 0;
+        job->wake = 0;
+        job->ctx = NULL;
+        job->task = task;
+        job->func = task ? NULL : func;
+        #if CMD_STATS
+            job->entry = entry;
+            job->gen = _table->gen();
+        #endif
+        _jobs->count++;
+        return true;
+    }
+    return false;
+}
+#endif
+
+/**************************************************************************/
+/*!
+    Give every queued job one turn. Tasks that return CMD_TASK_DONE and
+    deferred handlers (which always run to completion) free their slot.
+*/
+/**************************************************************************/
+void CmdBase::jobs_run()
+{
+    #if CMD_JOB_QUEUE_SIZE
+        if (_jobs == NULL || !_jobs->count) {return;}
+
+        // anything a job prints must come after our own output
+        _tx.flush();
+
+        CmdBase *prev_active = _active;
+        _active = this;
+
+        for (uint8_t slot = 0; slot < _jobs->size; slot++) {
+            cmd_job_t *job = &_jobs->slots[slot];
+            #if CMD_STATS
+                uint32_t start = micros();
+            #endif
+
+            if (job->task != NULL) {
+                uint8_t yield = (job->task(job) == CMD_TASK_YIELD);
+
+                #if CMD_STATS
+                    // every step adds to the handler time, but only a finished job counts as a call. the command
+                    // may have been removed since the job was queued, so its entry is checked again after each step
+                    job->entry = stat_entry(job->entry, job->gen);
+                    job->gen = _table->gen();
+                    stat_add(job->entry, micros() - start, !yield);
+                #endif
+
+                if (yield) {continue;}
+            } else if (job->func != NULL) {
+                job->func(job->argc, job->argv);
+                #if CMD_STATS
+                    stat_call(job->entry, job->gen, start);
+                #endif
+            } else {
+                continue;
+            }
+
+            job->task = NULL;
+            job->func = NULL;
+            _jobs->count--;
+        }
+
+        _active = prev_active;
+    #endif
+}
+
+#if CMD_WORKER_QUEUE_SIZE
+/**************************************************************************/
+/*!
+    worker_push() - poll() side of the worker queue: wait for a free slot
+    (writing out worker output meanwhile, so a worker blocked on a full
+    output ring can finish), fill it in, then publish it with a release
+    store of the head index
+*/
+/**************************************************************************/
+uint8_t CmdBase::worker_push(uint8_t argc, char **argv, cmd_func_t func, cmd_t *entry)
+{
+    _tx.flush();
+    for (;;) {
+        #if CMD_STATS
+            // a slot is only reused once worker_drain() has accounted its handler time
+            uint8_t oldest = _worker_done;
+        #else
+            uint8_t oldest = cmd_ring_load(&_worker_tail);
+        #endif
+        if ((uint8_t)(_worker_head - oldest) < CMD_WORKER_QUEUE_SIZE) {break;}
+
+        worker_drain();
+        yield();
+    }
+
+    cmd_job_t *job = &_worker_jobs[_worker_head & (CMD_WORKER_QUEUE_SIZE - 1)];
+    if (!job_copy(job, argc, argv)) {return false;}
+    job->func = func;
+    #if CMD_STATS
+        job->entry = entry;
+        job->gen = _table->gen();
+    #endif
+
+    cmd_ring_store(&_worker_head, (uint8_t)(_worker_head + 1));
+    return true;
+}
+
+/* worker_wait() - wait for the worker to finish every queued command, writing out its output meanwhile */
+void CmdBase::worker_wait()
+{
+    for (;;) {
+        // whatever the worker printed before its tail moved is in the ring by now
+        uint8_t idle = (cmd_ring_load(&_worker_tail) == _worker_head);
+        worker_drain();
+        if (idle) {break;}
+        yield();
+    }
+}
+
+/* worker_drain() - copy the worker's output to the stream, behind anything we buffered ourselves */
+void CmdBase::worker_drain()
+{
+    uint8_t chunk[32];
+    uint16_t len;
+
+    while ((len = cmd_ring_read(&_worker_ring, chunk, sizeof(chunk))) > 0) {_tx.write(chunk, len);}
+    _tx.flush();
+
+    #if CMD_STATS
+        // the counters are only touched on this thread, where the table can't change under them
+        uint8_t tail = cmd_ring_load(&_worker_tail);
+        for (; _worker_done != tail; _worker_done++) {
+            cmd_job_t *job = &_worker_jobs[_worker_done & (CMD_WORKER_QUEUE_SIZE - 1)];
+            stat_add(stat_entry(job->entry, job->gen), job->elapsed, true);
+        }
+    #endif
+}
+
+/**************************************************************************/
+/*!
+    worker_run() - worker side: run the command at the tail of the queue,
+    then release its slot (the job stays valid while the handler runs)
+*/
+/**************************************************************************/
+uint8_t CmdBase::worker_run()
+{
+    uint8_t tail = _worker_tail;
+    if (tail == cmd_ring_load(&_worker_head)) {return false;}
+
+    cmd_job_t *job = &_worker_jobs[tail & (CMD_WORKER_QUEUE_SIZE - 1)];
+
+    CmdBase *prev_active = _active;
+    uint8_t prev_in_worker = _in_worker;
+    _active = this;
+    _in_worker = true;
+
+    #if CMD_STATS
+        // accounted by worker_drain() on the poll() thread
+        uint32_t start = micros();
+    #endif
+    job->func(job->argc, job->argv);
+    #if CMD_STATS
+        job->elapsed = micros() - start;
+    #endif
+
+    _active = prev_active;
+    _in_worker = prev_in_worker;
+
+    cmd_ring_store(&_worker_tail, (uint8_t)(tail + 1));
+    return true;
+}
+
+/* worker_pending() - commands queued for / running on the worker */
+uint8_t CmdBase::worker_pending()
+{
+    return (uint8_t)(cmd_ring_load(&_worker_head) - cmd_ring_load(&_worker_tail));
+}
+#endif
+
+/* jobs_pending() - number of queued / running jobs */
+uint8_t CmdBase::jobs_pending()
+{
+    #if CMD_JOB_QUEUE_SIZE
+        return _jobs ? _jobs->count : 0;
+    #else
+        return 0;
+    #endif
+}
+
+#if CMD_STATS
+/* stats() - runtime counters of this instance */
+const cmd_stats_t *CmdBase::stats()
+{
+    return &_stats;
+}
+
+/* cmd_stats() - runtime counters of one command (NULL if there is no such command) */
+const cmd_entry_stats_t *CmdBase::cmd_stats(const char *name)
+{
+    cmd_t *entry = _table->lookup_path(name);
+    return entry ? &entry->stats : NULL;
+}
+
+/* stats_reset() - clear the counters of this instance and of every command in its table */
+void CmdBase::stats_reset()
+{
+    if (in_worker()) {return;}
+    memset(&_stats, 0, sizeof(_stats));
+    _table->stats_reset();
+}
+
+/* add_stats_cmd() - add the built-in command that prints all counters */
+void CmdBase::add_stats_cmd(const char *name)
+{
+    add(name, stats_cmd);
+}
+
+/**************************************************************************/
+/*!
+    Built-in stats command. Prints the counters of the instance it was
+    typed on, then one line per command:
+
+        name calls total_us max_us errors
+
+    "stats reset" clears all counters.
+*/
+/**************************************************************************/
+void CmdBase::stats_cmd(int argc, char **argv)
+{
+    CmdBase *cmd = _active;
+    Stream *out = stream();
+
+    if (argc > 1 && !strcmp(argv[1], "reset")) {
+        cmd->stats_reset();
+        return;
+    }
+
+    out->print(F("bytes read: "));       out->println(cmd->_stats.bytes_read);
+    out->print(F("bytes echoed: "));     out->println(cmd->_stats.bytes_echoed);
+    out->print(F("lines dropped: "));    out->println(cmd->_stats.lines_dropped);
+    out->print(F("unknown commands: ")); out->println(cmd->_stats.unknown);
+    out->print(F("JSON rejected: "));    out->println(cmd->_stats.json_rejected);
+    out->print(F("binary rejected: "));  out->println(cmd->_stats.bin_rejected);
+
+    out->println(F("command calls total_us max_us errors"));
+    stats_print(out, cmd->_table->list(), 0);
+}
+
+/* stats_print() - print the counters of one level of the command tree, subcommands indented below their group */
+void CmdBase::stats_print(Print *out, cmd_t *list, uint8_t depth)
+{
+    for (cmd_t *entry = list; entry != NULL; entry = entry->next) {
+        for (uint8_t i = 0; i < depth; i++) {out->print(F("  "));}
+        cmd_print_name(out, entry);
+        out->print(' ');
+        out->print(entry->stats.calls);
+        out->print(' ');
+        out->print(entry->stats.time_total);
+        out->print(' ');
+        out->print(entry->stats.time_max);
+        out->print(' ');
+        out->println(entry->stats.errors);
+        stats_print(out, entry->sub, depth + 1);
+    }
+}
+#endif
+
+/* exec_mode() - choose when plain command handlers run (CMD_EXEC_INLINE / CMD_EXEC_DEFERRED / CMD_EXEC_WORKER) */
+void CmdBase::exec_mode(uint8_t mode)
+{
+    _exec_mode = mode;
+}
+
+/* lookup() - find a command added at runtime (via the hashed index once frozen, otherwise by walking the list) */
+cmd_t *CmdTable::lookup(const char *name) {
+    if (_cmd_index) {
+        uint16_t hash = cmd_hash(name);
+
+        /* probe until an empty slot - the table is never full, so this always terminates */
+        for (uint16_t i = hash & _cmd_index_mask; _cmd_index[i].entry != NULL; i = (i + 1) & _cmd_index_mask) {
+            if (_cmd_index[i].hash == hash && cmd_name_eq(name, _cmd_index[i].entry)) {return _cmd_index[i].entry;}
+        }
+        return NULL;
+    }
+
+    for (cmd_t *cmd_entry = cmd_tbl_list; cmd_entry != NULL; cmd_entry = cmd_entry->next) {
+        if (cmd_name_eq(name, cmd_entry)) {return cmd_entry;}
+    }
+    return NULL;
+}
+
+/* lookup_static() - binary search of the flash-resident command table */
+cmd_func_t CmdTable::lookup_static(const char *name) {
+    uint16_t lo = 0;
+    uint16_t hi = _static_tbl_size;
+
+    while (lo < hi) {
+        uint16_t mid = lo + ((hi - lo) >> 1);
+        int diff = strcmp_P(name, _static_tbl[mid].cmd);
+
+        if (diff == 0) {
+            /* Function pointer also lives in flash */
+            return (cmd_func_t)pgm_read_ptr(&_static_tbl[mid].func);
+        } else if (diff < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+#if CMD_PREFIX_INDEX
+/* prefix_build() - build the sorted name index, if the table changed since it was last built */
+uint8_t CmdTable::prefix_build() {
+    if (_prefix_built) {return true;}
+
+    free(_prefix_idx);
+    _prefix_idx = NULL;
+    _prefix_count = 0;
+    _prefix_built = false;
+
+    if (_cmd_count) {
+        /* not enough memory - completion and abbreviations only see the flash-resident table */
+        _prefix_idx = (cmd_t **)malloc(_cmd_count * sizeof(cmd_t *));
+        if (_prefix_idx == NULL) {return false;}
+    }
+
+    /* binary insertion; the list is newest first, so (like lookup()) the first entry seen for a duplicate name wins */
+    for (cmd_t *entry = cmd_tbl_list; entry != NULL; entry = entry->next) {
+        uint16_t lo = 0;
+        uint16_t hi = _prefix_count;
+        while (lo < hi) {
+            uint16_t mid = lo + ((hi - lo) >> 1);
+            if (cmd_entry_cmp(_prefix_idx[mid], entry) < 0) {lo = mid + 1;} else {hi = mid;}
+        }
+        if (lo < _prefix_count && !cmd_entry_cmp(_prefix_idx[lo], entry)) {continue;}
+
+        memmove(&_prefix_idx[lo + 1], &_prefix_idx[lo], (_prefix_count - lo) * sizeof(cmd_t *));
+        _prefix_idx[lo] = entry;
+        _prefix_count++;
+    }
+
+    _prefix_built = true;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Find the commands starting with prefix. Both the sorted name index and
+    the flash-resident table are in strcmp() order, so the matches are one
+    contiguous range in each, found with a lower / upper bound search.
+*/
+/**************************************************************************/
+uint16_t CmdTable::prefix_find(const char *prefix, uint16_t len, cmd_prefix_t *range) {
+    uint16_t lo, hi, mid;
+
+    memset(range, 0, sizeof(cmd_prefix_t));
+
+    if (prefix_build()) {
+        /* first name that doesn't sort before the prefix */
+        lo = 0;
+        hi = _prefix_count;
+        while (lo < hi) {
+            mid = lo + ((hi - lo) >> 1);
+            cmd_t *entry = _prefix_idx[mid];
+            if (cmd_name_ncmp(entry->cmd, entry->flags & CMD_ENTRY_NAME_P, prefix, false, len) < 0) {lo = mid + 1;} else {hi = mid;}
+        }
+        range->first = lo;
+
+        /* first name after it that doesn't start with the prefix */
+        hi = _prefix_count;
+        while (lo < hi) {
+            mid = lo + ((hi - lo) >> 1);
+            cmd_t *entry = _prefix_idx[mid];
+            if (cmd_name_ncmp(entry->cmd, entry->flags & CMD_ENTRY_NAME_P, prefix, false, len) == 0) {lo = mid + 1;} else {hi = mid;}
+        }
+        range->count = lo - range->first;
+    }
+
+    /* same again, straight out of the flash-resident table */
+    lo = 0;
+    hi = _static_tbl_size;
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (cmd_name_ncmp(_static_tbl[mid].cmd, true, prefix, false, len) < 0) {lo = mid + 1;} else {hi = mid;}
+    }
+    range->static_first = lo;
+
+    hi = _static_tbl_size;
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (cmd_name_ncmp(_static_tbl[mid].cmd, true, prefix, false, len) == 0) {lo = mid + 1;} else {hi = mid;}
+    }
+    range->static_count = lo - range->static_first;
+
+    return range->count + range->static_count;
+}
+
+/* prefix_name() - name of match i (runtime commands first, then the flash-resident table) of a prefix_find() result */
+const char *CmdTable::prefix_name(const cmd_prefix_t *range, uint16_t i, uint8_t *in_flash) {
+    if (i < range->count) {
+        cmd_t *entry = _prefix_idx[range->first + i];
+        *in_flash = entry->flags & CMD_ENTRY_NAME_P;
+        return entry->cmd;
+    }
+
+    *in_flash = true;
+    return _static_tbl[range->static_first + (i - range->count)].cmd;
+}
+
+/* lookup_abbrev() - resolve a unique abbreviation of a command name */
+cmd_t *CmdTable::lookup_abbrev(const char *name, cmd_func_t *func) {
+    cmd_prefix_t range;
+    uint16_t count = prefix_find(name, strlen(name), &range);
+
+    *func = NULL;
+
+    /* a name in both tables is one command (the runtime entry takes precedence, as with exact names) */
+    if (range.count == 1 && range.static_count == 1) {
+        cmd_t *entry = _prefix_idx[range.first];
+        if (!cmd_name_ncmp(entry->cmd, entry->flags & CMD_ENTRY_NAME_P, _static_tbl[range.static_first].cmd, true, 0xFFFF)) {count = 1;}
+    }
+
+    if (count != 1) {return NULL;}
+
+    if (range.count) {
+        cmd_t *entry = _prefix_idx[range.first];
+        *func = entry->func;
+        return entry;
+    }
+
+    *func = (cmd_func_t)pgm_read_ptr(&_static_tbl[range.static_first].func);
+    return NULL;
+}
+#endif
+
+/* parse_json() - performs the buffer parsing based on JSON formatting */
+void CmdBase::parse_json(char *cmd) {
+    cmd_json_parser_t parser;
+    cmd_json_tok_t *toks = _json ? _json->toks : NULL;
+
+    /* Tokenize in place - the message must be exactly one JSON object (nested objects / arrays are allowed).
+       Without a JSON state the tokens are only counted, which checks the message just as strictly */
+    cmd_json_init(&parser);
+    int16_t tok_count = cmd_json_parse(&parser, cmd, strlen(cmd), toks, toks ? _json->max_toks : 0);
+    /* The tokenizer refuses anything after the root value, so only its type is left to check */
+    uint8_t valid = (tok_count > 0 && cmd[strspn(cmd, " \t\r\n")] == '{');
+
+    if (_json) {
+        /* Keep the request "id" as written (strings with their quotes) so the reply can carry it */
+        _json->id[0] = '\0';
+        int16_t id_idx = valid ? cmd_json_find(cmd, toks, tok_count, 0, "id") : -1;
+        if (id_idx >= 0) {
+            const cmd_json_tok_t *tok = &toks[id_idx];
+            uint8_t quoted = (tok->type == CMD_JSON_STRING);
+            int16_t start = tok->start - quoted;
+            int16_t len = tok->end + quoted - start;
+
+            // an id that doesn't fit couldn't be echoed back, and an object / array isn't an id
+            if (tok->type == CMD_JSON_OBJECT || tok->type == CMD_JSON_ARRAY || len >= CMD_JSON_ID_SIZE) {
+                valid = false;
+            } else {
+                memcpy(_json->id, cmd + start, len);
+                _json->id[len] = '\0';
+            }
+        }
+    }
+
+    if (!valid) {
+        #if CMD_STATS
+            _stats.json_rejected++;
+        #endif
+        return;
+    }
+
+    /* Valid JSON message --> call the users function(s), after pushing out our own output */
+    _tx.flush();
+    if (_json_func) {_json_func(cmd);}
+    if (_json_tok_func && toks) {_json_tok_func(cmd, toks, tok_count);}
+
+    /* The id only applies while the request is being handled */
+    if (_json) {_json->id[0] = '\0';}
+}
+
+/* json_id() - "id" of the JSON request being handled, NULL if none */
+const char *CmdBase::json_id() {
+    return (_json && _json->id[0]) ? _json->id : NULL;
+}
+
+#if CMD_JSON_PENDING
+/**************************************************************************/
+/*!
+    json_defer() - move the id of the request being handled to the pending
+    request queue, so it can be answered after the callback returns
+*/
+/**************************************************************************/
+uint8_t CmdBase::json_defer() {
+    if (!_json) {return CMD_JSON_NO_TICKET;}
+
+    for (uint8_t ticket = 0; ticket < CMD_JSON_PENDING; ticket++) {
+        // slots are claimed / released atomically: a worker handler can reply while poll() defers the next request
+        uint8_t bit = (uint8_t)(1 << ticket);
+        if (__atomic_fetch_or(&_json->pending_used, bit, __ATOMIC_ACQ_REL) & bit) {continue;}
+
+        strcpy(_json->pending[ticket], _json->id);
+        return ticket;
+    }
+    return CMD_JSON_NO_TICKET;
+}
+
+/* json_pending() - number of deferred requests still waiting for their reply */
+uint8_t CmdBase::json_pending() {
+    uint8_t count = 0;
+    if (_json) {
+        for (uint8_t used = cmd_ring_load(&_json->pending_used); used; used &= used - 1) {count++;}
+    }
+    return count;
+}
+
+/* json_release() - free the slot of a deferred request */
+void CmdBase::json_release(uint8_t ticket) {
+    if (_json && ticket < CMD_JSON_PENDING) {__atomic_fetch_and(&_json->pending_used, (uint8_t)~(1 << ticket), __ATOMIC_RELEASE);}
+}
+#endif
+
+/**************************************************************************/
+/*!
+    This function processes the characters staged by poll(). Runs of plain
+    input are copied into the message buffer in bulk; anything that needs
+    editing / escape handling falls back to handle_char(), one character at
+    a time.
+*/
+/**************************************************************************/
+void CmdBase::handler()
+{
+    /* Streamed JSON is framed by its braces rather than by line editing */
+    if (_mode == CLI_MODE_JSON_STREAM) {
+        rx_json_stream();
+        _tx.flush();
+        return;
+    }
+
+    /* So are binary frames, by their 0x00 delimiter */
+    if (_mode == CLI_MODE_BIN) {
+        rx_bin();
+        _tx.flush();
+        return;
+    }
+
+    while (_rx_pos < _rx_end) {
+        /* bulk paths only apply when no escape sequence is being collected */
+        if (!cmd_esc_active(&_esc)) {
+            if (_mode == CLI_MODE_JSON) {
+                if (rx_bulk_json()) {continue;}
+            } else if (_tail_ptr == _msg_end) {
+                if (rx_bulk_echo()) {continue;}
+            }
+        }
+
+        handle_char((char)_rx_buf[_rx_pos++]);
+    }
+
+    /* Everything echoed / redrawn for this chunk goes out in one write */
+    _tx.flush();
+}
+
+/* rx_fill() - pull whatever the stream / receive ring has available into the receive staging buffer */
+uint8_t CmdBase::rx_fill() {
+    /* Still working through the previous chunk */
+    if (_rx_pos < _rx_len) {return true;}
+
+    if (_ring != NULL) {
+        /* Filled by an interrupt / RX callback: take a chunk without touching the stream */
+        _rx_len = cmd_ring_read(_ring, _rx_buf, CMD_RX_CHUNK_SIZE);
+    } else {
+        int avail = _Cereal->available();
+        if (avail <= 0) {return false;}
+        if (avail > CMD_RX_CHUNK_SIZE) {avail = CMD_RX_CHUNK_SIZE;}
+
+        /* Only ask for what's already available, so readBytes() never waits on its timeout */
+        _rx_len = _Cereal->readBytes((char *)_rx_buf, avail);
+    }
+    _rx_pos = 0;
+    _rx_end = _rx_len;
+
+    #if CMD_STATS
+        _stats.bytes_read += _rx_len;
+    #endif
+
+    return _rx_len > 0;
+}
+
+/* rx_waiting() - input still in the stream / receive ring */
+uint8_t CmdBase::rx_waiting() {
+    if (_ring != NULL) {return cmd_ring_available(_ring) > 0;}
+    return _Cereal->available() > 0;
+}
+
+/**
+ * @brief CLI_MODE_JSON fast path. There is no echo in programmatic JSON mode, so everything up to the next CR is
+ *          copied into the msg buffer with memcpy.  ESC (the exit sequence) and BS / DEL (backspace) are left to
+ *          handle_char(): the bytes before them are copied, then the caller handles the key itself.
+ * @retval true if the staged bytes were consumed, false if the caller should fall back to handle_char()
+*/
+uint8_t CmdBase::rx_bulk_json() {
+    static const uint8_t keys[] = {CLI_ASCII_ESC, CLI_ASCII_BS, CLI_ASCII_DEL};
+    uint8_t *start = _rx_buf + _rx_pos;
+    uint8_t *end = _rx_buf + _rx_end;
+    uint8_t *cr = (uint8_t *)memchr(start, CLI_ASCII_CR, end - start);
+    uint8_t *stop = cr ? cr : end;
+
+    /* Stop short of the first key handle_char() has to see, the line isn't complete before it */
+    for (uint8_t i = 0; i < sizeof(keys); i++) {
+        uint8_t *key = (uint8_t *)memchr(start, keys[i], stop - start);
+        if (key) {
+            stop = key;
+            cr = NULL;
+        }
+    }
+    if (stop == start && !cr) {return false;}
+
+    while (start < stop) {
+        /* CRLF terminals: the LF arrives at the start of the next message, drop it */
+        if (_cursor_ptr == msg && *start == CLI_ASCII_LF) {
+            start++;
+            continue;
+        }
+
+        /* No editing in this mode, so the edit gap always sits at the end of the line */
+        uint16_t room = (_msg_size - 1) - (_cursor_ptr - msg);
+        uint16_t len = (stop - start) < room ? (stop - start) : room;
+
+        memcpy(_cursor_ptr, start, len);
+        _cursor_ptr += len;
+        start += len;
+
+        if (start < stop) {command_too_long();}
+    }
+
+    /* Consume the CR (if found) before dispatching, in case the callback changes the mode */
+    _rx_pos = (stop - _rx_buf) + (cr ? 1 : 0);
+    if (cr) {return_key();}
+
+    return true;
+}
+
+/**
+ * @brief CLI_MODE_JSON_STREAM framing. Tracks brace / bracket depth, strings and escapes as each byte arrives (O(1)
+ *          per byte) and dispatches the message the moment its closing brace is seen, so back-to-back objects don't
+ *          need a CR between them.  Anything between messages (whitespace, CR/LF, stray bytes) is skipped, except
+ *          for ESC ESC, which requests an exit (see exit_cli()).
+*/
+void CmdBase::rx_json_stream() {
+    while (_rx_pos < _rx_end) {
+        char c = (char)_rx_buf[_rx_pos++];
+
+        /* Between messages: wait for the opening brace, ESC ESC requests an exit as in the other text modes */
+        if (_json_depth == 0) {
+            if (c == CLI_ASCII_ESC) {
+                if (_frame_flags & CLI_JSON_FRAME_ESC) {_exit_cli = true;}
+                _frame_flags ^= CLI_JSON_FRAME_ESC;
+                continue;
+            }
+            _frame_flags &= ~CLI_JSON_FRAME_ESC;
+            if (c != '{') {continue;}
+        }
+
+        /* Drop the message if it doesn't fit, but keep framing it up to its closing brace, so nothing in its tail
+           is taken for a new message */
+        if (!(_frame_flags & CLI_JSON_FRAME_DROP) && (_cursor_ptr - msg) == (_msg_size-1)) {
+            uint16_t depth = _json_depth;
+            uint8_t flags = _frame_flags;
+            command_too_long();
+            _json_depth = depth;
+            _frame_flags = flags | CLI_JSON_FRAME_DROP;
+        }
+        if (!(_frame_flags & CLI_JSON_FRAME_DROP)) {*_cursor_ptr++ = c;}
+
+        if (_frame_flags & CLI_JSON_FRAME_IN_STR) {
+            /* Inside a string only the (unescaped) closing quote matters */
+            if (_frame_flags & CLI_JSON_FRAME_ESCAPE) {
+                _frame_flags &= ~CLI_JSON_FRAME_ESCAPE;
+            } else if (c == '\\') {
+                _frame_flags |= CLI_JSON_FRAME_ESCAPE;
+            } else if (c == '"') {
+                _frame_flags &= ~CLI_JSON_FRAME_IN_STR;
+            }
+        } else if (c == '"') {
+            _frame_flags |= CLI_JSON_FRAME_IN_STR;
+        } else if (c == '{' || c == '[') {
+            _json_depth++;
+        } else if (c == '}' || c == ']') {
+            /* Closing the root object completes the message (or the one being dropped) */
+            if (--_json_depth == 0) {
+                if (_frame_flags & CLI_JSON_FRAME_DROP) {
+                    _frame_flags &= ~CLI_JSON_FRAME_DROP;
+                    continue;
+                }
+                return_key();
+
+                /* The callback may have switched modes - let handler() pick the right path for the rest */
+                if (_mode != CLI_MODE_JSON_STREAM) {
+                    handler();
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief CLI_MODE_BIN framing. Bytes up to the next 0x00 delimiter are copied into the msg buffer in bulk (memchr +
+ *          memcpy), and the frame is decoded and dispatched when the delimiter arrives.  A frame that doesn't fit
+ *          the buffer is dropped up to the next delimiter.
+*/
+void CmdBase::rx_bin() {
+    while (_rx_pos < _rx_end) {
+        uint8_t *start = _rx_buf + _rx_pos;
+        uint8_t *end = _rx_buf + _rx_end;
+        uint8_t *delim = (uint8_t *)memchr(start, CMD_BIN_DELIM, end - start);
+        uint8_t *stop = delim ? delim : end;
+        uint16_t len = stop - start;
+
+        if (!(_frame_flags & CLI_BIN_FRAME_DROP)) {
+            /* No editing in this mode, so the edit gap always sits at the end of the frame */
+            if (len > (uint16_t)(_msg_size - (_cursor_ptr - msg))) {
+                _frame_flags |= CLI_BIN_FRAME_DROP;
+            } else {
+                memcpy(_cursor_ptr, start, len);
+                _cursor_ptr += len;
+            }
+        }
+
+        /* Consume the delimiter (if found) before dispatching, in case the handler changes the mode */
+        _rx_pos = (stop - _rx_buf) + (delim ? 1 : 0);
+        if (!delim) {continue;}
+
+        if (!(_frame_flags & CLI_BIN_FRAME_DROP)) {
+            bin_frame();
+        } else {
+            #if CMD_STATS
+                _stats.lines_dropped++;
+            #endif
+        }
+        rst_msg_ptr();
+
+        /* Bounded poll: once the time budget is spent, stop right after this frame */
+        if (poll_expired()) {_rx_end = _rx_pos;}
+
+        /* The handler may have switched modes - let handler() pick the right path for the rest */
+        if (_mode != CLI_MODE_BIN) {
+            handler();
+            return;
+        }
+    }
+}
+
+/* bin_frame() - decode / check the frame in the command buffer and call its handler */
+void CmdBase::bin_frame() {
+    uint8_t id;
+    uint8_t *payload;
+    uint16_t payload_len;
+
+    /* Empty frames (back-to-back delimiters) are used to resynchronize, they aren't errors */
+    if (_cursor_ptr == msg) {return;}
+
+    /* Corrupted frames, and IDs nobody registered, are dropped silently - the sender times out and retries */
+    cmd_bin_func_t func = NULL;
+    if (cmd_bin_decode(msg, _cursor_ptr - msg, &id, &payload, &payload_len)) {func = _table->lookup_bin(id);}
+
+    if (func == NULL) {
+        #if CMD_STATS
+            _stats.bin_rejected++;
+        #endif
+        return;
+    }
+
+    _tx.flush();
+    func(payload, payload_len);
+}
+
+/**
+ * @brief Fast path for typing at the end of the line: a run of printable characters is appended to the msg buffer
+ *          with memcpy and echoed with a single write() instead of one print() per character.
+ * @retval true if any characters were consumed, false if the caller should fall back to handle_char()
+*/
+uint8_t CmdBase::rx_bulk_echo() {
+    uint8_t *start = _rx_buf + _rx_pos;
+    uint8_t *ptr = start;
+    uint8_t *end = _rx_buf + _rx_end;
+    uint16_t room = (_msg_size - 1) - line_len();
+
+    /* Only plain printable ASCII - control characters need handle_char() */
+    if ((uint16_t)(end - start) > room) {end = start + room;}
+    while (ptr < end && *ptr >= ' ' && *ptr < CLI_ASCII_DEL) {ptr++;}
+
+    uint16_t len = ptr - start;
+    if (!len) {return false;}
+
+    memcpy(_cursor_ptr, start, len);
+    _cursor_ptr += len;
+    _rx_pos += len;
+    line_edited();
+
+    if (_print) {
+        _tx.write(start, len);
+        #if CMD_STATS
+            _stats.bytes_echoed += len;
+        #endif
+    }
+
+    return true;
+}
+
+/* handle_char() - process a single character (editing keys, escape sequences, CR, ...) */
+void CmdBase::handle_char(char c)
+{
+    /* See if we're tracking an esc command code, or standart text character */
+    if (cmd_esc_active(&_esc)) {
+        handle_esc_cmd_char(c);
+    } else {
+        switch (c) {
+            case CLI_ASCII_ESC:
+                // escape
+                esc_key();
+                break;
+
+            case CLI_ASCII_LF:
+                // Do Nothing - only handle CR, ignore LF, but clear escape fl
+                break;
+
+            case CLI_ASCII_CR:
+                // enter
+                return_key();
                 break;
             
             case CLI_ASCII_BS:
@@ -392,6 +2180,13 @@ void Cmd::handler()
                 // delete (used by some terminals for the 'backspace' key)
                 backspace(CLI_ASCII_DEL);
                 break;
+
+            #if CMD_PREFIX_INDEX
+                case CLI_ASCII_TAB:
+                    // tab: complete the command name (only in the standard mode, elsewhere it's an ordinary character)
+                    if (_mode == CLI_MODE_STD) {tab_key();} else {standard_key(c);}
+                    break;
+            #endif
             
             default:
                 // normal key
@@ -402,7 +2197,7 @@ void Cmd::handler()
 }
 
 /* point to the appropriate stream, based on what the user has passed */
-void Cmd::set_stream() {
+void CmdBase::set_stream() {
     #ifdef SoftwareSerial_h
         /* point common Stream to either the HW or SW stream, depending on what was passed */
         _Cereal = !_hwStream ? (Stream*)_swStream : _hwStream;
@@ -412,24 +2207,75 @@ void Cmd::set_stream() {
 }
 
 /* initialization for pointers and buffers */
-void Cmd::init_buffers() {
-    /* init the command table */
-    cmd_tbl_list = NULL;
+void CmdBase::init_buffers(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args) {
+    /* command buffer + argv storage live in the CmdT instance */
+    msg = msg_buf;
+    _msg_size = msg_size;
+    _msg_end = msg_buf + msg_size;
+    _argv = argv_buf;
+    _max_args = max_args;
+
+    /* dispatch from our own command table until use_table() says otherwise */
+    _table = &_own_table;
+
+    /* Terminal output is coalesced before it reaches the stream */
+    _tx.begin(_Cereal);
+
+    /* Reset all message pointers */
+    rst_msg_ptr();
+
+    /* Nothing staged in the receive buffer yet */
+    _rx_pos = 0;
+    _rx_len = 0;
+    _rx_end = 0;
+
+    /* No time budget outside of poll(max_bytes, max_micros) */
+    _poll_start = 0;
+    _poll_micros = 0;
+
+    #if CMD_STATS
+        /* All counters start at 0 */
+        memset(&_stats, 0, sizeof(_stats));
+    #endif
+
+    #if CMD_KEY_BINDINGS
+        /* No user key bindings */
+        memset(_keys, 0, sizeof(_keys));
+    #endif
 
-    /* Reset all message pointers */
-    rst_msg_ptr();
+    /* Handlers run inline (the job queue / history / JSON state are attached separately, see attach_jobs() ...) */
+    _exec_mode = CMD_EXEC_INLINE;
+    #if CMD_WORKER_QUEUE_SIZE
+        _worker_head = 0;
+        _worker_tail = 0;
+        #if CMD_STATS
+            _worker_done = 0;
+        #endif
+        _worker_out.begin(&_worker_ring);
+    #endif
 }
 
 /* reset the message pointers */
-void Cmd::rst_msg_ptr() {
-    /* init the msg ptr to the start of the command buffer */
-    msg_ptr = msg;
+void CmdBase::rst_msg_ptr() {
+    /* empty line: the edit gap spans the whole command buffer */
+    _tail_ptr = _msg_end;
 
-    /* init the escape command ptr to the start of the escape command buffer */
-    _esc_cmd_ptr = _esc_cmd;
+    /* drop any partially received escape sequence */
+    cmd_esc_reset(&_esc);
 
     /* Set the cursor pointer to be at the starting position */
     _cursor_ptr = msg;
+
+    /* Any partially framed JSON message is dropped along with the buffer */
+    _json_depth = 0;
+    _frame_flags = 0;
+
+    #if CMD_HISTORY_DEPTH
+        /* Back to editing a new line */
+        _hist_browse = 0;
+        _hist_recalled = CMD_HIST_NONE;
+        _hist_cache_slot = CMD_HIST_NONE;
+    #endif
 }
 
 /**************************************************************************/
@@ -438,240 +2284,794 @@ void Cmd::rst_msg_ptr() {
     constantly to check if there is any available input at the command prompt.
 */
 /**************************************************************************/
-void Cmd::poll()
+void CmdBase::poll()
 {
-    while (_Cereal->available())
+    /* Let handlers know which instance (and stream) they are being called from */
+    CmdBase *prev_active = _active;
+    _active = this;
+
+    /* Pull the input in chunks (one readBytes() per chunk instead of one read() per byte) */
+    while (rx_fill())
     {
+        _rx_end = _rx_len;
         handler();
     }
+
+    /* Queued jobs get one turn per poll() */
+    jobs_run();
+
+    #if CMD_WORKER_QUEUE_SIZE
+        /* Write out what the worker printed since the last poll() */
+        worker_drain();
+    #endif
+
+    _active = prev_active;
 }
 
-/* prepare to look for escape commands */
-void Cmd::esc_key() {
-    // if the esc key is pressed twice in a row
-    if (_esc_cmd_ptr - _esc_cmd == 1) {_exit_cli = true;}
+/**************************************************************************/
+/*!
+    Bounded poll: same as poll(), but returns once max_bytes of input have
+    been processed or max_micros have elapsed (0 = no limit). The time
+    budget is checked between chunks and after every dispatched command, so
+    a call overruns it by at most one command handler. Anything left over
+    stays in the staging buffer (or the stream), along with the partially
+    typed line, and is picked up by the next call.
+*/
+/**************************************************************************/
+uint8_t CmdBase::poll(uint16_t max_bytes, uint32_t max_micros)
+{
+    CmdBase *prev_active = _active;
+    _active = this;
+
+    /* Save the caller's budget in case a handler polls this instance again */
+    uint32_t prev_start = _poll_start;
+    uint32_t prev_micros = _poll_micros;
+    _poll_start = micros();
+    _poll_micros = max_micros;
+
+    uint32_t bytes_left = max_bytes ? max_bytes : 0xFFFFFFFFUL;
+
+    while (bytes_left && !poll_expired() && rx_fill())
+    {
+        /* Only let handler() see as much of the staged chunk as the budget allows */
+        uint16_t start = _rx_pos;
+        uint16_t staged = _rx_len - _rx_pos;
+        _rx_end = _rx_pos + (staged < bytes_left ? staged : bytes_left);
+
+        handler();
+
+        uint16_t used = _rx_pos - start;
+        bytes_left = used < bytes_left ? bytes_left - used : 0;
+    }
+
+    /* Queued jobs get one turn per poll() */
+    jobs_run();
+
+    uint8_t more = (_rx_pos < _rx_len) || rx_waiting() || jobs_pending();
+
+    #if CMD_WORKER_QUEUE_SIZE
+        /* Write out what the worker printed, and keep the caller polling until the worker is idle */
+        worker_drain();
+        more = more || worker_pending() || cmd_ring_available(&_worker_ring);
+    #endif
+
+    _poll_start = prev_start;
+    _poll_micros = prev_micros;
+    _active = prev_active;
+
+    return more;
+}
+
+/* poll_expired() - true once the time budget of the current bounded poll is spent */
+uint8_t CmdBase::poll_expired() {
+    return _poll_micros && ((uint32_t)(micros() - _poll_start) >= _poll_micros);
+}
 
-    // Add to the escape command char
-    *_esc_cmd_ptr++ = CLI_ASCII_ESC;
+/* prepare to look for escape commands */
+void CmdBase::esc_key() {
+    // start decoding an escape sequence (a second ESC is handled by handle_esc_cmd_char())
+    cmd_esc_feed(&_esc, CLI_ASCII_ESC);
 }
 
 /* standard char was passed, add to the buffer and proceed as normal */
-void Cmd::standard_key(char c) {
+void CmdBase::standard_key(char c) {
     /**
      * Basic algorithm
-     *      Increment msg_ptr size since we have a new character
-     *      Add the character at the cursor pointer location and move the cursor pointer
+     *      Add the character at the start of the edit gap (the cursor) and move the cursor pointer - O(1), the tail
+     *      of the line lives at the end of the buffer and doesn't move
      *      IF cursor pointer is at the end of the line, just print character and move on
      *      ELSE need to "insert" the character at the terminal's cursor position:
-     *          1) Move all characters starting at the cursor pointer up by one byte
-     *          2) Add the new character at the cursor pointer
-     *          3) Clear the screen at the cursor and reprint all characters from the cursor to the end of the buffer
+     *          1) Reprint the new character + the tail of the line (the line only grew, so nothing needs clearing)
+     *          2) Move the terminal's cursor back to just after the new character
     */
 
     // verify we haven't reached the limit for msg length
-    if ((msg_ptr - msg) == (CMD_MAX_MSG_SIZE-1))
+    if (line_len() == (_msg_size-1))
     {   
-        // command is too long, need to terminate it
-        cli_println("");
-        cli_println(F("Error: command too long. Please reduce command size."));
+        command_too_long();
+        return;
+    }
 
-        // reset the pointers
-        rst_msg_ptr();
+    // insert the character into the edit gap
+    *_cursor_ptr++ = c;
+    line_edited();
+
+    // print the character (and anything after it)
+    cli_print(c);
+    #if CMD_STATS
+        if (_print) {_stats.bytes_echoed++;}
+    #endif
+    cursor_move(cursor_print(), 'D');
+}
+
+#if CMD_PREFIX_INDEX
+/**************************************************************************/
+/*!
+    Tab completion of the command name. The line is extended by the part
+    that all matching commands have in common (plus a space once only one
+    command is left); if that adds nothing, the candidates are listed and
+    the line is reprinted below them.
+*/
+/**************************************************************************/
+void CmdBase::tab_key() {
+    cmd_prefix_t range;
+    uint16_t len = _cursor_ptr - msg;
+
+    /* Only the command name is completed, with the cursor at its end */
+    if (_tail_ptr != _msg_end || memchr(msg, ' ', len)) {return;}
+
+    uint16_t count = _table->prefix_find((const char *)msg, len, &range);
+    if (count == 0) {return;}
+
+    /* Longest common prefix of the matches, compared against the first one */
+    uint8_t first_flash, name_flash;
+    const char *first = _table->prefix_name(&range, 0, &first_flash);
+    uint16_t common = len;
+    while (cmd_name_char(first, first_flash, common)) {common++;}
+
+    for (uint16_t i = 1; i < count; i++) {
+        const char *name = _table->prefix_name(&range, i, &name_flash);
+        uint16_t n = len;
+        while (n < common && cmd_name_char(name, name_flash, n) == cmd_name_char(first, first_flash, n)) {n++;}
+        common = n;
+    }
+
+    if (common > len || count == 1) {
+        /* Typed in as if by the user, so the echo and the line limit are handled as usual */
+        for (uint16_t i = len; i < common && line_len() < (_msg_size-1); i++) {
+            standard_key((char)cmd_name_char(first, first_flash, i));
+        }
+        if (count == 1 && line_len() < (_msg_size-1)) {standard_key(' ');}
         return;
     }
 
-    // see if the cursor is at the end of the message, or in the middle somewhere
-    if (_cursor_ptr == msg_ptr) {
-        // normal character entered at the end of the buffer
-        *_cursor_ptr++ = c;
-        msg_ptr++;
+    /* Ambiguous: list the candidates, then reprint the prompt and the line */
+    if (!_print) {return;}
+    cli_println("");
+    for (uint16_t i = 0; i < count; i++) {
+        const char *name = _table->prefix_name(&range, i, &name_flash);
+        cmd_print_str(&_tx, name, name_flash);
+        cli_print(F("  "));
+    }
+    display_prompt();
+    _tx.write(msg, len);
+}
+#endif
 
-        // print the character and move on
-        cli_print(c);
-    } else {
-        /* move chars from n to n-1 before inserting the new char */
-        for (uint8_t *chr_buf = msg_ptr; chr_buf > _cursor_ptr; chr_buf--) {*chr_buf = *(chr_buf - 1);}
+/**************************************************************************/
+/*!
+    Run a script of command lines from RAM (see script_run())
+*/
+/**************************************************************************/
+uint8_t CmdBase::run_script(const char *script, cmd_script_result_t *result, uint8_t flags)
+{
+    return script_run(script, false, result, flags);
+}
+
+/**************************************************************************/
+/*!
+    Run a script of command lines from flash (see script_run())
+*/
+/**************************************************************************/
+uint8_t CmdBase::run_script_P(const char *script, cmd_script_result_t *result, uint8_t flags)
+{
+    return script_run(script, true, result, flags);
+}
 
-        /* insert the new character at the cursor pointer and increment the buffer pointer size, since we've added a character */
-        *_cursor_ptr = c;
-        msg_ptr++;
+/**************************************************************************/
+/*!
+    script_run() - copy one line at a time into a small line buffer and
+    hand it to parse_std(), with printback off so the terminal only sees
+    what the handlers print.  The edit buffer isn't touched, so a line the
+    user is typing survives the script.
+*/
+/**************************************************************************/
+uint8_t CmdBase::script_run(const char *script, uint8_t flash, cmd_script_result_t *result, uint8_t flags)
+{
+    cmd_script_result_t summary = {0, 0, 0, 0};
+    char line[CMD_SCRIPT_LINE_SIZE];
+    uint16_t line_no = 0;
+    char c = 1;
+
+    // handlers may call Cmd::stream(), and anything we buffered goes out first
+    CmdBase *prev_active = _active;
+    _active = this;
+    _tx.flush();
+
+    uint8_t prev_print = _print;
+    _print = false;
+
+    #if CMD_HISTORY_DEPTH
+        // script lines don't come from the history, so there is no cache slot to fill in
+        uint8_t prev_cache_slot = _hist_cache_slot;
+        _hist_cache_slot = CMD_HIST_NONE;
+    #endif
 
-        /* print the characters back to the terminal that are left in the buffer */
-        uint16_t chars_printed = cursor_print();
+    uint32_t start = micros();
+    while (c) {
+        uint16_t len = 0;
+        uint8_t too_long = false;
+        line_no++;
+
+        // one line, up to the next LF (CRs are dropped) or the end of the script
+        while ((c = flash ? (char)pgm_read_byte(script) : *script) != '\0') {
+            script++;
+            if (c == '\n') {break;}
+            if (c == '\r') {continue;}
+            if (len < CMD_SCRIPT_LINE_SIZE - 1) {
+                line[len++] = c;
+            } else {
+                too_long = true;
+            }
+        }
+        line[len] = '\0';
+
+        // blank lines and comments
+        char *cmd = line;
+        while (*cmd == ' ' || *cmd == '\t') {cmd++;}
+        if (*cmd == '\0' || *cmd == '#') {continue;}
+
+        summary.lines++;
+        _cmd_failed = too_long;
+        if (too_long) {
+            #if CMD_STATS
+                _stats.lines_dropped++;
+            #endif
+        } else {
+            parse_std(cmd);
+        }
 
-        /* Move the terminal's cursor back to the desired position, which is one less than the characters printed (since we also printed the new char) */
-        for (uint8_t i = 0; i < (chars_printed - 1); i++) {cli_print(ESC_CMD_LEFT);}
+        if (_cmd_failed) {
+            summary.errors++;
+            if (!summary.error_line) {summary.error_line = line_no;}
+            if (flags & CMD_SCRIPT_STOP_ON_ERROR) {break;}
+        }
+    }
+    summary.micros = micros() - start;
 
-        /* now move the buffer pointers to be ready for new characters */
-        _cursor_ptr++;
+    #if CMD_HISTORY_DEPTH
+        _hist_cache_slot = prev_cache_slot;
+    #endif
+    _print = prev_print;
+    _cmd_failed = false;
+
+    if (flags & CMD_SCRIPT_SUMMARY) {
+        cli_print_P(cmd_script_done);
+        cli_print(summary.lines);
+        cli_print(F(" lines, "));
+        cli_print(summary.errors);
+        cli_print(F(" errors"));
+        if (summary.error_line) {
+            cli_print(F(" (first at line "));
+            cli_print(summary.error_line);
+            cli_print(')');
+        }
+        cli_println("");
     }
+    _tx.flush();
+    _active = prev_active;
+
+    if (result) {*result = summary;}
+    return summary.errors == 0;
+}
+
+/* command_too_long() - drop the current line when it doesn't fit in the msg buffer */
+void CmdBase::command_too_long() {
+    #if CMD_STATS
+        _stats.lines_dropped++;
+    #endif
+
+    // command is too long, need to terminate it
+    cli_println("");
+    cli_println(F("Error: command too long. Please reduce command size."));
+
+    // reset the pointers
+    rst_msg_ptr();
 }
 
-/* currently handling ESC commands, so add char to the esc command buffer */
-void Cmd::handle_esc_cmd_char(char c) {
+/* currently handling ESC commands, so feed the char to the escape sequence decoder */
+void CmdBase::handle_esc_cmd_char(char c) {
+    uint8_t key = cmd_esc_feed(&_esc, (uint8_t)c);
+
+    /* Still inside the sequence */
+    if (key == CMD_ESC_MORE) {return;}
+
     /* Check for unique scenario of back-to-back esc keys */
-    if (c == CLI_ASCII_ESC) {
-        esc_key();
+    if (key == CMD_ESC_DOUBLE) {
+        _exit_cli = true;
         return;
     }
 
-    /* Add to the escape command buffer */
-    *_esc_cmd_ptr++ = c;
-
-    /* See if we've collected the entire command */
-    if ((_esc_cmd_ptr - _esc_cmd) >= ESC_CMD_SIZE) {
-        /* If the 3rd digit is numerical, we need to keep receiving a 4th character */
-        if (!_ext_esc_cmd && isdigit(c)) {
-            _ext_esc_cmd = true;
-            return;
-        } else {
-            /* Null terminate the buffer to create a string */
-            *_esc_cmd_ptr = '\0';
+    key_press(key);
+}
 
-            /* Check for a valid escape command */
-            check_esc_cmd();
+/* key_press() - run the user binding or the default editor action of a decoded key */
+void CmdBase::key_press(uint8_t key) {
+    /* Unknown sequences were consumed whole, nothing else to do */
+    if (key == CMD_KEY_NONE) {return;}
 
-            /* Reset the escape commant pointer */
-            _esc_cmd_ptr = _esc_cmd;
+    #if CMD_KEY_BINDINGS
+        for (uint8_t i = 0; i < CMD_KEY_BINDINGS; i++) {
+            if (_keys[i].key != key) {continue;}
 
-            /* Ensure the extended command flag is cleared */
-            _ext_esc_cmd = false;
+            if (_keys[i].func) {
+                _keys[i].func(key);
+            } else {
+                edit_action(_keys[i].action);
+            }
+            return;
         }
-    }
+    #endif
+
+    edit_action(cmd_key_action(key));
 }
 
-/* Check for valid escape commands */
-void Cmd::check_esc_cmd() {
-    if (strlen((char *)_esc_cmd) == ESC_CMD_SIZE) {
-        /* checking against 3 char CMD */
-        if (!strcmp((char*)_esc_cmd, ESC_CMD_UP)) {
-            esc_cmd_up();
-        } else if (!strcmp((char*)_esc_cmd, ESC_CMD_LEFT)) {
+/* edit_action() - perform an editor action (CMD_ACT_x) on the line being edited */
+void CmdBase::edit_action(uint8_t action) {
+    uint8_t *ptr;
+
+    switch (action) {
+        case CMD_ACT_LEFT:
             esc_cmd_left();
-        } else if (!strcmp((char*)_esc_cmd, ESC_CMD_RIGHT)) {
+            break;
+
+        case CMD_ACT_RIGHT:
             esc_cmd_right();
-        } else {
-            /* Uncomment this block to help with debugging
-                cli_print("[Invalid escape command received: ");
-                for (uint8_t i = 0; i < ESC_CMD_SIZE; i++) {
-                    cli_print("0x" + String(_esc_cmd[i], HEX) + " ");
-                }
-                cli_print("]");
-            */
-        }
-    } else {
-        /* checking against 4 char CMD */
-        if (!strcmp((char*)_esc_cmd, ESC_CMD_DEL)) {
+            break;
+
+        case CMD_ACT_HIST_PREV:
+            esc_cmd_up();
+            break;
+
+        case CMD_ACT_HIST_NEXT:
+            esc_cmd_down();
+            break;
+
+        case CMD_ACT_HOME:
+            gap_left(_cursor_ptr - msg);
+            break;
+
+        case CMD_ACT_END:
+            gap_right(_msg_end - _tail_ptr);
+            break;
+
+        case CMD_ACT_DELETE:
             esc_cmd_del();
-        } else {
-            /* Uncomment this block to help with debugging
-                cli_print("[Invalid escape command received: ");
-                for (uint8_t i = 0; i < ESC_EXT_CMD_SIZE; i++) {
-                    cli_print("0x" + String(_esc_cmd[i], HEX) + " ");
-                }
-                cli_print("]");
-            */
-        }
+            break;
+
+        case CMD_ACT_WORD_LEFT:
+            // back over any spaces, then to the start of the word before them
+            ptr = _cursor_ptr;
+            while (ptr > msg && ptr[-1] == ' ') {ptr--;}
+            while (ptr > msg && ptr[-1] != ' ') {ptr--;}
+            gap_left(_cursor_ptr - ptr);
+            break;
+
+        case CMD_ACT_WORD_RIGHT:
+            // over any spaces, then past the end of the word after them
+            ptr = _tail_ptr;
+            while (ptr < _msg_end && *ptr == ' ') {ptr++;}
+            while (ptr < _msg_end && *ptr != ' ') {ptr++;}
+            gap_right(ptr - _tail_ptr);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* gap_left() - move the cursor n characters left: the characters move across the edit gap, the terminal's cursor follows */
+void CmdBase::gap_left(uint16_t n) {
+    if (!n) {return;}
+
+    _cursor_ptr -= n;
+    _tail_ptr -= n;
+    memmove(_tail_ptr, _cursor_ptr, n);
+    cursor_move(n, 'D');
+}
+
+/* gap_right() - move the cursor n characters right */
+void CmdBase::gap_right(uint16_t n) {
+    if (!n) {return;}
+
+    memmove(_cursor_ptr, _tail_ptr, n);
+    _cursor_ptr += n;
+    _tail_ptr += n;
+    cursor_move(n, 'C');
+}
+
+#if CMD_KEY_BINDINGS
+/* key_bind_slot() - binding slot for a key (existing or free), NULL if none is left */
+cmd_key_binding_t *CmdBase::key_bind_slot(uint8_t key) {
+    cmd_key_binding_t *free_slot = NULL;
+
+    for (uint8_t i = 0; i < CMD_KEY_BINDINGS; i++) {
+        if (_keys[i].key == key) {return &_keys[i];}
+        if (_keys[i].key == CMD_KEY_NONE && free_slot == NULL) {free_slot = &_keys[i];}
     }
+    return free_slot;
+}
+
+/* bind_key() - bind a key to an editor action, overriding its default */
+uint8_t CmdBase::bind_key(uint8_t key, uint8_t action) {
+    cmd_key_binding_t *slot = key_bind_slot(key);
+    if (key == CMD_KEY_NONE || slot == NULL) {return false;}
+
+    slot->key = key;
+    slot->action = action;
+    slot->func = NULL;
+    return true;
 }
 
+/* attach_key_callback() - call func(key) when the key is pressed, instead of an editor action */
+uint8_t CmdBase::attach_key_callback(uint8_t key, cmd_key_func_t func) {
+    cmd_key_binding_t *slot = key_bind_slot(key);
+    if (key == CMD_KEY_NONE || slot == NULL) {return false;}
+
+    slot->key = key;
+    slot->action = CMD_ACT_NONE;
+    slot->func = func;
+    return true;
+}
+#endif
+
 /* Escape Command Left Received */
-void Cmd::esc_cmd_left() {
+void CmdBase::esc_cmd_left() {
     /* If the cursor isn't already at the beginning, move it left */
-    if (_cursor_ptr - msg) {
+    if (_cursor_ptr > msg) {
         /* Move the cursor left */
         cli_print(ESC_CMD_LEFT);
 
-        /* Move the curosr pointer correspondingly */
-        _cursor_ptr--;
+        /* Move the character before the cursor across the edit gap */
+        *--_tail_ptr = *--_cursor_ptr;
     }
 }
 
 /* Escape Command Right Received */
-void Cmd::esc_cmd_right() {
+void CmdBase::esc_cmd_right() {
     /* If the cursor isn't already at the end, move it right */
-    if (msg_ptr - _cursor_ptr) {
-        /* Move the cursor left */
+    if (_tail_ptr < _msg_end) {
+        /* Move the cursor right */
         cli_print(ESC_CMD_RIGHT);
 
-        /* Move the curosr pointer correspondingly */
-        _cursor_ptr++;
+        /* Move the character after the cursor across the edit gap */
+        *_cursor_ptr++ = *_tail_ptr++;
     }
 }
 
 /* Escape Command Up Received */
-void Cmd::esc_cmd_up() {
+void CmdBase::esc_cmd_up() {
+    #if CMD_HISTORY_DEPTH
+        /* Step back to the next older entry (if there is one) */
+        if (_hist && _hist_browse < _hist->count) {
+            _hist_browse++;
+            hist_recall((_hist->head + _hist->depth - _hist_browse) % _hist->depth);
+        }
+    #endif
+}
+
+/* Escape Command Down Received */
+void CmdBase::esc_cmd_down() {
+    #if CMD_HISTORY_DEPTH
+        /* Step forward to the next newer entry, or back to an empty line past the newest one */
+        if (_hist_browse > 0) {
+            _hist_browse--;
+            hist_recall(_hist_browse ? (_hist->head + _hist->depth - _hist_browse) % _hist->depth : CMD_HIST_NONE);
+        }
+    #endif
+}
+
+/* line_edited() - the line no longer matches the history entry it was recalled from */
+void CmdBase::line_edited() {
+    #if CMD_HISTORY_DEPTH
+        _hist_recalled = CMD_HIST_NONE;
+    #endif
+}
+
+#if CMD_HISTORY_DEPTH
+/* hist_push() - remember the line about to be executed (consecutive duplicates are stored once) */
+void CmdBase::hist_push(const char *line, uint16_t len) {
+    _hist_cache_slot = CMD_HIST_NONE;
+
+    /* Lines that don't fit a history entry aren't remembered (nor anything without a history ring) */
+    if (_hist == NULL || len >= CMD_HISTORY_LINE_SIZE) {return;}
+
+    /* Same as the newest entry - keep it (and its cached parse result) */
+    if (_hist->count) {
+        uint8_t newest = (_hist->head + _hist->depth - 1) % _hist->depth;
+        if (!strcmp(_hist->slots[newest].line, line)) {
+            _hist_cache_slot = newest;
+            return;
+        }
+    }
+
+    /* Overwrite the oldest entry */
+    memcpy(_hist->slots[_hist->head].line, line, len + 1);
+    _hist->slots[_hist->head].argc = 0;
+    _hist_cache_slot = _hist->head;
+
+    _hist->head = (_hist->head + 1) % _hist->depth;
+    if (_hist->count < _hist->depth) {_hist->count++;}
+}
+
+/* hist_recall() - replace the line being edited with a history entry (or an empty line) */
+void CmdBase::hist_recall(uint8_t slot) {
+    /* Move the terminal's cursor back to the start of the line */
+    cursor_move(_cursor_ptr - msg, 'D');
+
+    /* Empty the gap buffer (without touching the browse position) */
+    _cursor_ptr = msg;
+    _tail_ptr = _msg_end;
+
+    if (slot != CMD_HIST_NONE) {
+        uint16_t len = strlen(_hist->slots[slot].line);
+        memcpy(msg, _hist->slots[slot].line, len);
+        _cursor_ptr += len;
+        if (_print) {_tx.write(msg, len);}
+    }
+
+    /* Clear whatever was left of the previous line */
+    cli_print(ESC_CMD_CLR_LINE_RIGHT);
+
+    _hist_recalled = slot;
+}
+
+/* hist_exec() - re-run an unchanged recalled line from its cached parse result */
+uint8_t CmdBase::hist_exec() {
+    /* the cached line was parsed into at most _max_args tokens, so it fits the argv storage */
+    char **argv = _argv;
+
+    if (_hist_recalled == CMD_HIST_NONE) {return false;}
+
+    /* Only if the parse result is cached, and the command tables haven't changed since */
+    cmd_hist_t entry = _hist->slots[_hist_recalled];
+    if (!entry.argc || entry.gen != _table->gen()) {return false;}
+
+    /* Split the line in place at the cached token boundaries (same result as the strtok() pass in parse_std()) */
+    for (char *ptr = (char *)msg; *ptr; ptr++) {
+        if (*ptr == ' ') {*ptr = '\0';}
+    }
+    for (uint8_t i = 0; i < entry.argc; i++) {argv[i] = (char *)msg + entry.tok[i];}
+    argv[entry.argc] = NULL;
+
+    /* Re-running an older entry makes it the newest */
+    uint8_t newest = (_hist->head + _hist->depth - 1) % _hist->depth;
+    if (_hist_recalled != newest) {
+        _hist->slots[_hist->head] = entry;
+        _hist->head = (_hist->head + 1) % _hist->depth;
+        if (_hist->count < _hist->depth) {_hist->count++;}
+    }
+
+    #if CMD_STATS
+        dispatch(entry.argc, argv, entry.func, entry.task, entry.entry);
+    #else
+        dispatch(entry.argc, argv, entry.func, entry.task, NULL);
+    #endif
 
+    return true;
 }
 
+/* hist_cache() - store the parse result of the line just executed in its history entry */
+void CmdBase::hist_cache(uint8_t argc, char **argv, cmd_func_t func, cmd_task_t task, cmd_t *cmd_entry) {
+    if (_hist_cache_slot == CMD_HIST_NONE || argc > CMD_HISTORY_MAX_ARGS) {return;}
+
+    cmd_hist_t *entry = &_hist->slots[_hist_cache_slot];
+    for (uint8_t i = 0; i < argc; i++) {entry->tok[i] = argv[i] - (char *)msg;}
+    entry->argc = argc;
+    entry->gen = _table->gen();
+    entry->func = func;
+    entry->task = task;
+    #if CMD_STATS
+        entry->entry = cmd_entry;
+    #endif
+}
+#endif
+
 /**
  * @brief Re-print characters from the cursor pointer to the end of the msg buffer
  * @retval Returns the qty of characters printed
 */
-uint16_t Cmd::cursor_print() {
-    /* Clear the terminal to the right of the cursor */
-    cli_print(ESC_CMD_CLR_LINE_RIGHT);
-
-    /* Print the characters from the cursor to the end */
-    uint16_t chars_printed = 0;
-    for (uint8_t *ptr = _cursor_ptr; ptr < msg_ptr; ptr++) {
-        cli_print((char)*ptr);
-        chars_printed++;
-    }
+uint16_t CmdBase::cursor_print() {
+    /* The characters after the cursor are contiguous (end of the gap buffer), so print them in one block */
+    uint16_t chars_printed = _msg_end - _tail_ptr;
+    if (_print) {_tx.write(_tail_ptr, chars_printed);}
     return chars_printed;
 }
 
+/* Move the terminal's cursor left ('D') / right ('C') by n columns (one parameterized sequence instead of n) */
+void CmdBase::cursor_move(uint16_t n, char dir) {
+    if (!n || !_print) {return;}
+
+    /* \e[D is shorter than \e[1D */
+    _tx.write((const uint8_t *)"\e[", 2);
+    if (n > 1) {_tx.print(n);}
+    _tx.write((uint8_t)dir);
+}
+
 /* Escape Command DEL (delete key) Received */
-void Cmd::esc_cmd_del() {
+void CmdBase::esc_cmd_del() {
     /**
      * Basic algorithm for delete key:
-     *  1) Downshift the contents of the buffer between the cursor position and the end of the msg buffer (overwriting the character at the cursors position)
-     *  2) Clear the terminal to the right of the cursor, and reprint the new characters from the cursor pointer to the end of the msg buffer
+     *  1) Grow the edit gap by one at the tail end (dropping the character under the cursor) - O(1)
+     *  2) Reprint the characters from the cursor to the end of the line, plus a space over the old last character
      *  3) Return the terminal's cursor back to the original position it was in step 1
     */
 
+    /* Nothing to delete when the cursor is already at the end of the line */
+    if (_tail_ptr == _msg_end) {return;}
 
+    _tail_ptr++;
+    line_edited();
+    tail_redraw();
+}
 
-    /**
-     * For buffer contents chr_buf[i,i+1,...,n-1,n] do the following:
-     *  1) move char from i+1 to i
-     *  2) print the moved char back to the terminal
-     *  3) loop (incrementing i) until n-1
-     * 
-     * Reminder: msg_ptr is always pointed to the "last valid char" + 1
-    */
-    
-    /* move chars from i+1 to i */
-    for (uint8_t *chr_buf = _cursor_ptr; chr_buf < msg_ptr; chr_buf++) {*chr_buf = *(chr_buf + 1);}
-
-    /* move the msg_ptr down if we actually deleted something */
-    if (_cursor_ptr < msg_ptr) {msg_ptr--;}
-
-    /* print the characters back to the terminal that are left in the buffer */
+/* Redraw the line after a character was removed at the cursor */
+void CmdBase::tail_redraw() {
+    /* print the characters back to the terminal that are left in the buffer, then blank the (now unused) last column */
     uint16_t chars_printed = cursor_print();
+    cli_print(' ');
 
     /* Move the terminal's cursor back to the desired position (since printing above moved it to the end of the line) */
-    for (uint8_t i = 0; i < chars_printed; i++) {cli_print(ESC_CMD_LEFT);}
+    cursor_move(chars_printed + 1, 'D');
 }
 
 /* Backspace character */
-void Cmd::backspace(char _bs_char/*=CLI_ASCII_DEL*/) {
+void CmdBase::backspace(char _bs_char/*=CLI_ASCII_DEL*/) {
     /**
      * Basic algorithm:
      *      IF cursor is at the begining of the terminal, do nothing
-     *      IF cursor is at the end, simply move the pointers down by one and print BS to the terminal
-     *      ELSE we need to move the cursor down one spot, then just call the DEL function
+     *      Grow the edit gap by one at the cursor end (dropping the character before the cursor) - O(1)
+     *      IF cursor is at the end, simply print BS to the terminal
+     *      ELSE move the terminal's cursor left and redraw the rest of the line
     */
     if (_cursor_ptr > msg) {
-        if (_cursor_ptr == msg_ptr) {
-            msg_ptr--;
-            _cursor_ptr--;
+        _cursor_ptr--;
+        line_edited();
+
+        if (_tail_ptr == _msg_end) {
             cli_print(_bs_char);
         } else {
-            /* Move cursor down one spot and call the DEL function */
-            _cursor_ptr--;
             cli_print(ESC_CMD_LEFT);
-            esc_cmd_del();
+            tail_redraw();
         }
     }
 }
+
+/* Length of the line being edited (characters before + after the edit gap) */
+uint16_t CmdBase::line_len() {
+    return (_cursor_ptr - msg) + (_msg_end - _tail_ptr);
+}
+
+/* Close the edit gap, leaving the line contiguous and NULL terminated at the start of msg */
+uint16_t CmdBase::line_close() {
+    uint16_t tail_len = _msg_end - _tail_ptr;
+
+    /* line_len() is at most _msg_size - 1, so there is always room for the terminator */
+    memmove(_cursor_ptr, _tail_ptr, tail_len);
+    _cursor_ptr += tail_len;
+    _tail_ptr = _msg_end;
+    *_cursor_ptr = '\0';
+
+    return _cursor_ptr - msg;
+}
+
+/**************************************************************************/
+/*!
+    CmdMux constructor - byte_budget is the number of input bytes each port
+    may process per turn.
+*/
+/**************************************************************************/
+CmdMux::CmdMux(uint16_t byte_budget) {
+    _port_count = 0;
+    _next = 0;
+    _byte_budget = byte_budget ? byte_budget : 1;
+}
+
+/* attach() - add a port to the multiplexer, switching it to the shared command table */
+uint8_t CmdMux::attach(CmdBase *port) {
+    if (_port_count >= CMD_MUX_MAX_PORTS) {return false;}
+
+    port->use_table(&_table);
+    _ports[_port_count++] = port;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Poll every attached port once. Each port may process up to the byte
+    budget, and the port that goes first rotates on every call, so a port
+    receiving a flood of input can't starve the others.
+*/
+/**************************************************************************/
+uint8_t CmdMux::poll() {
+    uint8_t pending = false;
+
+    for (uint8_t i = 0; i < _port_count; i++) {
+        uint8_t idx = (_next + i) % _port_count;
+        if (_ports[idx]->poll(_byte_budget)) {pending = true;}
+    }
+
+    if (_port_count) {_next = (_next + 1) % _port_count;}
+
+    return pending;
+}
+
+/* add() - add a command to the shared command table */
+void CmdMux::add(const char *name, void (*func)(int argc, char **argv)) {
+    _table.add(name, func);
+}
+
+/* add_bin() - add (or replace) a binary command in the shared command table */
+void CmdMux::add_bin(uint8_t id, cmd_bin_func_t func) {
+    _table.add_bin(id, func);
+}
+
+/* add() - add a command with a typed argument schema to the shared command table */
+uint8_t CmdMux::add(const char *name, const char *schema, cmd_typed_func_t func) {
+    return _table.add(name, schema, func);
+}
+
+/* add_task() - add a task command to the shared command table */
+void CmdMux::add_task(const char *name, cmd_task_t task) {
+    _table.add_task(name, task);
+}
+
+/* add_P() - add a command whose name stays in flash to the shared command table */
+void CmdMux::add_P(const char *name, void (*func)(int argc, char **argv)) {
+    _table.add_P(name, func);
+}
+
+/* add_P() - add a typed command whose name stays in flash to the shared command table */
+uint8_t CmdMux::add_P(const char *name, const char *schema, cmd_typed_func_t func) {
+    return _table.add_P(name, schema, func);
+}
+
+/* add_task_P() - add a task command whose name stays in flash to the shared command table */
+void CmdMux::add_task_P(const char *name, cmd_task_t task) {
+    _table.add_task_P(name, task);
+}
+
+/* remove() - remove a command from the shared command table */
+uint8_t CmdMux::remove(const char *name) {
+    return _table.remove(name);
+}
+
+/* replace() - replace the callback of a command in the shared command table, or add it */
+uint8_t CmdMux::replace(const char *name, void (*func)(int argc, char **argv)) {
+    return _table.replace(name, func);
+}
+
+/* freeze() - build a hashed index over the shared command table */
+uint8_t CmdMux::freeze() {
+    return _table.freeze();
+}
+
+/* add_table() - attach a flash-resident command table to the shared command table */
+void CmdMux::add_table(const cmd_static_t *tbl, uint16_t count) {
+    _table.add_table(tbl, count);
+}
+
+/* table() - the shared command table */
+CmdTable *CmdMux::table() {
+    return &_table;
+}
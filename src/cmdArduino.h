@@ -45,22 +45,34 @@
     #include <stdint.h>
     #include <Arduino.h>
     #include <HardwareSerial.h>
+    #include "cmdJson.h"
+    #include "cmdBin.h"
+    #include "cmdArgs.h"
+    #include "cmdKeys.h"
+    #include "cmdJsonWriter.h"
+    #include "cmdRing.h"
 
 
     /* Global Strings to be stored in flash to save RAM */
     const char cmd_banner[] PROGMEM = "*************** CMD *******************";    // Command Prompt Strings (stored in flash to save RAM)
     const char cmd_prompt[] PROGMEM = "CMD >> ";                                    // Command Prompt Strings (stored in flash to save RAM)
     const char cmd_unrecog[] PROGMEM = "CMD: Command not recognized.";              // Command Prompt Strings (stored in flash to save RAM)
-    #define CMD_BUF_SIZE 50     // Set this number greater than or equal to the largest string length above (used for strcpy)
+    const char cmd_job_full[] PROGMEM = "CMD: Can't queue command.";                // Command Prompt Strings (stored in flash to save RAM)
+    const char cmd_badarg[] PROGMEM = "CMD: Invalid argument ";                     // Command Prompt Strings (stored in flash to save RAM)
+    const char cmd_usage[] PROGMEM = "CMD: Usage: ";                                // Command Prompt Strings (stored in flash to save RAM)
+    const char cmd_subcmds[] PROGMEM = "CMD: Subcommands:";                         // Command Prompt Strings (stored in flash to save RAM)
+    const char cmd_script_done[] PROGMEM = "CMD: Script: ";                         // Command Prompt Strings (stored in flash to save RAM)
+    #define CMD_BUF_SIZE 50     // No longer used by the library (strings above are printed straight from flash); kept for sketches that reference it
 
     /* Common Definitions for use with this module */
     #ifndef CMD_MAX_MSG_SIZE
-        #define CMD_MAX_MSG_SIZE    1024                                            //Maximum command line input supported (in bytes).
+        #define CMD_MAX_MSG_SIZE    1024                                            //Maximum command line input supported (in bytes) by Cmd.
                                                                                     //If larger input is desired, user can #define CMD_MAX_MSG_SIZE prior to including this library
+                                                                                    //(or declare the instance as CmdT<size, args> to size each instance separately)
     #endif
 
     #ifndef CMD_MAX_ARGS
-        #define CMD_MAX_ARGS 128    // Maximum number of command line arguments that can be parsed
+        #define CMD_MAX_ARGS 128    // Maximum number of command line arguments that can be parsed by Cmd (at most 255)
                                     //If larger input is desired, user can #define CMD_MAX_ARGS prior to including this library
     #endif
 
@@ -69,13 +81,14 @@
     #define CLI_ASCII_BS '\b'       // ASCII Backspace
     #define CLI_ASCII_DEL 0x7F      // ASCII DEL (sometimes used by terminals when pressing backpsace)
     #define CLI_ASCII_ESC '\e'      // ASCII ESC
+    #define CLI_ASCII_TAB '\t'      // ASCII Horizontal Tab (command name completion)
 
-    #define ESC_CMD_SIZE 3                      // Length of escape commands to track (including the \e character).  Currently, only support arrow keys: [A, [C, [D
+    /* Escape sequences are decoded by the state machine in cmdKeys.h, these are the ones printed to the terminal */
     #define ESC_CMD_UP              "\e[A"      // Arrow up (recall last command)
+    #define ESC_CMD_DOWN            "\e[B"      // Arrow down (recall next command)
     #define ESC_CMD_RIGHT           "\e[C"      // Moves the cursor to the right
     #define ESC_CMD_LEFT            "\e[D"      // Moves the cursor to the left
 
-    #define ESC_EXT_CMD_SIZE 4                  // Length of escape commands to track when a number is detected in the 3rd position
     #define ESC_CMD_CLR_LINE_FULL   "\e[2K"     // clears the entire line
     #define ESC_CMD_DEL             "\e[3~"     // command sent by putty when the DEL key is pressed
     #define ESC_CMD_CLR_LINE_RIGHT  "\e[0K"     // clears to the end of the line (starting at cursors position)
@@ -83,48 +96,882 @@
     #define CLI_MODE_STD 0                      // standard / manual input (commands / args parsed by spaces).  Terminal printback is on.
     #define CLI_MODE_JSON 1                     // JSON / programmatic input (command sequence is parsed as a JSON string with keys, all text must be between {} ).  Terminal printback is off.
     #define CLI_MODE_JSON_MAN 2                 // JSON / manual input (command sequence is parsed as a JSON string with keys, all text must be between {} ).  Terminal printback is on.
+    #define CLI_MODE_JSON_STREAM 3              // JSON / streamed input (each message is framed by its braces and dispatched as soon as the closing brace arrives, no CR needed).  Terminal printback is off.  ESC ESC between messages requests an exit.
+    #define CLI_MODE_BIN 4                      // binary / programmatic input (COBS framed: command ID + payload + CRC16, see cmdBin.h).  Terminal printback is off.
+
+    #define CLI_JSON_FRAME_IN_STR 0x01          // JSON stream framing: currently inside a string
+    #define CLI_JSON_FRAME_ESCAPE 0x02          // JSON stream framing: previous character was a backslash inside a string
+    #define CLI_BIN_FRAME_DROP 0x04             // binary framing: the current frame didn't fit the command buffer, drop it up to the next delimiter
+    #define CLI_JSON_FRAME_ESC 0x08             // JSON stream framing: the previous byte between messages was ESC (a second one requests an exit)
+    #define CLI_JSON_FRAME_DROP 0x10            // JSON stream framing: the current message didn't fit the command buffer, drop it up to its closing brace
+
+    #ifndef CMD_JSON_MAX_TOKENS
+        #define CMD_JSON_MAX_TOKENS 32      // Default number of JSON tokens (keys + values + objects/arrays) per message held by CmdJsonState<>
+                                            //If larger messages are desired, user can #define CMD_JSON_MAX_TOKENS prior to including this library
+    #endif
+
+    #ifndef CMD_JSON_ID_SIZE
+        #define CMD_JSON_ID_SIZE 16         // Longest "id" of a JSON request, as written in the message (quotes included) + the NULL terminator
+                                            //If longer ids are desired, user can #define CMD_JSON_ID_SIZE prior to including this library
+    #endif
+
+    #ifndef CMD_JSON_PENDING
+        #define CMD_JSON_PENDING 4          // Number of JSON requests that can wait for a deferred reply (see json_defer(), 8 at most, 0 removes deferred replies completely)
+                                            //If a different number is desired, user can #define CMD_JSON_PENDING prior to including this library
+    #endif
+
+    #if CMD_JSON_PENDING > 8
+        #error "CMD_JSON_PENDING must be 8 or less"
+    #endif
+
+    #define CMD_JSON_NO_TICKET 0xFF         // json_defer(): no free slot in the pending request queue
+
+    #ifndef CMD_RX_CHUNK_SIZE
+        #define CMD_RX_CHUNK_SIZE 64        // Number of bytes pulled from the stream per readBytes() call by poll() (one USB-CDC packet)
+                                            //If a different staging size is desired, user can #define CMD_RX_CHUNK_SIZE prior to including this library
+    #endif
+
+    #ifndef CMD_TX_BUF_SIZE
+        #define CMD_TX_BUF_SIZE 64          // Size of the buffer used to coalesce terminal output (echo, redraw, prompts) into as few writes as possible
+                                            //If a different size is desired, user can #define CMD_TX_BUF_SIZE prior to including this library
+    #endif
+
+    #ifndef CMD_HISTORY_DEPTH
+        #define CMD_HISTORY_DEPTH 4         // Default number of command lines remembered by CmdHistory<> for Up / Down recall (0 removes command history completely)
+                                            //If a different depth is desired, user can #define CMD_HISTORY_DEPTH prior to including this library
+    #endif
+
+    #ifndef CMD_HISTORY_LINE_SIZE
+        #define CMD_HISTORY_LINE_SIZE 64    // Longest command line (including the NULL terminator) kept in the history, longer lines aren't remembered (256 at most)
+    #endif
+
+    #if CMD_HISTORY_LINE_SIZE > 256
+        #error "CMD_HISTORY_LINE_SIZE must be 256 or less (cached token offsets are 8-bit)"
+    #endif
+
+    #ifndef CMD_HISTORY_MAX_ARGS
+        #define CMD_HISTORY_MAX_ARGS 8      // Lines with up to this many arguments also remember their parse result, so re-running them skips the tokenizer + command lookup
+    #endif
+
+    #define CMD_HIST_NONE 0xFF              // History slot index meaning "no slot"
+
+    #ifndef CMD_JOB_QUEUE_SIZE
+        #define CMD_JOB_QUEUE_SIZE 2        // Default number of commands CmdJobs<> can hold queued / running at the same time (see add_task() / exec_mode(), 0 removes the job queue completely)
+                                            //If a different size is desired, user can #define CMD_JOB_QUEUE_SIZE prior to including this library
+    #endif
+
+    #ifndef CMD_JOB_LINE_SIZE
+        #define CMD_JOB_LINE_SIZE 64        // Longest command line (including the NULL terminator) that can be queued as a job
+    #endif
+
+    #ifndef CMD_JOB_MAX_ARGS
+        #define CMD_JOB_MAX_ARGS 8          // Maximum number of arguments of a queued job
+    #endif
+
+    #define CMD_EXEC_INLINE 0               // command handlers run as soon as the command is parsed (default)
+    #define CMD_EXEC_DEFERRED 1             // command handlers are queued and run from later poll() calls, so input keeps flowing
+    #define CMD_EXEC_WORKER 2               // command handlers are queued for worker_run() on another thread / core, their output comes back through poll()
+
+    #ifndef CMD_WORKER_QUEUE_SIZE
+        #define CMD_WORKER_QUEUE_SIZE 0     // Number of commands queued for the worker thread / task (power of 2, see exec_mode(CMD_EXEC_WORKER), 0 compiles worker support out)
+                                            //If a worker is desired, user can #define CMD_WORKER_QUEUE_SIZE prior to including this library (e.g. 4, on ESP32 / host builds)
+    #endif
+
+    #ifndef CMD_WORKER_OUT_SIZE
+        #define CMD_WORKER_OUT_SIZE 256     // Size of the ring carrying handler output from the worker back to poll() (power of 2)
+    #endif
+
+    #if CMD_WORKER_QUEUE_SIZE
+        #if (CMD_WORKER_QUEUE_SIZE & (CMD_WORKER_QUEUE_SIZE - 1)) || CMD_WORKER_QUEUE_SIZE > 128
+            #error "CMD_WORKER_QUEUE_SIZE must be a power of 2, up to 128"
+        #endif
+
+        /* poll() and the worker each keep their own "current instance", so Cmd::stream() answers for the calling thread */
+        #define CMD_THREAD_LOCAL thread_local
+    #else
+        #define CMD_THREAD_LOCAL
+    #endif
+
+    #ifndef CMD_SCRIPT_LINE_SIZE
+        #define CMD_SCRIPT_LINE_SIZE 64     // Longest line (including the NULL terminator) of a script run by run_script() / run_script_P(), longer lines are errors
+                                            //If longer lines are desired, user can #define CMD_SCRIPT_LINE_SIZE prior to including this library
+    #endif
+
+    #define CMD_SCRIPT_STOP_ON_ERROR 0x01   // run_script(): stop at the first line that fails
+    #define CMD_SCRIPT_SUMMARY 0x02         // run_script(): print a one line summary when done
+    #define CMD_SCRIPT_DEFAULT (CMD_SCRIPT_STOP_ON_ERROR | CMD_SCRIPT_SUMMARY)
+
+    #ifndef CMD_STATS
+        #define CMD_STATS 0                 // Runtime counters: per command calls / handler time / errors, plus global CLI counters (0 compiles them out completely)
+                                            //If the counters are desired, user can #define CMD_STATS 1 prior to including this library
+    #endif
+
+    #ifndef CMD_KEY_BINDINGS
+        #define CMD_KEY_BINDINGS 4          // Number of user key bindings (see bind_key()) on top of the built-in ones (0 removes them completely)
+                                            //If more bindings are desired, user can #define CMD_KEY_BINDINGS prior to including this library
+    #endif
+
+    #ifndef CMD_PREFIX_INDEX
+        #define CMD_PREFIX_INDEX 0          // Tab completion of command names, and dispatch on unique abbreviations (e.g. "st" -> "stats"), from a sorted name index (0 compiles it out)
+                                            //If completion / abbreviations are desired, user can #define CMD_PREFIX_INDEX 1 prior to including this library
+    #endif
+
+    #define CMD_TASK_DONE 0                 // task return value: the job is finished and its queue slot is released
+    #define CMD_TASK_YIELD 1                // task return value: call the task again on the next poll()
+
+    #ifndef CMD_STATIC_NAME_SIZE
+        #define CMD_STATIC_NAME_SIZE 16     // Maximum command name length (including the NULL terminator) for flash-resident command tables
+                                            //If longer names are desired, user can #define CMD_STATIC_NAME_SIZE prior to including this library
+    #endif
+
+    /* Command callback function */
+    typedef void (*cmd_func_t)(int argc, char **argv);
+
+    #if CMD_STATS
+        /* Runtime counters of one command table entry (commands added at runtime, not flash-resident tables) */
+        typedef struct _cmd_entry_stats_t
+        {
+            uint32_t calls;                     // number of times the handler ran (tasks: number of jobs completed)
+            uint32_t time_total;                // cumulative handler time in micros
+            uint32_t time_max;                  // longest single handler call (tasks: longest single step) in micros
+            uint16_t errors;                    // rejected invocations (bad typed arguments, job queue full)
+        } cmd_entry_stats_t;
+
+        /* Runtime counters of one Cmd instance */
+        typedef struct _cmd_stats_t
+        {
+            uint32_t bytes_read;                // bytes read from the stream
+            uint32_t bytes_echoed;              // typed characters echoed back to the terminal
+            uint32_t lines_dropped;             // lines dropped because they didn't fit the command buffer
+            uint32_t unknown;                   // lines with an unknown command
+            uint32_t json_rejected;             // JSON messages rejected by the tokenizer
+            uint32_t bin_rejected;              // binary frames dropped (bad COBS / CRC, or unknown command ID)
+        } cmd_stats_t;
+    #endif
+
+    struct _cmd_t;
+
+    /**
+     * Queued command (see Cmd::add_task()).  The line is copied out of the command buffer, so argv stays valid
+     * while new input is typed.  state and ctx belong to the task: both start out as 0 / NULL and are kept
+     * between calls, so a task can be written as a state machine that picks up where it yielded.
+    */
+    typedef struct _cmd_job_t
+    {
+        uint8_t argc;
+        char *argv[CMD_JOB_MAX_ARGS + 1];
+        uint16_t state;                         // task state, 0 on the first call
+        uint32_t wake;                          // task owned, e.g. the millis() value to wait for before doing more work
+        void *ctx;                              // task owned context pointer
+        uint8_t (*task)(struct _cmd_job_t *job);
+        void (*func)(int argc, char **argv);    // plain handler deferred by CMD_EXEC_DEFERRED (task == NULL)
+        #if CMD_STATS
+            struct _cmd_t *entry;               // command table entry the job's counters are kept in (NULL if none)
+            uint32_t gen;                       // table generation entry was last checked against (see CmdTable::has_entry())
+            uint32_t elapsed;                   // CMD_EXEC_WORKER: handler time measured by the worker, accounted by poll()
+        #endif
+        char line[CMD_JOB_LINE_SIZE];
+    } cmd_job_t;
+
+    /* Resumable command task - returns CMD_TASK_YIELD to be called again on the next poll(), or CMD_TASK_DONE */
+    typedef uint8_t (*cmd_task_t)(cmd_job_t *job);
+
+    /* Job queue (see Cmd::attach_jobs(), or CmdJobs<Slots> for one with its own storage) */
+    typedef struct _cmd_jobs_t
+    {
+        cmd_job_t *slots;                       // a slot is in use while its task / func is set
+        uint8_t size;                           // number of slots
+        uint8_t count;                          // number of slots in use
+    } cmd_jobs_t;
+
+    /* Binary command callback function (CLI_MODE_BIN) - payload points into the command buffer */
+    typedef void (*cmd_bin_func_t)(uint8_t *payload, uint16_t len);
+
+    /* Binary command table entry */
+    typedef struct _cmd_bin_t
+    {
+        uint8_t id;
+        cmd_bin_func_t func;
+        struct _cmd_bin_t *next;
+    } cmd_bin_t;
+
+    /* Typed command callback function - args holds one parsed value per schema argument, argc is the number given */
+    typedef void (*cmd_typed_func_t)(int argc, cmd_arg_t *args);
+
+    /* Key binding callback function - key is the CMD_KEY_x code (with modifier bits) that was pressed */
+    typedef void (*cmd_key_func_t)(uint8_t key);
+
+    /* Outcome of a script run by Cmd::run_script() / Cmd::run_script_P() */
+    typedef struct _cmd_script_result_t
+    {
+        uint16_t lines;                         // lines run (blank lines and # comments don't count)
+        uint16_t errors;                        // lines that failed: unknown command, bad arguments, couldn't be queued, too long
+        uint16_t error_line;                    // line number (from 1) of the first failure, 0 if none
+        uint32_t micros;                        // time taken
+    } cmd_script_result_t;
+
+    /* User key binding (see Cmd::bind_key() / Cmd::attach_key_callback()) */
+    typedef struct _cmd_key_binding_t
+    {
+        uint8_t key;                            // CMD_KEY_x | modifiers, CMD_KEY_NONE if the slot is free
+        uint8_t action;                         // CMD_ACT_x, used when func is NULL
+        cmd_key_func_t func;                    // called instead of an editor action, if set
+    } cmd_key_binding_t;
+
+    /* Command table entry flags */
+    #define CMD_ENTRY_NAME_P 0x01               // cmd points to a name in flash (added with add_P() / F()), not a heap copy
 
     /* Custom command line structure */
     typedef struct _cmd_t
     {
-        char *cmd;
+        char *cmd;                              // command name, in flash if CMD_ENTRY_NAME_P is set
         void (*func)(int argc, char **argv);
+        cmd_task_t task;                        // set instead of func for commands added with add_task()
+        cmd_typed_func_t typed_func;            // set instead of func for commands added with an argument schema
+        uint8_t *schema;                        // compiled argument schema (see cmdArgs.h), NULL if none
+        uint8_t flags;                          // CMD_ENTRY_* flags
+        struct _cmd_t *sub;                     // subcommands (see add() with a multi-word name), NULL if none
+        #if CMD_STATS
+            cmd_entry_stats_t stats;
+        #endif
         struct _cmd_t *next;
     } cmd_t;
 
+    /* Command history entry: the raw line plus its cached parse result */
+    typedef struct _cmd_hist_t
+    {
+        char line[CMD_HISTORY_LINE_SIZE];       // line as it was typed
+        uint8_t argc;                           // number of cached tokens (0 = parse result not cached)
+        uint32_t gen;                           // command table generation the cached handler belongs to
+        uint8_t tok[CMD_HISTORY_MAX_ARGS];      // offset of each token in the line
+        void (*func)(int argc, char **argv);    // cached handler
+        cmd_task_t task;                        // cached task (commands added with add_task())
+        #if CMD_STATS
+            struct _cmd_t *entry;               // cached command table entry, for its counters
+        #endif
+    } cmd_hist_t;
+
+    /* Command history ring (see Cmd::attach_history(), or CmdHistory<Depth> for one with its own storage) */
+    typedef struct _cmd_history_t
+    {
+        cmd_hist_t *slots;
+        uint8_t depth;                          // number of slots
+        uint8_t head;                           // next slot to be written
+        uint8_t count;                          // number of valid entries
+    } cmd_history_t;
+
+    /* JSON request state (see Cmd::attach_json_state(), or CmdJsonState<Tokens> for one with its own storage) */
+    typedef struct _cmd_json_state_t
+    {
+        cmd_json_tok_t *toks;                   // token storage for the tokenizer
+        uint16_t max_toks;                      // number of tokens toks can hold
+        char id[CMD_JSON_ID_SIZE];              // "id" of the request being handled, as written in the message (empty if none)
+        #if CMD_JSON_PENDING
+            char pending[CMD_JSON_PENDING][CMD_JSON_ID_SIZE];   // ids of the deferred requests
+            uint8_t pending_used;                               // a pending slot is in use while its bit is set
+        #endif
+    } cmd_json_state_t;
+
+    #if CMD_HISTORY_DEPTH
+        /* A history ring with its own storage: CmdHistory<> hist; */
+        template <uint8_t Depth = CMD_HISTORY_DEPTH>
+        class CmdHistory : public cmd_history_t
+        {
+            static_assert(Depth >= 1 && Depth < CMD_HIST_NONE, "cmdArduino: CmdHistory depth must be 1 to 254");
+
+            public:
+                CmdHistory() {slots = _storage; depth = Depth; head = 0; count = 0;}
+
+            private:
+                cmd_hist_t _storage[Depth];
+        };
+    #endif
+
+    #if CMD_JOB_QUEUE_SIZE
+        /* A job queue with its own storage: CmdJobs<> jobs; */
+        template <uint8_t Slots = CMD_JOB_QUEUE_SIZE>
+        class CmdJobs : public cmd_jobs_t
+        {
+            static_assert(Slots >= 1, "cmdArduino: CmdJobs needs at least one slot");
+
+            public:
+                CmdJobs() {memset(_storage, 0, sizeof(_storage)); slots = _storage; size = Slots; count = 0;}
 
-    /* Class Definition */
-    class Cmd
+            private:
+                cmd_job_t _storage[Slots];
+        };
+    #endif
+
+    /* JSON request state with its own token storage: CmdJsonState<> json; */
+    template <uint16_t Tokens = CMD_JSON_MAX_TOKENS>
+    class CmdJsonState : public cmd_json_state_t
+    {
+        static_assert(Tokens >= 1 && Tokens <= 0x7FFF, "cmdArduino: CmdJsonState tokens must be 1 to 32767");
+
+        public:
+            CmdJsonState() {
+                toks = _storage;
+                max_toks = Tokens;
+                id[0] = '\0';
+                #if CMD_JSON_PENDING
+                    pending_used = 0;
+                #endif
+            }
+
+        private:
+            cmd_json_tok_t _storage[Tokens];
+    };
+
+    /* Hashed command index slot (see Cmd::freeze()) */
+    typedef struct _cmd_index_t
+    {
+        uint16_t hash;
+        cmd_t *entry;
+    } cmd_index_t;
+
+    /* Commands starting with a given prefix (see CmdTable::prefix_find()): a range of the sorted name index, plus a range of the flash-resident table */
+    typedef struct _cmd_prefix_t
     {
+        uint16_t first;                         // first match in the sorted name index of runtime commands
+        uint16_t count;                         // number of runtime commands that match
+        uint16_t static_first;                  // first match in the flash-resident command table
+        uint16_t static_count;                  // number of flash-resident commands that match
+    } cmd_prefix_t;
+
+    /**
+     * Flash-resident command table entry (see CMD_TABLE / Cmd::add_table()).
+     * The name is stored inline (not as a pointer) so the entire entry, including the string, lives in PROGMEM.
+    */
+    typedef struct _cmd_static_t
+    {
+        char cmd[CMD_STATIC_NAME_SIZE];
+        void (*func)(int argc, char **argv);
+    } cmd_static_t;
+
+    /* compile-time strcmp() used to validate the ordering of flash-resident command tables */
+    constexpr int cmd_static_strcmp(const char *a, const char *b) {
+        return (*a != *b || !*a) ? ((int)(uint8_t)*a - (int)(uint8_t)*b) : cmd_static_strcmp(a + 1, b + 1);
+    }
+
+    /* compile-time check that a flash-resident command table is sorted (strictly ascending, no duplicates) */
+    template <size_t N>
+    constexpr bool cmd_static_sorted(const cmd_static_t (&tbl)[N], size_t i = 1) {
+        return (i >= N) ? true : (cmd_static_strcmp(tbl[i - 1].cmd, tbl[i].cmd) < 0 && cmd_static_sorted(tbl, i + 1));
+    }
+
+    /**
+     * Declare a flash-resident command table.  Entries must be listed in ascending strcmp() order, which is
+     * verified at compile time, so Cmd can binary search the table without sorting it (or using any RAM) at runtime.
+     *
+     *      CMD_TABLE(my_cmds,
+     *          {"blink", led_blink},
+     *          {"hello", hello},
+     *          {"pwm",   led_pwm}
+     *      );
+     *      ...
+     *      cmd.add_table(my_cmds);
+    */
+    #define CMD_TABLE(name, ...) \
+        constexpr cmd_static_t name[] PROGMEM = {__VA_ARGS__}; \
+        static_assert(cmd_static_sorted(name), "cmdArduino: CMD_TABLE " #name " must be sorted by command name, without duplicates")
+
+
+    /**
+     * Output coalescing buffer.  Everything the command line prints back to the terminal is collected here and
+     * written to the stream in as few write() calls as possible (when the buffer fills, or on flush()).
+    */
+    class CmdTxBuffer : public Print
+    {
+        public:
+            /* attach the buffer to the stream it flushes to */
+            void begin(Stream *stream) {_stream = stream; _len = 0;}
+
+            /* Print interface - buffered */
+            size_t write(uint8_t c);
+            size_t write(const uint8_t *buffer, size_t size);
+            using Print::write;
+
+            /* write out anything buffered */
+            void flush();
+
+        private:
+            Stream *_stream = NULL;
+            uint8_t _buf[CMD_TX_BUF_SIZE];
+            uint16_t _len = 0;
+    };
+
+    #if CMD_WORKER_QUEUE_SIZE
+        /**
+         * Stream handed to command handlers running on the worker (Cmd::stream()).  Writes go into a lock-free
+         * ring that poll() drains to the real stream, so the two threads never write to it at the same time.
+         * When the ring is full the worker waits (yield()) for poll() to catch up.
+        */
+        class CmdWorkerOut : public Stream
+        {
+            public:
+                /* attach to the ring the output goes through */
+                void begin(cmd_ring_t *ring) {_ring = ring;}
+
+                /* Print interface - queued for poll() */
+                size_t write(uint8_t c);
+                size_t write(const uint8_t *buffer, size_t size);
+                using Print::write;
+
+                /* Stream interface - handlers get their input through argv, there is nothing to read */
+                int available() {return 0;}
+                int read() {return -1;}
+                int peek() {return -1;}
+
+            private:
+                cmd_ring_t *_ring = NULL;
+        };
+    #endif
 
+    /**
+     * Command table: commands added at runtime (linked list, optionally indexed by freeze()) plus an optional
+     * flash-resident table.  Every Cmd owns one, and several Cmd instances can share a single table (see
+     * Cmd::use_table() / CmdMux) so commands only have to be registered once.
+    */
+    class CmdTable
+    {
         public:
-            /* Constructor of Cmd Class - no pointers provided to any streams */
-            Cmd();
+            /* Constructor of CmdTable Class - empty table */
+            CmdTable();
+
+            /* add() - allows the user to add command + callback functions to be triggered when the command is seen */
+            void add(const char *name, void (*func)(int argc, char **argv));
+
+            /* add_task() - add a command whose handler is a resumable task, run from the job queue (see Cmd::add_task()) */
+            void add_task(const char *name, cmd_task_t task);
+
+            /* add() - add a command with a typed argument schema (see Cmd::add()) */
+            uint8_t add(const char *name, const char *schema, cmd_typed_func_t func);
+
+            /* add_P() - add a command whose name stays in flash instead of being copied to the heap (see Cmd::add_P()) */
+            void add_P(const char *name, void (*func)(int argc, char **argv));
+
+            /* add_task_P() - add a task command whose name stays in flash */
+            void add_task_P(const char *name, cmd_task_t task);
+
+            /* add_P() - add a command with a typed argument schema, whose name stays in flash */
+            uint8_t add_P(const char *name, const char *schema, cmd_typed_func_t func);
+
+            /* add() - F() name overloads, same as add_P() */
+            void add(const __FlashStringHelper *name, void (*func)(int argc, char **argv)) {add_P((const char *)name, func);}
+            uint8_t add(const __FlashStringHelper *name, const char *schema, cmd_typed_func_t func) {return add_P((const char *)name, schema, func);}
+
+            /**
+             * @brief Add (or replace) the handler of a binary command (CLI_MODE_BIN)
+             * @param id command ID carried in the frame
+             * @param func handler, or NULL to remove the command
+            */
+            void add_bin(uint8_t id, cmd_bin_func_t func);
+
+            /* lookup_bin() - find the handler of a binary command (NULL if there is none) */
+            cmd_bin_func_t lookup_bin(uint8_t id);
+
+            /**
+             * @brief Remove a command from the command table (freeing its memory)
+             * @param name command name to remove
+             * @retval true if the command was found and removed
+            */
+            uint8_t remove(const char *name);
+
+            /**
+             * @brief Replace the callback of an existing command (or add the command if it doesn't exist yet)
+             * @param name command name
+             * @param func new callback function
+             * @retval true if an existing command was replaced, false if it was added
+            */
+            uint8_t replace(const char *name, void (*func)(int argc, char **argv));
+
+            /**
+             * @brief Build a hashed index over the commands added so far, so dispatch becomes a hash probe + one strcmp
+             *          instead of walking the whole list.  Commands added / removed afterwards keep the index up to date.
+             *          Note: the index uses 4 * (next power of 2 above 1.5x the command count) bytes of heap (more on 32-bit targets)
+             * @retval true if the index was built, false if there wasn't enough memory (dispatch falls back to the list walk)
+            */
+            uint8_t freeze();
+
+            /**
+             * @brief Attach a flash-resident command table (see CMD_TABLE).  Commands in the table use no heap and are
+             *          found with a binary search.  Commands registered with add() take precedence over table entries.
+             *          Note: only one table can be attached at a time; attaching a new table replaces the previous one
+             * @param tbl pointer to the PROGMEM table (must be sorted by command name)
+             * @param count number of entries in the table
+            */
+            void add_table(const cmd_static_t *tbl, uint16_t count);
+
+            /* add_table() - convenience overload that takes the table size from the array itself */
+            template <size_t N>
+            void add_table(const cmd_static_t (&tbl)[N]) {add_table(tbl, N);}
+
+            /* lookup() - find a command added at runtime (via the hashed index once frozen, otherwise by walking the list) */
+            cmd_t *lookup(const char *name);
+
+            /* lookup_static() - binary search of the flash-resident command table */
+            cmd_func_t lookup_static(const char *name);
+
+            /* gen() - generation counter, bumped whenever the table changes (used to invalidate cached handlers, wide enough never to wrap in practice) */
+            uint32_t gen();
+
+            /* list() - first command added at runtime (follow ->next for the rest), e.g. to walk the table */
+            cmd_t *list();
+
+            #if CMD_STATS
+                /* stats_reset() - clear the counters of every command in the table */
+                void stats_reset();
+
+                /* has_entry() - whether entry is (still) in the table, i.e. wasn't removed since it was looked up */
+                uint8_t has_entry(const cmd_t *entry);
+            #endif
+
+            /* lookup_path() - find a command by its name, or by its multi-word path for subcommands */
+            cmd_t *lookup_path(const char *path);
+
+            #if CMD_PREFIX_INDEX
+                /**
+                 * @brief Find every command whose name starts with prefix, in both the runtime commands and the
+                 *          flash-resident table.  Runtime names are kept in a sorted index (built on first use, and
+                 *          rebuilt after the table changes), so this is two binary searches per table - the cost
+                 *          depends on the name length and log(n), not on one strcmp per command.
+                 * @param prefix start of a command name (needn't be NULL terminated)
+                 * @param len length of the prefix
+                 * @param range filled in with the matches, see prefix_name()
+                 * @retval number of matching commands
+                */
+                uint16_t prefix_find(const char *prefix, uint16_t len, cmd_prefix_t *range);
+
+                /* prefix_name() - name of match i (runtime commands first, then the flash-resident table) of a prefix_find() result, *in_flash is set if it lives in PROGMEM */
+                const char *prefix_name(const cmd_prefix_t *range, uint16_t i, uint8_t *in_flash);
+
+                /* lookup_abbrev() - resolve a unique abbreviation of a command name: returns the runtime entry, or NULL and sets *func for a flash-resident command (*func = NULL if none / ambiguous) */
+                cmd_t *lookup_abbrev(const char *name, cmd_func_t *func);
+            #endif
+
+        private:
+            /* add_entry() - allocate a command table entry for either a handler or a task (the name is copied unless it is in flash) */
+            cmd_t *add_entry(const char *name, cmd_func_t func, cmd_task_t task, uint8_t flags);
+
+            /* add_typed() - compile the schema and add a typed command */
+            uint8_t add_typed(const char *name, const char *schema, cmd_typed_func_t func, uint8_t flags);
+
+            /* link_entry() - allocate an entry and add it to a list: the table itself, or the subcommands of a group */
+            cmd_t *link_entry(cmd_t **list, const char *name, cmd_func_t func, cmd_task_t task, uint8_t flags);
+
+            /* path_list() - walk a multi-word path down the subcommand tree (creating missing groups if asked), returns the list its last word belongs in */
+            cmd_t **path_list(char *path, char **leaf, uint8_t create);
+
+            #if CMD_STATS
+                /* stats_clear() - clear the counters of one level of the command tree and everything below it */
+                void stats_clear(cmd_t *list);
+
+                /* has_entry_in() - whether entry is in one level of the command tree or below it */
+                uint8_t has_entry_in(const cmd_t *list, const cmd_t *entry);
+            #endif
+
+            /* index_build() - (re)allocate and fill the hashed command index */
+            uint8_t index_build();
 
-            /* Constructor of Cmd Class - pointers provided to a HardwareSerial stream */
-            Cmd(HardwareSerial *stream);
+            /* index_insert() - add a command to the hashed command index (an existing entry with the same name is only replaced if requested) */
+            void index_insert(cmd_t *entry, uint8_t replace_existing);
+
+            /* changed() - the command tables changed: invalidate cached handlers and the sorted name index */
+            void changed();
+
+            /* Custom structure for command table entries */
+            cmd_t *cmd_tbl_list, *cmd_tbl;
+
+            /* Number of entries in the runtime command table */
+            uint16_t _cmd_count;
+
+            /* Bumped whenever the command tables change, invalidating cached handlers */
+            uint32_t _cmd_gen;
+
+            /* Hashed command index (NULL until freeze() is called) */
+            cmd_index_t *_cmd_index;
+
+            /* Hashed command index size - 1 (size is always a power of 2) */
+            uint16_t _cmd_index_mask;
+
+            /* Flash-resident command table (sorted by name) */
+            const cmd_static_t *_static_tbl;
+
+            /* Number of entries in the flash-resident command table */
+            uint16_t _static_tbl_size;
+
+            /* Binary commands (CLI_MODE_BIN) */
+            cmd_bin_t *_bin_list;
+
+            #if CMD_PREFIX_INDEX
+                /* prefix_build() - build the sorted name index, if the table changed since it was last built */
+                uint8_t prefix_build();
+
+                /* Runtime commands sorted by name, one entry per distinct name (NULL until first needed) */
+                cmd_t **_prefix_idx;
+
+                /* Number of entries in the sorted name index */
+                uint16_t _prefix_count;
+
+                /* Whether the sorted name index matches the table (cleared by changed()) */
+                uint8_t _prefix_built;
+            #endif
+    };
+
+    /**
+     * Class Definition.  CmdBase holds the whole command line implementation; the command buffer and the argv array
+     * it works in are provided by CmdT<MsgSize, MaxArgs> (below), so their sizes can be chosen per instance.
+    */
+    class CmdBase
+    {
+
+        protected:
+            /* Constructor of CmdBase Class - no pointers provided to any streams */
+            CmdBase(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args);
+
+            /* Constructor of CmdBase Class - pointers provided to a HardwareSerial stream */
+            CmdBase(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args, HardwareSerial *stream);
 
             #ifdef SoftwareSerial_h
-                /* Constructor of Cmd Class - pointers provided to a SoftwareSerial stream */
-                Cmd(SoftwareSerial *stream);
+                /* Constructor of CmdBase Class - pointers provided to a SoftwareSerial stream */
+                CmdBase(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args, SoftwareSerial *stream);
             #endif
 
+        public:
             /* begin() - should only be called if the calling program hasn't initated the serial stream yet */
             void begin(uint32_t speed, uint32_t config=SERIAL_8N1);
 
             /* poll() - repeteadly called by the user's loop to check the command line inputs */
             void poll();
 
-            /* add() - allows the user to add command + callback functions to be triggered when the command is seen */
+            /**
+             * @brief Bounded poll: process at most max_bytes of input and spend at most max_micros (0 = no limit),
+             *          then return.  Input that isn't processed yet stays staged, and a partially typed line is kept,
+             *          so the next call resumes where this one stopped.  The time budget is checked after every
+             *          command, so the worst case is max_micros plus the slowest command handler.
+             * @retval true if more input is still waiting
+            */
+            uint8_t poll(uint16_t max_bytes, uint32_t max_micros=0);
+
+            /**
+             * @brief Take input from a receive ring filled by an interrupt / RX callback (see cmdRing.h) instead of
+             *          reading the stream in poll().  Output still goes to the stream.
+             * @param ring the ring, or NULL to read the stream again
+            */
+            void attach_ring(cmd_ring_t *ring);
+
+            #if CMD_HISTORY_DEPTH
+                /**
+                 * @brief Turn on Up / Down recall of the last command lines, kept in the given ring (e.g. a CmdHistory<>).
+                 *          Without one, Up / Down do nothing and no RAM is spent on history.
+                 * @param hist the history ring, or NULL to turn history off again
+                */
+                void attach_history(cmd_history_t *hist);
+            #endif
+
+            #if CMD_JOB_QUEUE_SIZE
+                /**
+                 * @brief Give this instance a job queue (e.g. a CmdJobs<>), needed to run add_task() commands and for
+                 *          CMD_EXEC_DEFERRED.  Without one, tasks are refused like with a full queue and deferred
+                 *          handlers run inline.  Attach it before polling, it can't be swapped while jobs are queued.
+                 * @param jobs the job queue
+                */
+                void attach_jobs(cmd_jobs_t *jobs);
+            #endif
+
+            /**
+             * @brief Add a command + the callback function to be triggered when the command is seen.  A name made
+             *          of several words adds a subcommand, e.g. add("net wifi set", wifi_set) - the words before
+             *          the last one become groups (created without a handler if they don't exist yet).  Dispatch
+             *          follows the typed words down the tree in one pass, and the deepest match is called with the
+             *          rest of the line (argv[0] is its own name).  A group without a handler lists its subcommands.
+             *          Note: this applies to every add() / add_task() variant, except names in flash (add_P())
+             * @param name command name, or space separated path of a subcommand
+             * @param func handler
+            */
             void add(const char *name, void (*func)(int argc, char **argv));
 
+            /**
+             * @brief Add a command with a typed argument schema, e.g. "u8 u32 i16 f hex str" (see cmdArgs.h).  The
+             *          arguments are parsed and range checked before dispatch, and the handler gets the parsed values.
+             *          Bad input is rejected with a message naming the argument, without calling the handler.
+             *          Note: typed commands always run inline, also in CMD_EXEC_DEFERRED / CMD_EXEC_WORKER mode
+             * @param name command name
+             * @param schema space separated argument types, a '?' suffix marks an optional argument
+             * @param func handler
+             * @retval true if added, false if the schema is invalid (or there wasn't enough memory)
+            */
+            uint8_t add(const char *name, const char *schema, cmd_typed_func_t func);
+
+            /**
+             * @brief Add a command whose handler is a resumable task.  The parsed command is copied into the job queue
+             *          and the prompt comes back right away; the task is then called once per poll() until it returns
+             *          CMD_TASK_DONE, so several long-running commands can make progress while input keeps flowing.
+             *          Note: lines longer than CMD_JOB_LINE_SIZE or with more than CMD_JOB_MAX_ARGS arguments can't be queued
+             * @param name command name
+             * @param task task function, see cmd_job_t for the state it is passed
+            */
+            void add_task(const char *name, cmd_task_t task);
+
+            /**
+             * @brief Add a command whose name is kept in flash.  add() copies every name to the heap; with add_P() the
+             *          table only stores the pointer, and dispatch compares against flash.  Flash and RAM names can be
+             *          mixed in one table.
+             *
+             *      const char led_name[] PROGMEM = "led";
+             *      cmd.add_P(led_name, led);
+             *      cmd.add(F("blink"), blink);         // same thing, with an F() string
+             *
+             * @param name command name in PROGMEM (must stay valid for as long as the command is registered)
+             * @param func handler
+            */
+            void add_P(const char *name, void (*func)(int argc, char **argv));
+
+            /* add_P() - add a command with a typed argument schema, whose name stays in flash */
+            uint8_t add_P(const char *name, const char *schema, cmd_typed_func_t func);
+
+            /* add_task_P() - add a task command whose name stays in flash */
+            void add_task_P(const char *name, cmd_task_t task);
+
+            /* add() - F() name overloads, same as add_P() */
+            void add(const __FlashStringHelper *name, void (*func)(int argc, char **argv)) {add_P((const char *)name, func);}
+            uint8_t add(const __FlashStringHelper *name, const char *schema, cmd_typed_func_t func) {return add_P((const char *)name, schema, func);}
+
+            /* add_bin() - add (or replace) the handler of a binary command (see CmdTable::add_bin()) */
+            void add_bin(uint8_t id, cmd_bin_func_t func);
+
+            /**
+             * @brief Send a binary frame (COBS encoded, with CRC16) on this instance's stream, e.g. as the reply to a
+             *          binary command.  Works in any mode (on the worker, the frame goes out through Cmd::stream()).
+             * @param id command ID
+             * @param payload payload bytes (may contain any value, including 0x00)
+             * @param len payload length
+            */
+            void send_bin(uint8_t id, const uint8_t *payload, uint16_t len);
+
+            /* remove() - remove a command from the command table (see CmdTable::remove()) */
+            uint8_t remove(const char *name);
+
+            /* replace() - replace the callback of an existing command, or add it (see CmdTable::replace()) */
+            uint8_t replace(const char *name, void (*func)(int argc, char **argv));
+
+            /* freeze() - build a hashed index over the command table (see CmdTable::freeze()) */
+            uint8_t freeze();
+
+            /* add_table() - attach a flash-resident command table (see CmdTable::add_table()) */
+            void add_table(const cmd_static_t *tbl, uint16_t count);
+
+            /* add_table() - convenience overload that takes the table size from the array itself */
+            template <size_t N>
+            void add_table(const cmd_static_t (&tbl)[N]) {add_table(tbl, N);}
+
+            /**
+             * @brief Use a command table shared with other Cmd instances (e.g. one per serial port, see CmdMux) instead
+             *          of this instance's own table.  Commands added through any of them are seen by all of them.
+             *          Handlers cached in the command history belong to the previous table and are dropped.
+             * @param tbl the shared table, or NULL to go back to this instance's own table
+            */
+            void use_table(CmdTable *tbl);
+
+            /* table() - the command table this instance dispatches from */
+            CmdTable *table();
+
+            /**
+             * @brief The stream of the Cmd instance currently dispatching a command, so a handler can reply on the
+             *          port the command came from (e.g. when several ports share a table through CmdMux)
+             * @retval the stream, or NULL when called outside of a command handler / poll()
+            */
+            static Stream *stream();
+
+            /* active() - the Cmd instance currently polling / dispatching (NULL outside of poll()) */
+            static CmdBase *active();
+
+            /* in_worker() - true on the thread running worker_run(), while it runs a command handler */
+            static uint8_t in_worker();
+
             /* conv() - allows the user to convert a string to number */
             uint32_t conv(char *str, uint8_t base=10);
 
+            /**
+             * @brief Choose when plain command handlers run
+             * @param mode CMD_EXEC_INLINE = as soon as the command is parsed (default), CMD_EXEC_DEFERRED = queued and run
+             *          from the next poll(), like tasks (handlers run inline if the job queue is full), CMD_EXEC_WORKER =
+             *          queued for worker_run() on another thread / core (needs CMD_WORKER_QUEUE_SIZE).  Worker handlers
+             *          must print only through Cmd::stream() (not Serial.print()) and must not change the command table.
+            */
+            void exec_mode(uint8_t mode);
+
+            #if CMD_WORKER_QUEUE_SIZE
+                /**
+                 * @brief Run the oldest command queued by CMD_EXEC_WORKER.  Call it in a loop from a second thread / task
+                 *          (e.g. a FreeRTOS task pinned to the other ESP32 core) while loop() keeps calling poll():
+                 *
+                 *      void worker(void *) {for (;;) {if (!cmd.worker_run()) {delay(1);}}}
+                 *
+                 *          Parsing and all stream I/O stay on the poll() thread.  Commands reach the worker through a
+                 *          lock-free queue, and handlers reply through Cmd::stream(), whose output travels back the same
+                 *          way and is written out by poll().  Handlers run one at a time, in the order they were typed.
+                 *          When the queue is full, poll() waits for the worker.
+                 *
+                 *          Handlers on the worker must only print through Cmd::stream(): writing to Serial (or any
+                 *          other stream) directly races poll().  send_bin() and CmdJsonWriter replies are routed through
+                 *          Cmd::stream() automatically.  The command table can't be changed from the worker either, since
+                 *          poll() looks commands up without a lock: add(), remove(), replace(), freeze(), add_table()
+                 *          and stats_reset() are refused there (add() returns NULL, the others false / nothing).
+                 * @retval true if a command was run, false if the queue was empty
+                */
+                uint8_t worker_run();
+
+                /* worker_pending() - number of commands queued for / running on the worker */
+                uint8_t worker_pending();
+            #endif
+
+            /* jobs_pending() - number of queued / running jobs */
+            uint8_t jobs_pending();
+
+            #if CMD_STATS
+                /* stats() - runtime counters of this instance (bytes read, lines dropped, unknown commands, ...) */
+                const cmd_stats_t *stats();
+
+                /**
+                 * @brief Runtime counters of one command (calls, cumulative / max handler time, errors)
+                 * @retval the counters, or NULL if there is no such command (commands in flash-resident tables have no counters)
+                */
+                const cmd_entry_stats_t *cmd_stats(const char *name);
+
+                /* stats_reset() - clear the counters of this instance and of every command in its table */
+                void stats_reset();
+
+                /* add_stats_cmd() - add the built-in command that prints all counters ("<name> reset" clears them), it always runs inline */
+                void add_stats_cmd(const char *name = "stats");
+            #endif
+
+            /* jobs_run() - give every queued job one turn (poll() already does this, call it directly to run jobs without checking for input) */
+            void jobs_run();
+
+            /**
+             * @brief Run a script of newline separated command lines (e.g. bulk provisioning), straight through the
+             *          normal command dispatch but without echo, prompts or error messages.  Blank lines and lines
+             *          starting with '#' are skipped.  Handler output still goes to the stream.
+             *          Note: called from a command handler, that handler's argv is reused by the script
+             * @param script the script, NULL terminated
+             * @param result where to store the summary (optional)
+             * @param flags CMD_SCRIPT_STOP_ON_ERROR and / or CMD_SCRIPT_SUMMARY
+             * @retval true if every line ran without error
+            */
+            uint8_t run_script(const char *script, cmd_script_result_t *result = NULL, uint8_t flags = CMD_SCRIPT_DEFAULT);
+
+            /* run_script_P() - same as run_script(), for a script stored in flash (PROGMEM) */
+            uint8_t run_script_P(const char *script, cmd_script_result_t *result = NULL, uint8_t flags = CMD_SCRIPT_DEFAULT);
+
             /**
              * @brief Set the the interface mode to be standard (normal user input) or JSON programmatic
              *          Note: setting the mode will automatically clear the command buffer
-             * @param mode CLI_MODE_STD = standard mode , CLI_MODE_JSON = JSON programmatic mode, CLI_MODE_JSON_MAN = JSON manual mode
+             * @param mode CLI_MODE_STD = standard mode , CLI_MODE_JSON = JSON programmatic mode, CLI_MODE_JSON_MAN = JSON manual mode,
+             *          CLI_MODE_JSON_STREAM = JSON programmatic mode framed by braces (back-to-back objects, no CR required),
+             *          CLI_MODE_BIN = binary frames dispatched by command ID (see add_bin()).
+             *          Note: there is no escape sequence in CLI_MODE_BIN (every byte value is valid data), a binary
+             *          handler has to call mode() to leave it
             */
             void mode(uint8_t mode);
 
@@ -134,9 +981,71 @@
             */
            void attach_json_callback(void (*json_func)(char *json_msg));
 
+            /**
+             * @brief Allows the user to attach a callback function to be called with a tokenized JSON message.
+             *          The tokens are spans into json_msg (nothing is copied), use cmd_json_find() / cmd_json_eq() /
+             *          cmd_json_int() / cmd_json_str() to look up fields.  Nested objects and arrays are supported.
+             *          Reply with a CmdJsonWriter, which writes to the stream the message came from.
+             *          Note: the tokens are kept in the JSON state, so this callback needs attach_json_state()
+             * @param *json_func() pointer to a callback function provided by the user to be triggered when a JSON message is available
+            */
+            void attach_json_callback(void (*json_func)(char *json_msg, cmd_json_tok_t *toks, int16_t tok_count));
+
+            /**
+             * @brief Give this instance the token storage and request ids used by the tokenized JSON callback,
+             *          json_id() and json_defer() (e.g. a CmdJsonState<>).  Without one, JSON messages are still
+             *          checked and passed to the plain callback, but without tokens or ids.
+             * @param json the JSON state, or NULL to drop it again
+            */
+            void attach_json_state(cmd_json_state_t *json);
+
+            /**
+             * @brief The "id" of the JSON request being handled, as written in the message (e.g. 7 or "a1"), so several
+             *          requests can be in flight at once.  A CmdJsonWriter created in the callback adds it to the reply.
+             * @retval the id, or NULL if the request had none (or outside of a JSON callback, or without a JSON state)
+            */
+            const char *json_id();
+
+            #if CMD_JSON_PENDING
+                /**
+                 * @brief Keep the JSON request being handled open, to reply to it later (e.g. once a measurement is done),
+                 *          while the following requests are handled.  Replies to deferred requests can go out in any
+                 *          order; each one carries the id of its request.
+                 *
+                 *      uint8_t ticket = cmd.json_defer();
+                 *      ...
+                 *      CmdJsonWriter out(&cmd, ticket);    // later, e.g. from loop()
+                 *      out.begin_object();                 // {"id":...
+                 *
+                 * @retval ticket for CmdJsonWriter(cmd, ticket), or CMD_JSON_NO_TICKET if CMD_JSON_PENDING requests are
+                 *          already waiting or there is no JSON state (reply right away then, e.g. with an error)
+                */
+                uint8_t json_defer();
+
+                /* json_pending() - number of deferred JSON requests still waiting for their reply */
+                uint8_t json_pending();
+
+                /* json_release() - drop a deferred request without replying (CmdJsonWriter releases it after the reply) */
+                void json_release(uint8_t ticket);
+            #endif
+
             /* user can poll this function to check whether or not the exit character has been passed, allowing them to terminate the command line if desired */
             uint8_t exit_cli();
 
+            #if CMD_KEY_BINDINGS
+                /**
+                 * @brief Bind a key to an editor action, overriding its default (see cmdKeys.h), e.g.
+                 *          bind_key(CMD_KEY_PGUP, CMD_ACT_HOME).  CMD_ACT_NONE turns the key off.
+                 * @param key CMD_KEY_x, optionally | CMD_KEY_SHIFT / CMD_KEY_ALT / CMD_KEY_CTRL
+                 * @param action CMD_ACT_x
+                 * @retval true if bound, false if all CMD_KEY_BINDINGS slots are taken
+                */
+                uint8_t bind_key(uint8_t key, uint8_t action);
+
+                /* attach_key_callback() - call func(key) when the key is pressed, instead of an editor action (same slots as bind_key()) */
+                uint8_t attach_key_callback(uint8_t key, cmd_key_func_t func);
+            #endif
+
         private:
             /* display() - prints the command banner + command prompt strings to the stream */
             void display();
@@ -153,14 +1062,83 @@
             /* parse_json() - performs the buffer parsing based on JSON formatting */
             void parse_json(char *cmd);
 
-            /* handler() - called by poll() to handle all periodic tasks/buffer checking */
+            /* dispatch_typed() - check the arguments against the command's schema, then run its handler */
+            void dispatch_typed(cmd_t *cmd_entry, uint8_t argc, char **argv);
+
+            /* dispatch() - run (or queue) a parsed command, then print the prompt */
+            void dispatch(uint8_t argc, char **argv, cmd_func_t func, cmd_task_t task, cmd_t *entry);
+
+            #if CMD_JOB_QUEUE_SIZE
+                /* job_push() - copy a parsed command into a free job queue slot */
+                uint8_t job_push(uint8_t argc, char **argv, cmd_func_t func, cmd_task_t task, cmd_t *entry);
+            #endif
+
+            #if CMD_WORKER_QUEUE_SIZE
+                /* worker_push() - queue a parsed command for the worker, waiting for a free slot (false if the line doesn't fit a job) */
+                uint8_t worker_push(uint8_t argc, char **argv, cmd_func_t func, cmd_t *entry);
+
+                /* worker_wait() - wait for the worker to finish every queued command, writing out its output meanwhile */
+                void worker_wait();
+
+                /* worker_drain() - write out whatever the worker's handlers printed */
+                void worker_drain();
+            #endif
+
+            #if CMD_STATS
+                /* stat_entry() - entry, if it is still in the table (gen is the table generation it was looked up / checked in), NULL otherwise */
+                cmd_t *stat_entry(cmd_t *entry, uint32_t gen);
+
+                /* stat_call() - account one handler call that started at micros() == start (entry was looked up in table generation gen) */
+                void stat_call(cmd_t *entry, uint32_t gen, uint32_t start);
+
+                /* stats_cmd() - the built-in stats command */
+                static void stats_cmd(int argc, char **argv);
+
+                /* stats_print() - print the counters of one level of the command tree, subcommands indented below their group */
+                static void stats_print(Print *out, cmd_t *list, uint8_t depth);
+            #endif
+
+            /* handler() - called by poll() to process the bytes currently staged in the receive buffer */
             void handler();
 
+            /* rx_fill() - pull whatever the stream / receive ring has available into the receive staging buffer */
+            uint8_t rx_fill();
+
+            /* rx_waiting() - true if the stream / receive ring has input that isn't staged yet */
+            uint8_t rx_waiting();
+
+            /* poll_expired() - true once the time budget of the current bounded poll is spent */
+            uint8_t poll_expired();
+
+            /* rx_bulk_json() - CLI_MODE_JSON fast path: copy staged bytes straight into the msg buffer up to the next CR */
+            uint8_t rx_bulk_json();
+
+            /* rx_json_stream() - CLI_MODE_JSON_STREAM: track brace depth / strings per byte and dispatch on the closing brace */
+            void rx_json_stream();
+
+            /* rx_bin() - CLI_MODE_BIN: collect bytes up to the 0x00 frame delimiter */
+            void rx_bin();
+
+            /* bin_frame() - decode / check the frame in the command buffer and call its handler */
+            void bin_frame();
+
+            /* rx_bulk_echo() - fast path for a run of printable characters typed at the end of the line */
+            uint8_t rx_bulk_echo();
+
+            /* handle_char() - process a single character (editing keys, escape sequences, CR, ...) */
+            void handle_char(char c);
+
+            /* command_too_long() - drop the current line when it doesn't fit in the msg buffer */
+            void command_too_long();
+
+            /* script_run() - run_script() / run_script_P(): one line at a time through parse_std() */
+            uint8_t script_run(const char *script, uint8_t flash, cmd_script_result_t *result, uint8_t flags);
+
             /* point to the appropriate stream, based on what the user has passed */
             void set_stream();
 
             /* initialization for pointers and buffers */
-            void init_buffers();
+            void init_buffers(uint8_t *msg_buf, uint16_t msg_size, char **argv_buf, uint8_t max_args);
 
             /* reset the message pointers */
             void rst_msg_ptr();
@@ -174,11 +1152,28 @@
             /* standard char was passed, add to the buffer and proceed as normal */
             void standard_key(char c);
 
-            /* currently handling ESC commands, so add char to the esc command buffer */
+            #if CMD_PREFIX_INDEX
+                /* tab_key() - complete the command name being typed, or list the candidates */
+                void tab_key();
+            #endif
+
+            /* currently handling ESC commands, so feed the char to the escape sequence decoder */
             void handle_esc_cmd_char(char c);
 
-            /* Check for valid escape commands */
-            void check_esc_cmd();
+            /* key_press() - run the user binding or the default editor action of a decoded key */
+            void key_press(uint8_t key);
+
+            /* edit_action() - perform an editor action (CMD_ACT_x) on the line being edited */
+            void edit_action(uint8_t action);
+
+            /* gap_left() / gap_right() - move the cursor n characters left / right (across the edit gap, and on the terminal) */
+            void gap_left(uint16_t n);
+            void gap_right(uint16_t n);
+
+            #if CMD_KEY_BINDINGS
+                /* key_bind_slot() - binding slot for a key (existing or free), NULL if none is left */
+                cmd_key_binding_t *key_bind_slot(uint8_t key);
+            #endif
 
             /* Escape Command Left Received */
             void esc_cmd_left();
@@ -189,45 +1184,154 @@
             /* Escape Command Up Received */
             void esc_cmd_up();
 
+            /* Escape Command Down Received */
+            void esc_cmd_down();
+
+            /* line_edited() - the line no longer matches the history entry it was recalled from */
+            void line_edited();
+
+            #if CMD_HISTORY_DEPTH
+                /* hist_push() - remember the line about to be executed (consecutive duplicates are stored once) */
+                void hist_push(const char *line, uint16_t len);
+
+                /* hist_recall() - replace the line being edited with a history entry (or an empty line) */
+                void hist_recall(uint8_t slot);
+
+                /* hist_exec() - re-run an unchanged recalled line from its cached parse result */
+                uint8_t hist_exec();
+
+                /* hist_cache() - store the parse result of the line just executed in its history entry */
+                void hist_cache(uint8_t argc, char **argv, cmd_func_t func, cmd_task_t task, cmd_t *entry);
+            #endif
+
             /**
              * @brief Re-print characters from the cursor pointer to the end of the msg buffer
              * @retval Returns the qty of characters printed
             */
             uint16_t cursor_print();
 
+            /* Move the terminal's cursor left / right by n columns (one parameterized sequence instead of n) */
+            void cursor_move(uint16_t n, char dir);
+
             /* Escape Command DEL (delete key) Received */
             void esc_cmd_del();
 
+            /* Redraw the line after a character was removed at the cursor */
+            void tail_redraw();
+
+            /* Length of the line being edited (characters before + after the edit gap) */
+            uint16_t line_len();
+
+            /* Close the edit gap, leaving the line contiguous and NULL terminated at the start of msg (returns its length) */
+            uint16_t line_close();
+
             /* Backspace character */
             void backspace(char _bs_char=CLI_ASCII_DEL);
 
-            /* Simple print, gated by the global boolean */
-            #define cli_print(x) if(_print){_Cereal->print(x);}
+            /* Simple print, gated by the global boolean (coalesced in the TX buffer) */
+            #define cli_print(x) if(_print){_tx.print(x);}
 
-            /* Simple println, gated by the global boolean */
-            #define cli_println(x) if(_print){_Cereal->println(x);}
+            /* Simple println, gated by the global boolean (coalesced in the TX buffer) */
+            #define cli_println(x) if(_print){_tx.println(x);}
 
-            /* Command input buffer */
-            uint8_t msg[CMD_MAX_MSG_SIZE];
+            /* print / println of a string stored in flash (PROGMEM), straight from flash without a RAM copy */
+            #define cli_print_P(x) cli_print((const __FlashStringHelper *)(x))
+            #define cli_println_P(x) cli_println((const __FlashStringHelper *)(x))
 
-            /* Pointer to the Command input buffer */
-            uint8_t *msg_ptr;
+            /* Terminal output coalescing buffer - flushed once per handler() pass and before any user callback */
+            CmdTxBuffer _tx;
+
+            /**
+             * Command input buffer (storage provided by CmdT), used as a gap buffer while the line is edited:
+             *      [msg, _cursor_ptr)                      characters before the cursor
+             *      [_cursor_ptr, _tail_ptr)                the gap (free space)
+             *      [_tail_ptr, _msg_end)                   characters after the cursor
+             * so inserting / deleting at the cursor is O(1) regardless of the line length.
+            */
+            uint8_t *msg;
+
+            /* End of the command input buffer (msg + its size) */
+            uint8_t *_msg_end;
+
+            /* Size of the command input buffer */
+            uint16_t _msg_size;
+
+            /* Tokens of the line being parsed (storage provided by CmdT, _max_args + 1 entries) */
+            char **_argv;
+
+            /* Maximum number of tokens per line */
+            uint8_t _max_args;
+
+            /* End of the edit gap (start of the characters after the cursor) */
+            uint8_t *_tail_ptr;
+
+            /* Receive staging buffer filled by poll() with one readBytes() call */
+            uint8_t _rx_buf[CMD_RX_CHUNK_SIZE];
+
+            /* Position of the next unprocessed byte in the receive staging buffer */
+            uint16_t _rx_pos;
+
+            /* Number of valid bytes in the receive staging buffer */
+            uint16_t _rx_len;
+
+            /* handler() stops at this position in the receive staging buffer (bounded polling) */
+            uint16_t _rx_end;
+
+            /* Bounded polling: micros() when the current poll started, and its time budget (0 = no limit) */
+            uint32_t _poll_start;
+            uint32_t _poll_micros;
+
+            /* JSON stream framing: current brace / bracket depth (0 = between messages) */
+            uint16_t _json_depth;
+
+            /* Framing flags: CLI_JSON_FRAME_x (JSON stream) / CLI_BIN_FRAME_x (binary) */
+            uint8_t _frame_flags;
             
-            /* Custom structure for command table entries */
-            cmd_t *cmd_tbl_list, *cmd_tbl;
+            /* Command table owned by this instance */
+            CmdTable _own_table;
+
+            /* Command table used for dispatch (_own_table unless use_table() was called) */
+            CmdTable *_table;
+
+            /* Cmd instance currently polling / dispatching (per thread when there is a worker) */
+            static CMD_THREAD_LOCAL CmdBase *_active;
+
+            #if CMD_WORKER_QUEUE_SIZE
+                /* Set on the thread running worker_run(), so stream() returns the worker output */
+                static thread_local uint8_t _in_worker;
 
-            /* Escape command input buffer (increase buffer size by one to make it a NULL terminated string )*/
-            uint8_t _esc_cmd[ESC_EXT_CMD_SIZE + 1];
+                /* Worker queue: commands are published by poll() (head) and consumed by worker_run() (tail) */
+                cmd_job_t _worker_jobs[CMD_WORKER_QUEUE_SIZE];
+                uint8_t _worker_head;
+                uint8_t _worker_tail;
 
-            /* Pointer to the escape command buffer */
-            uint8_t *_esc_cmd_ptr;
+                #if CMD_STATS
+                    /* Oldest finished worker job whose handler time poll() hasn't accounted yet (its slot isn't reused before) */
+                    uint8_t _worker_done;
+                #endif
+
+                /* Handler output on its way back from the worker */
+                CmdRing<CMD_WORKER_OUT_SIZE> _worker_ring;
+                CmdWorkerOut _worker_out;
+            #endif
+
+            /* Escape sequence decoder state */
+            cmd_esc_t _esc;
+
+            #if CMD_KEY_BINDINGS
+                /* User key bindings, checked before the built-in ones */
+                cmd_key_binding_t _keys[CMD_KEY_BINDINGS];
+            #endif
 
-            /* Pointer to keep track of the cursor location when performing escape commands */
+            /* Pointer to keep track of the cursor location (start of the edit gap, where the next character goes) */
             uint8_t *_cursor_ptr;
             
             /* Stream pointer to provide support on multiple HW or SW Serial Interfaces (allows flexibility for stream calls)*/
             Stream *_Cereal;
 
+            /* Receive ring the input comes from instead of _Cereal (NULL = read the stream, see attach_ring()) */
+            cmd_ring_t *_ring = NULL;
+
             /* HardwareSerial pointer to provide .begin() support for HW Serial Interfaces */
             HardwareSerial* _hwStream;
 
@@ -236,11 +1340,38 @@
                 SoftwareSerial* _swStream;
             #endif
 
+            #if CMD_HISTORY_DEPTH
+                /* Command history ring (NULL = no history, see attach_history()) */
+                cmd_history_t *_hist = NULL;
+
+                /* How far back Up / Down has browsed (0 = editing a new line) */
+                uint8_t _hist_browse;
+
+                /* History slot the current line was recalled from, while it is unchanged (CMD_HIST_NONE otherwise) */
+                uint8_t _hist_recalled;
+
+                /* History slot matching the line being executed, to receive its parse result (CMD_HIST_NONE if none) */
+                uint8_t _hist_cache_slot;
+            #endif
+
+            /* CMD_EXEC_x - when plain command handlers run */
+            uint8_t _exec_mode;
+
+            #if CMD_STATS
+                /* Runtime counters of this instance */
+                cmd_stats_t _stats;
+            #endif
+
+            #if CMD_JOB_QUEUE_SIZE
+                /* Job queue (NULL = tasks can't be queued, see attach_jobs()) */
+                cmd_jobs_t *_jobs = NULL;
+            #endif
+
             /* Boolean to keep track of whether we've received an exit command */
             uint8_t _exit_cli = false;
 
-            /* Boolean to keep track of whether we've received an extended escape command */
-            uint8_t _ext_esc_cmd = false;
+            /* Set when the last command line failed (unknown command, bad arguments, ...), read by run_script() */
+            uint8_t _cmd_failed = false;
 
             /* Mode variable to keep track of the command line mode */
             uint8_t _mode = CLI_MODE_STD;
@@ -250,6 +1381,161 @@
 
             /* callback function to be called after receiving a JSON message */
             void (*_json_func)(char *json_msg) = NULL;
+
+            /* callback function to be called with the tokens of a JSON message */
+            void (*_json_tok_func)(char *json_msg, cmd_json_tok_t *toks, int16_t tok_count) = NULL;
+
+            /* Token storage, request id and pending request queue of the JSON modes (NULL = none, see attach_json_state()) */
+            cmd_json_state_t *_json = NULL;
+
+            /* the reply writer reads the id and stream of a deferred request, and releases it once the reply is out */
+            friend class CmdJsonWriter;
+    };
+
+    /* Storage of a CmdT instance, a base class so it is in place before CmdBase is constructed */
+    template <uint16_t MsgSize, uint8_t MaxArgs>
+    class CmdStorage
+    {
+        protected:
+            uint8_t _msg_buf[MsgSize];
+            char *_argv_buf[MaxArgs + 1];
+    };
+
+    /**
+     * Command line with its own buffer sizes, e.g. a small one for a debug port next to a large one for the main port:
+     *
+     *      CmdT<128, 8> dbg(&Serial1);
+     *      CmdT<1024, 32> cli(&Serial);
+     *
+     * MsgSize is the longest line (in bytes, including the NULL terminator) and MaxArgs the most tokens per line.
+     * The argv array is part of the instance, so parsing a line uses no stack for it.  Cmd is the instance with the
+     * default sizes (CMD_MAX_MSG_SIZE / CMD_MAX_ARGS).
+    */
+    template <uint16_t MsgSize, uint8_t MaxArgs>
+    class CmdT : private CmdStorage<MsgSize, MaxArgs>, public CmdBase
+    {
+        static_assert(MsgSize >= 2, "cmdArduino: CmdT MsgSize must hold at least one character + the NULL terminator");
+        static_assert(MaxArgs >= 1, "cmdArduino: CmdT MaxArgs must be at least 1 (the command name)");
+        static_assert(MsgSize <= 0x7FFF, "cmdArduino: CmdT MsgSize must be 32767 or less (JSON token offsets are int16_t)");
+
+        public:
+            /* Constructor of CmdT Class - no pointers provided to any streams */
+            CmdT() : CmdBase(this->_msg_buf, MsgSize, this->_argv_buf, MaxArgs) {}
+
+            /* Constructor of CmdT Class - pointers provided to a HardwareSerial stream */
+            CmdT(HardwareSerial *stream) : CmdBase(this->_msg_buf, MsgSize, this->_argv_buf, MaxArgs, stream) {}
+
+            #ifdef SoftwareSerial_h
+                /* Constructor of CmdT Class - pointers provided to a SoftwareSerial stream */
+                CmdT(SoftwareSerial *stream) : CmdBase(this->_msg_buf, MsgSize, this->_argv_buf, MaxArgs, stream) {}
+            #endif
+
+            /**
+             * @brief RAM used by one instance (in bytes), known at compile time:
+             *          static_assert(Cmd::footprint() < 2048, "...");
+             *          Note: commands added at runtime (and the hashed index) are allocated separately, on the heap, and
+             *          an attached CmdHistory / CmdJobs / CmdJsonState is a separate object (add its sizeof)
+            */
+            static constexpr size_t footprint() {return sizeof(CmdT);}
+
+            /* msg_size() / max_args() - the buffer sizes this instance was declared with */
+            static constexpr uint16_t msg_size() {return MsgSize;}
+            static constexpr uint8_t max_args() {return MaxArgs;}
+    };
+
+    /* Command line with the default buffer sizes */
+    typedef CmdT<CMD_MAX_MSG_SIZE, CMD_MAX_ARGS> Cmd;
+
+    #ifndef CMD_MUX_MAX_PORTS
+        #define CMD_MUX_MAX_PORTS 4         // Maximum number of Cmd instances (streams) a CmdMux can poll
+    #endif
+
+    #ifndef CMD_MUX_BYTE_BUDGET
+        #define CMD_MUX_BYTE_BUDGET 64      // Default number of input bytes each port may process per CmdMux::poll() turn
+    #endif
+
+    /**
+     * Command line multiplexer: exposes the same command line on several streams.  All attached ports dispatch from
+     * one shared command table, and are polled round-robin with a per-port byte budget so a busy port can't starve
+     * the others.  Handlers can call Cmd::stream() to reply on the port the command came from.
+    */
+    class CmdMux
+    {
+        public:
+            /* Constructor of CmdMux Class - byte_budget is the number of input bytes each port may process per turn */
+            CmdMux(uint16_t byte_budget = CMD_MUX_BYTE_BUDGET);
+
+            /**
+             * @brief Attach a port (Cmd instance) to the multiplexer.  The port switches to the shared command table.
+             * @retval true if attached, false if CMD_MUX_MAX_PORTS ports are already attached
+            */
+            uint8_t attach(CmdBase *port);
+
+            /**
+             * @brief Poll every attached port once, round-robin (the port that goes first rotates on every call)
+             * @retval true if any port still has input waiting
+            */
+            uint8_t poll();
+
+            /* add() - add a command to the shared command table */
+            void add(const char *name, void (*func)(int argc, char **argv));
+
+            /* add() - add a command with a typed argument schema to the shared command table (see Cmd::add()) */
+            uint8_t add(const char *name, const char *schema, cmd_typed_func_t func);
+
+            /* add_task() - add a task command to the shared command table (see Cmd::add_task()) */
+            void add_task(const char *name, cmd_task_t task);
+
+            /* add_P() - add a command whose name stays in flash to the shared command table (see Cmd::add_P()) */
+            void add_P(const char *name, void (*func)(int argc, char **argv));
+
+            /* add_P() - add a typed command whose name stays in flash to the shared command table */
+            uint8_t add_P(const char *name, const char *schema, cmd_typed_func_t func);
+
+            /* add_task_P() - add a task command whose name stays in flash to the shared command table */
+            void add_task_P(const char *name, cmd_task_t task);
+
+            /* add() - F() name overloads, same as add_P() */
+            void add(const __FlashStringHelper *name, void (*func)(int argc, char **argv)) {add_P((const char *)name, func);}
+            uint8_t add(const __FlashStringHelper *name, const char *schema, cmd_typed_func_t func) {return add_P((const char *)name, schema, func);}
+
+            /* add_bin() - add (or replace) a binary command in the shared command table */
+            void add_bin(uint8_t id, cmd_bin_func_t func);
+
+            /* remove() - remove a command from the shared command table */
+            uint8_t remove(const char *name);
+
+            /* replace() - replace the callback of a command in the shared command table, or add it */
+            uint8_t replace(const char *name, void (*func)(int argc, char **argv));
+
+            /* freeze() - build a hashed index over the shared command table */
+            uint8_t freeze();
+
+            /* add_table() - attach a flash-resident command table to the shared command table */
+            void add_table(const cmd_static_t *tbl, uint16_t count);
+
+            /* add_table() - convenience overload that takes the table size from the array itself */
+            template <size_t N>
+            void add_table(const cmd_static_t (&tbl)[N]) {add_table(tbl, N);}
+
+            /* table() - the shared command table */
+            CmdTable *table();
+
+        private:
+            /* Command table shared by every attached port */
+            CmdTable _table;
+
+            /* Attached ports */
+            CmdBase *_ports[CMD_MUX_MAX_PORTS];
+
+            /* Number of attached ports */
+            uint8_t _port_count;
+
+            /* Port that goes first on the next poll() */
+            uint8_t _next;
+
+            /* Input bytes each port may process per turn */
+            uint16_t _byte_budget;
     };
 
 #endif //CMDARDUINO_H
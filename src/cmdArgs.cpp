@@ -0,0 +1,208 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdArgs.cpp
+
+    Typed argument schemas: schema compiler and the integer / hex / float
+    argument parsers used to validate arguments before dispatch.
+*/
+/**************************************************************************/
+
+/* Included header file */
+#include <Arduino.h>
+#include <errno.h>
+#include "cmdArgs.h"
+
+/* Type names as written in a schema, indexed by CMD_ARG_x (stored in flash to save RAM) */
+static const char cmd_arg_names[][4] PROGMEM = {"", "u8", "u16", "u32", "i8", "i16", "i32", "hex", "f", "str"};
+#define CMD_ARG_TYPE_COUNT (sizeof(cmd_arg_names) / sizeof(cmd_arg_names[0]))
+
+/* Largest magnitude of each integer type, indexed by CMD_ARG_x (signed types: the positive limit) */
+static const uint32_t cmd_arg_max[] PROGMEM = {0, 0xFF, 0xFFFF, 0xFFFFFFFFUL, 0x7F, 0x7FFF, 0x7FFFFFFFUL};
+
+/**************************************************************************/
+/*!
+    Compile a schema string. Each type name becomes one byte, so the schema
+    is only parsed once (when the command is added), not on every dispatch.
+*/
+/**************************************************************************/
+int8_t cmd_schema_compile(const char *schema, uint8_t *out) {
+    uint8_t count = 0;
+    uint8_t optional_seen = false;
+
+    while (*schema) {
+        if (*schema == ' ') {schema++; continue;}
+
+        /* the type name runs up to the next space or '?' */
+        const char *name = schema;
+        while (*schema && *schema != ' ' && *schema != '?') {schema++;}
+        uint8_t len = schema - name;
+
+        uint8_t type = CMD_ARG_NONE;
+        for (uint8_t i = 1; i < CMD_ARG_TYPE_COUNT; i++) {
+            if (len == strlen_P(cmd_arg_names[i]) && !strncmp_P(name, cmd_arg_names[i], len)) {type = i; break;}
+        }
+        if (type == CMD_ARG_NONE || count >= CMD_SCHEMA_MAX_ARGS) {return -1;}
+
+        /* optional arguments can only be followed by other optional arguments */
+        if (*schema == '?') {
+            type |= CMD_ARG_OPTIONAL;
+            optional_seen = true;
+            schema++;
+        } else if (optional_seen) {
+            return -1;
+        }
+
+        out[count++] = type;
+    }
+
+    out[count] = CMD_ARG_NONE;
+    return count;
+}
+
+/* Unsigned decimal: digits only, with overflow checking */
+static uint8_t cmd_arg_parse_dec(const char *str, uint32_t max, uint32_t *val) {
+    uint32_t v = 0;
+
+    if (!*str) {return false;}
+    for (; *str; str++) {
+        uint8_t d = (uint8_t)(*str - '0');
+        if (d > 9 || v > (max - d) / 10) {return false;}
+        v = v * 10 + d;
+    }
+    *val = v;
+    return true;
+}
+
+/* Unsigned hexadecimal: optional 0x prefix, up to 8 digits */
+static uint8_t cmd_arg_parse_hex(const char *str, uint32_t *val) {
+    uint32_t v = 0;
+    uint8_t digits = 0;
+
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {str += 2;}
+    if (!*str) {return false;}
+
+    for (; *str; str++) {
+        uint8_t c = (uint8_t)*str;
+        uint8_t d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            d = (c | 0x20) - 'a' + 10;
+        } else {
+            return false;
+        }
+        if (++digits > 8) {return false;}
+        v = (v << 4) | d;
+    }
+    *val = v;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Parse and range check one argument.
+*/
+/**************************************************************************/
+uint8_t cmd_arg_parse(uint8_t type, const char *str, cmd_arg_t *arg) {
+    arg->type = type;
+
+    switch (type) {
+        case CMD_ARG_U8:
+        case CMD_ARG_U16:
+        case CMD_ARG_U32:
+            return cmd_arg_parse_dec(str, pgm_read_dword(&cmd_arg_max[type]), &arg->val.u);
+
+        case CMD_ARG_I8:
+        case CMD_ARG_I16:
+        case CMD_ARG_I32: {
+            /* the negative limit is one further than the positive limit */
+            uint8_t neg = (*str == '-');
+            uint32_t mag;
+            if (neg || *str == '+') {str++;}
+            if (!cmd_arg_parse_dec(str, pgm_read_dword(&cmd_arg_max[type]) + neg, &mag)) {return false;}
+            arg->val.i = neg ? (int32_t)(0 - mag) : (int32_t)mag;
+            return true;
+        }
+
+        case CMD_ARG_HEX:
+            return cmd_arg_parse_hex(str, &arg->val.u);
+
+        case CMD_ARG_FLOAT: {
+            /* decimal notation only: strtod() would also take nan / inf and hex floats */
+            const char *digits = str + (*str == '-' || *str == '+');
+            if (!isdigit(*digits) && *digits != '.') {return false;}
+            if (strpbrk(digits, "xX")) {return false;}
+
+            char *end;
+            errno = 0;
+            double val = strtod(str, &end);
+            if (!*str || *end || errno == ERANGE) {return false;}
+
+            /* the handler only ever sees finite values, also once narrowed to float (e.g. 1e39 is inf) */
+            arg->val.f = (float)val;
+            return !isnan(arg->val.f) && !isinf(arg->val.f);
+        }
+
+        case CMD_ARG_STR:
+            arg->val.s = str;
+            return true;
+    }
+    return false;
+}
+
+/* cmd_args_parse() - parse argv[] against a compiled schema */
+uint8_t cmd_args_parse(const uint8_t *schema, uint8_t argc, char **argv, cmd_arg_t *args) {
+    uint8_t i;
+
+    for (i = 0; schema[i] != CMD_ARG_NONE; i++) {
+        if (i >= argc) {
+            /* only optional arguments may be left out */
+            if (!(schema[i] & CMD_ARG_OPTIONAL)) {return argc + 1;}
+            args[i].type = CMD_ARG_NONE;
+            args[i].val.u = 0;
+            continue;
+        }
+        if (!cmd_arg_parse(schema[i] & CMD_ARG_TYPE_MASK, argv[i], &args[i])) {return i + 1;}
+    }
+
+    /* too many arguments */
+    return (argc > i) ? argc + 1 : 0;
+}
+
+/* cmd_arg_type_name() - name of an argument type as written in a schema (string in flash, PROGMEM) */
+const char *cmd_arg_type_name(uint8_t type) {
+    type &= CMD_ARG_TYPE_MASK;
+    return cmd_arg_names[type < CMD_ARG_TYPE_COUNT ? type : CMD_ARG_NONE];
+}
@@ -0,0 +1,127 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdArgs.h
+
+    Typed argument schemas. A schema is a space separated list of argument
+    types, e.g. "u8 u32 i16 f hex str", compiled once when the command is
+    added. Before dispatch, every argument is parsed and range checked
+    against it, so handlers receive ready-to-use values and bad input is
+    rejected before any handler code runs.
+
+        u8 u16 u32      unsigned decimal, range checked
+        i8 i16 i32      signed decimal, range checked
+        hex             unsigned hexadecimal (optional 0x prefix), up to 32 bits
+        f               float in decimal notation, finite (nan, inf, hex floats and overflows are rejected)
+        str             any string (points into the command buffer)
+
+    A '?' suffix (e.g. "u8 u8?") makes an argument optional. Optional
+    arguments can only be followed by other optional arguments.
+*/
+/**************************************************************************/
+#ifndef CMDARGS_H
+    #define CMDARGS_H
+
+    /* Include referenced libraries */
+    #include <stdint.h>
+    #include <stddef.h>
+
+    #ifndef CMD_SCHEMA_MAX_ARGS
+        #define CMD_SCHEMA_MAX_ARGS 8       // Maximum number of arguments in an argument schema
+                                            //If more arguments are desired, user can #define CMD_SCHEMA_MAX_ARGS prior to including this library
+    #endif
+
+    /* Argument types (low nibble of a compiled schema byte) */
+    #define CMD_ARG_NONE        0           // end of a compiled schema / argument not given
+    #define CMD_ARG_U8          1
+    #define CMD_ARG_U16         2
+    #define CMD_ARG_U32         3
+    #define CMD_ARG_I8          4
+    #define CMD_ARG_I16         5
+    #define CMD_ARG_I32         6
+    #define CMD_ARG_HEX         7
+    #define CMD_ARG_FLOAT       8
+    #define CMD_ARG_STR         9
+
+    #define CMD_ARG_TYPE_MASK   0x0F        // compiled schema byte: argument type
+    #define CMD_ARG_OPTIONAL    0x80        // compiled schema byte: argument may be left out
+
+    /* A parsed argument.  Unsigned / hex values are in u, signed values in i, floats in f, strings in s. */
+    typedef struct _cmd_arg_t
+    {
+        uint8_t type;       // CMD_ARG_x (CMD_ARG_NONE for an optional argument that wasn't given)
+        union
+        {
+            uint32_t u;
+            int32_t i;
+            float f;
+            const char *s;
+        } val;
+    } cmd_arg_t;
+
+    /**
+     * @brief Compile a schema string into one byte per argument (CMD_ARG_x | CMD_ARG_OPTIONAL), CMD_ARG_NONE terminated
+     * @param schema schema string, e.g. "u8 u32 i16 f hex str"
+     * @param out compiled schema (CMD_SCHEMA_MAX_ARGS + 1 bytes)
+     * @retval number of arguments, or -1 if the schema is invalid
+    */
+    int8_t cmd_schema_compile(const char *schema, uint8_t *out);
+
+    /**
+     * @brief Parse and range check one argument
+     * @param type CMD_ARG_x
+     * @param str argument string
+     * @param arg receives the parsed value
+     * @retval true if the argument is valid for the type
+    */
+    uint8_t cmd_arg_parse(uint8_t type, const char *str, cmd_arg_t *arg);
+
+    /**
+     * @brief Parse argv[] against a compiled schema
+     * @param schema compiled schema
+     * @param argc number of arguments (not counting the command name)
+     * @param argv arguments (not counting the command name)
+     * @param args receives one entry per schema argument (CMD_SCHEMA_MAX_ARGS entries)
+     * @retval 0 if all arguments are valid, otherwise the (1-based) position of the first bad argument,
+     *          or argc + 1 if the number of arguments doesn't match the schema
+    */
+    uint8_t cmd_args_parse(const uint8_t *schema, uint8_t argc, char **argv, cmd_arg_t *args);
+
+    /**
+     * @brief Name of an argument type as written in a schema ("u8", "hex", ...)
+     * @retval the name, stored in flash (PROGMEM)
+    */
+    const char *cmd_arg_type_name(uint8_t type);
+
+#endif //CMDARGS_H
@@ -0,0 +1,144 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdBin.cpp
+
+    COBS framing + CRC16-CCITT for the binary command line mode.
+*/
+/**************************************************************************/
+
+/* Included header file */
+#include <Arduino.h>
+#include "cmdBin.h"
+
+/* Longest run of non-zero bytes a COBS code byte can describe */
+#define CMD_COBS_MAX_RUN 254
+
+/* CRC16-CCITT of each 4-bit value (32 bytes of flash instead of a 512 byte byte-wise table) */
+static const uint16_t cmd_crc16_nibble[16] PROGMEM = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/**************************************************************************/
+/*!
+    CRC16-CCITT, one nibble at a time (two table lookups per byte instead
+    of eight shift / xor steps).
+*/
+/**************************************************************************/
+uint16_t cmd_crc16(uint16_t crc, const uint8_t *data, uint16_t len) {
+    while (len--) {
+        uint8_t b = *data++;
+        crc = (crc << 4) ^ pgm_read_word(&cmd_crc16_nibble[(crc >> 12) ^ (b >> 4)]);
+        crc = (crc << 4) ^ pgm_read_word(&cmd_crc16_nibble[(crc >> 12) ^ (b & 0x0F)]);
+    }
+    return crc;
+}
+
+/**************************************************************************/
+/*!
+    COBS decode in place. The decoded data is never longer than the encoded
+    data, so the write position never passes the read position.
+*/
+/**************************************************************************/
+int32_t cmd_cobs_decode(uint8_t *buf, uint16_t len) {
+    uint16_t rd = 0, wr = 0;
+
+    while (rd < len) {
+        uint8_t code = buf[rd++];
+
+        /* a zero can't appear inside an encoded frame, and a block can't run past the end */
+        if (code == CMD_BIN_DELIM || (uint16_t)(code - 1) > len - rd) {return -1;}
+
+        for (uint8_t i = 1; i < code; i++) {buf[wr++] = buf[rd++];}
+
+        /* every block except a full-length one ends with an implied zero (except at the very end) */
+        if (code != CMD_COBS_MAX_RUN + 1 && rd < len) {buf[wr++] = 0;}
+    }
+    return wr;
+}
+
+/* cmd_bin_decode() - COBS decode a frame in place and check its CRC */
+uint8_t cmd_bin_decode(uint8_t *buf, uint16_t len, uint8_t *id, uint8_t **payload, uint16_t *payload_len) {
+    int32_t frame_len = cmd_cobs_decode(buf, len);
+    if (frame_len < CMD_BIN_OVERHEAD) {return false;}
+
+    uint16_t data_len = frame_len - 2;
+    uint16_t crc = ((uint16_t)buf[data_len] << 8) | buf[data_len + 1];
+    if (cmd_crc16(CMD_BIN_CRC_INIT, buf, data_len) != crc) {return false;}
+
+    *id = buf[0];
+    *payload = buf + 1;
+    *payload_len = data_len - 1;
+    return true;
+}
+
+/* Byte i of the unencoded frame: id, payload, crc_hi, crc_lo */
+static inline uint8_t cmd_bin_frame_byte(uint16_t i, uint8_t id, const uint8_t *payload, uint16_t len, uint16_t crc) {
+    if (i == 0) {return id;}
+    if (i <= len) {return payload[i - 1];}
+    return (i == len + 1) ? (uint8_t)(crc >> 8) : (uint8_t)crc;
+}
+
+/**************************************************************************/
+/*!
+    Encode a frame straight to the output. Each COBS block is found by
+    scanning ahead for the next zero, so nothing has to be buffered.
+*/
+/**************************************************************************/
+size_t cmd_bin_write(Print *out, uint8_t id, const uint8_t *payload, uint16_t len) {
+    uint16_t crc = cmd_crc16(CMD_BIN_CRC_INIT, &id, 1);
+    crc = cmd_crc16(crc, payload, len);
+
+    uint32_t frame_len = (uint32_t)len + CMD_BIN_OVERHEAD;
+    uint32_t i = 0;
+    size_t n = 0;
+
+    while (true) {
+        /* find the end of this block: the next zero, the end of the frame, or a full-length run */
+        uint32_t j = i;
+        while (j < frame_len && (j - i) < CMD_COBS_MAX_RUN && cmd_bin_frame_byte(j, id, payload, len, crc) != 0) {j++;}
+
+        n += out->write((uint8_t)(j - i + 1));
+        for (uint32_t k = i; k < j; k++) {n += out->write(cmd_bin_frame_byte(k, id, payload, len, crc));}
+
+        if (j >= frame_len) {break;}
+
+        /* skip the zero the block stands in for (a full-length run has none, the next block starts right here) */
+        i = ((j - i) == CMD_COBS_MAX_RUN) ? j : j + 1;
+    }
+
+    n += out->write((uint8_t)CMD_BIN_DELIM);
+    return n;
+}
@@ -0,0 +1,88 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdBin.h
+
+    Binary framing used by CLI_MODE_BIN. A frame is a command ID, the
+    payload and a CRC16-CCITT (big endian) over both, COBS encoded so the
+    0x00 byte only ever appears as the frame delimiter:
+
+        COBS( id | payload ... | crc_hi | crc_lo ) 0x00
+
+    COBS adds one byte per 254 bytes of frame, so a receiver can
+    resynchronize on the next 0x00 after any corrupted or truncated frame.
+*/
+/**************************************************************************/
+#ifndef CMDBIN_H
+    #define CMDBIN_H
+
+    /* Include referenced libraries */
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <Print.h>
+
+    #define CMD_BIN_DELIM           0x00    // frame delimiter
+    #define CMD_BIN_OVERHEAD        3       // id + CRC16 bytes around the payload (before COBS encoding)
+    #define CMD_BIN_CRC_INIT        0xFFFF  // CRC16-CCITT initial value
+
+    /**
+     * @brief Update a CRC16-CCITT (polynomial 0x1021, MSB first, start with CMD_BIN_CRC_INIT)
+     * @retval the updated CRC
+    */
+    uint16_t cmd_crc16(uint16_t crc, const uint8_t *data, uint16_t len);
+
+    /**
+     * @brief Decode a COBS block in place (without its 0x00 delimiter)
+     * @retval decoded length, or -1 if the block is malformed
+    */
+    int32_t cmd_cobs_decode(uint8_t *buf, uint16_t len);
+
+    /**
+     * @brief Decode a received frame in place (without its 0x00 delimiter) and check its CRC
+     * @param buf encoded frame, overwritten with the decoded frame
+     * @param len encoded length
+     * @param id receives the command ID
+     * @param payload receives a pointer to the payload (inside buf)
+     * @param payload_len receives the payload length
+     * @retval true if the frame is well formed and the CRC matches
+    */
+    uint8_t cmd_bin_decode(uint8_t *buf, uint16_t len, uint8_t *id, uint8_t **payload, uint16_t *payload_len);
+
+    /**
+     * @brief Encode a frame straight to a Print / Stream (no intermediate buffer), including the 0x00 delimiter
+     * @retval number of bytes written
+    */
+    size_t cmd_bin_write(Print *out, uint8_t id, const uint8_t *payload, uint16_t len);
+
+#endif //CMDBIN_H
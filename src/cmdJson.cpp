@@ -0,0 +1,404 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdJson.cpp
+
+    Allocation-free, in-place JSON tokenizer. Follows the same single pass
+    design as jsmn (strict mode, with parent links): the parser never
+    copies the input, it only records where each token starts and ends.
+*/
+/**************************************************************************/
+
+/* Included header file */
+#include "cmdJson.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocate a fresh token from the token array */
+static cmd_json_tok_t *cmd_json_alloc_token(cmd_json_parser_t *parser, cmd_json_tok_t *toks, uint16_t num_toks) {
+    if (parser->toknext >= (int16_t)num_toks) {return NULL;}
+
+    cmd_json_tok_t *tok = &toks[parser->toknext++];
+    tok->start = tok->end = -1;
+    tok->size = 0;
+    tok->parent = -1;
+    return tok;
+}
+
+/* Fill in the type and boundaries of a token */
+static void cmd_json_fill_token(cmd_json_tok_t *tok, uint8_t type, int16_t start, int16_t end) {
+    tok->type = type;
+    tok->start = start;
+    tok->end = end;
+    tok->size = 0;
+}
+
+/* Check a digit run, returns the position just past it (or start if there are no digits) */
+static const char *cmd_json_digits(const char *p, const char *end) {
+    while (p < end && *p >= '0' && *p <= '9') {p++;}
+    return p;
+}
+
+/* Check that a primitive is true, false, null or a number: -?digits(.digits)?([eE][+-]?digits)? or -?0x hexdigits */
+static uint8_t cmd_json_valid_primitive(const char *p, uint16_t len) {
+    const char *end = p + len;
+
+    if ((len == 4 && !strncmp(p, "true", 4)) || (len == 5 && !strncmp(p, "false", 5)) || (len == 4 && !strncmp(p, "null", 4))) {return true;}
+
+    if (p < end && *p == '-') {p++;}
+
+    /* hex integer, as accepted by cmd_json_int() */
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        for (p += 2; p < end; p++) {
+            if (!isxdigit((unsigned char)*p)) {return false;}
+        }
+        return true;
+    }
+
+    const char *q = cmd_json_digits(p, end);
+    if (q == p) {return false;}
+    p = q;
+
+    if (p < end && *p == '.') {
+        q = cmd_json_digits(++p, end);
+        if (q == p) {return false;}
+        p = q;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {p++;}
+        q = cmd_json_digits(p, end);
+        if (q == p) {return false;}
+        p = q;
+    }
+
+    return p == end;
+}
+
+/* Parse a primitive (number, true, false, null) and fill the next token */
+static int16_t cmd_json_parse_primitive(cmd_json_parser_t *parser, const char *js, uint16_t len, cmd_json_tok_t *toks, uint16_t num_toks) {
+    uint16_t start = parser->pos;
+
+    for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
+        switch (js[parser->pos]) {
+            case '\t':
+            case '\r':
+            case '\n':
+            case ' ':
+            case ',':
+            case ']':
+            case '}':
+                goto found;
+            default:
+                break;
+        }
+        if (js[parser->pos] < 32 || js[parser->pos] >= 127) {
+            parser->pos = start;
+            return CMD_JSON_ERROR_INVAL;
+        }
+    }
+
+    /* a primitive must be followed by a separator or a closing bracket */
+    parser->pos = start;
+    return CMD_JSON_ERROR_PART;
+
+found:
+    if (!cmd_json_valid_primitive(js + start, parser->pos - start)) {
+        parser->pos = start;
+        return CMD_JSON_ERROR_INVAL;
+    }
+
+    if (toks == NULL) {
+        parser->pos--;
+        return 0;
+    }
+
+    cmd_json_tok_t *tok = cmd_json_alloc_token(parser, toks, num_toks);
+    if (tok == NULL) {
+        parser->pos = start;
+        return CMD_JSON_ERROR_NOMEM;
+    }
+    cmd_json_fill_token(tok, CMD_JSON_PRIMITIVE, start, parser->pos);
+    tok->parent = parser->toksuper;
+
+    /* the main loop advances past the separator */
+    parser->pos--;
+    return 0;
+}
+
+/* Parse a quoted string and fill the next token (the token excludes the quotes) */
+static int16_t cmd_json_parse_string(cmd_json_parser_t *parser, const char *js, uint16_t len, cmd_json_tok_t *toks, uint16_t num_toks) {
+    uint16_t start = parser->pos;
+
+    /* skip the opening quote */
+    parser->pos++;
+
+    for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
+        char c = js[parser->pos];
+
+        /* end of string */
+        if (c == '\"') {
+            if (toks == NULL) {return 0;}
+
+            cmd_json_tok_t *tok = cmd_json_alloc_token(parser, toks, num_toks);
+            if (tok == NULL) {
+                parser->pos = start;
+                return CMD_JSON_ERROR_NOMEM;
+            }
+            cmd_json_fill_token(tok, CMD_JSON_STRING, start + 1, parser->pos);
+            tok->parent = parser->toksuper;
+            return 0;
+        }
+
+        /* backslash: only the escapes allowed by the JSON spec */
+        if (c == '\\' && parser->pos + 1 < len) {
+            parser->pos++;
+            switch (js[parser->pos]) {
+                case '\"':
+                case '/':
+                case '\\':
+                case 'b':
+                case 'f':
+                case 'r':
+                case 'n':
+                case 't':
+                    break;
+                case 'u':
+                    /* \uXXXX - exactly 4 hex digits */
+                    parser->pos++;
+                    for (uint8_t i = 0; i < 4 && parser->pos < len && js[parser->pos] != '\0'; i++) {
+                        if (!isxdigit((unsigned char)js[parser->pos])) {
+                            parser->pos = start;
+                            return CMD_JSON_ERROR_INVAL;
+                        }
+                        parser->pos++;
+                    }
+                    parser->pos--;
+                    break;
+                default:
+                    parser->pos = start;
+                    return CMD_JSON_ERROR_INVAL;
+            }
+        }
+    }
+
+    parser->pos = start;
+    return CMD_JSON_ERROR_PART;
+}
+
+/* What may follow a complete value: a separator or the end of its container, nothing at the root */
+static uint8_t cmd_json_after_value(const cmd_json_parser_t *parser) {
+    return parser->depth ? (CMD_JSON_EXPECT_COMMA | CMD_JSON_EXPECT_CLOSE) : 0;
+}
+
+/* Whether the innermost open container is an array */
+static uint8_t cmd_json_in_array(const cmd_json_parser_t *parser) {
+    return (parser->arrays >> (parser->depth - 1)) & 1;
+}
+
+/* Reset a tokenizer before parsing a new message */
+void cmd_json_init(cmd_json_parser_t *parser) {
+    parser->pos = 0;
+    parser->toknext = 0;
+    parser->toksuper = -1;
+    parser->expect = CMD_JSON_EXPECT_VALUE;
+    parser->depth = 0;
+    parser->arrays = 0;
+}
+
+/* Tokenize a JSON message in place (nothing is copied or allocated) */
+int16_t cmd_json_parse(cmd_json_parser_t *parser, const char *js, uint16_t len, cmd_json_tok_t *toks, uint16_t num_toks) {
+    int16_t r;
+    int16_t count = parser->toknext;
+    cmd_json_tok_t *tok;
+
+    for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
+        char c = js[parser->pos];
+
+        switch (c) {
+            case '{':
+            case '[':
+                /* the structure is checked with the container stack, so it works without a token array too */
+                if (!(parser->expect & CMD_JSON_EXPECT_VALUE)) {return CMD_JSON_ERROR_INVAL;}
+                if (parser->depth >= CMD_JSON_MAX_DEPTH) {return CMD_JSON_ERROR_NOMEM;}
+                if (c == '[') {
+                    parser->arrays |= ((uint32_t)1 << parser->depth);
+                } else {
+                    parser->arrays &= ~((uint32_t)1 << parser->depth);
+                }
+                parser->depth++;
+                parser->expect = (c == '{' ? CMD_JSON_EXPECT_KEY : CMD_JSON_EXPECT_VALUE) | CMD_JSON_EXPECT_CLOSE;
+
+                count++;
+                if (toks == NULL) {break;}
+
+                tok = cmd_json_alloc_token(parser, toks, num_toks);
+                if (tok == NULL) {return CMD_JSON_ERROR_NOMEM;}
+
+                if (parser->toksuper != -1) {
+                    toks[parser->toksuper].size++;
+                    tok->parent = parser->toksuper;
+                }
+                tok->type = (c == '{' ? CMD_JSON_OBJECT : CMD_JSON_ARRAY);
+                tok->start = parser->pos;
+                parser->toksuper = parser->toknext - 1;
+                break;
+
+            case '}':
+            case ']':
+                if (!(parser->expect & CMD_JSON_EXPECT_CLOSE) || cmd_json_in_array(parser) != (c == ']')) {return CMD_JSON_ERROR_INVAL;}
+                parser->depth--;
+                parser->expect = cmd_json_after_value(parser);
+
+                if (toks == NULL) {break;}
+
+                /* walk up to the innermost container that is still open */
+                tok = &toks[parser->toknext - 1];
+                while (tok->start == -1 || tok->end != -1) {tok = &toks[tok->parent];}
+                tok->end = parser->pos + 1;
+                parser->toksuper = tok->parent;
+                break;
+
+            case '\"':
+                if (!(parser->expect & (CMD_JSON_EXPECT_KEY | CMD_JSON_EXPECT_VALUE))) {return CMD_JSON_ERROR_INVAL;}
+                r = cmd_json_parse_string(parser, js, len, toks, num_toks);
+                if (r < 0) {return r;}
+                count++;
+                if (parser->toksuper != -1 && toks != NULL) {toks[parser->toksuper].size++;}
+                parser->expect = (parser->expect & CMD_JSON_EXPECT_KEY) ? CMD_JSON_EXPECT_COLON : cmd_json_after_value(parser);
+                break;
+
+            case '\t':
+            case '\r':
+            case '\n':
+            case ' ':
+                break;
+
+            case ':':
+                if (!(parser->expect & CMD_JSON_EXPECT_COLON)) {return CMD_JSON_ERROR_INVAL;}
+                parser->expect = CMD_JSON_EXPECT_VALUE;
+
+                /* the value that follows belongs to the key just parsed */
+                parser->toksuper = parser->toknext - 1;
+                break;
+
+            case ',':
+                if (!(parser->expect & CMD_JSON_EXPECT_COMMA)) {return CMD_JSON_ERROR_INVAL;}
+                parser->expect = cmd_json_in_array(parser) ? CMD_JSON_EXPECT_VALUE : CMD_JSON_EXPECT_KEY;
+
+                /* done with a key/value pair - go back up to the enclosing object */
+                if (toks != NULL && toks[parser->toksuper].type != CMD_JSON_ARRAY && toks[parser->toksuper].type != CMD_JSON_OBJECT) {
+                    parser->toksuper = toks[parser->toksuper].parent;
+                }
+                break;
+
+            case '-':
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+            case 't':
+            case 'f':
+            case 'n':
+                /* primitives can't be keys, and a key only takes one value */
+                if (!(parser->expect & CMD_JSON_EXPECT_VALUE)) {return CMD_JSON_ERROR_INVAL;}
+                r = cmd_json_parse_primitive(parser, js, len, toks, num_toks);
+                if (r < 0) {return r;}
+                count++;
+                if (parser->toksuper != -1 && toks != NULL) {toks[parser->toksuper].size++;}
+                parser->expect = cmd_json_after_value(parser);
+                break;
+
+            default:
+                /* unexpected character */
+                return CMD_JSON_ERROR_INVAL;
+        }
+    }
+
+    /* any container left open means the message was cut short */
+    if (parser->depth) {return CMD_JSON_ERROR_PART;}
+
+    return count;
+}
+
+/* Compare a string / primitive token against a NULL terminated string */
+uint8_t cmd_json_eq(const char *js, const cmd_json_tok_t *tok, const char *s) {
+    if (tok->type != CMD_JSON_STRING && tok->type != CMD_JSON_PRIMITIVE) {return false;}
+
+    size_t len = tok->end - tok->start;
+    return (strlen(s) == len) && !strncmp(js + tok->start, s, len);
+}
+
+/* Index of the token following the subtree rooted at tok_idx (i.e. its next sibling) */
+int16_t cmd_json_skip(const cmd_json_tok_t *toks, int16_t tok_count, int16_t tok_idx) {
+    int16_t end = toks[tok_idx].end;
+
+    /* children always start inside their parent's span */
+    for (tok_idx++; tok_idx < tok_count && toks[tok_idx].start < end; tok_idx++) {}
+    return tok_idx;
+}
+
+/* Look up a key in an object */
+int16_t cmd_json_find(const char *js, const cmd_json_tok_t *toks, int16_t tok_count, int16_t obj_idx, const char *key) {
+    if (obj_idx < 0 || obj_idx >= tok_count || toks[obj_idx].type != CMD_JSON_OBJECT) {return -1;}
+
+    int16_t i = obj_idx + 1;
+    for (int16_t n = 0; n < toks[obj_idx].size && i + 1 < tok_count; n++) {
+        /* tokens alternate key, value (the value may be a whole subtree) */
+        int16_t value = i + 1;
+        if (cmd_json_eq(js, &toks[i], key)) {return value;}
+        i = cmd_json_skip(toks, tok_count, value);
+    }
+
+    return -1;
+}
+
+/* Convert a primitive token to an integer */
+int32_t cmd_json_int(const char *js, const cmd_json_tok_t *tok) {
+    return strtol(js + tok->start, NULL, 0);
+}
+
+/* NULL terminate a token in place and return a pointer to it */
+char *cmd_json_str(char *js, const cmd_json_tok_t *tok) {
+    js[tok->end] = '\0';
+    return js + tok->start;
+}
@@ -0,0 +1,141 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdJson.h
+
+    Allocation-free, in-place JSON tokenizer (in the style of jsmn) used by
+    the JSON command line modes. The message is never copied: each token is
+    a span (start/end offsets) into the original buffer, so callbacks can
+    look up keys and values without a JSON library.
+*/
+/**************************************************************************/
+#ifndef CMDJSON_H
+    #define CMDJSON_H
+
+    /* Include referenced libraries */
+    #include <stdint.h>
+    #include <stddef.h>
+
+    /* Token types */
+    #define CMD_JSON_UNDEFINED      0
+    #define CMD_JSON_OBJECT         1
+    #define CMD_JSON_ARRAY          2
+    #define CMD_JSON_STRING         3
+    #define CMD_JSON_PRIMITIVE      4       // number, true, false or null
+
+    /* Error codes returned by cmd_json_parse() */
+    #define CMD_JSON_ERROR_NOMEM    -1      // not enough tokens were provided (or the message nests deeper than CMD_JSON_MAX_DEPTH)
+    #define CMD_JSON_ERROR_INVAL    -2      // invalid character inside the JSON string
+    #define CMD_JSON_ERROR_PART     -3      // the string is not a full JSON packet, more bytes expected
+
+    /* JSON token: a span of the original message, plus its place in the tree */
+    typedef struct _cmd_json_tok_t
+    {
+        uint8_t type;       // CMD_JSON_OBJECT, CMD_JSON_ARRAY, ...
+        int16_t start;      // offset of the first character (strings: just after the opening quote)
+        int16_t end;        // offset just past the last character (strings: the closing quote)
+        int16_t size;       // number of children (objects count keys, keys count their value)
+        int16_t parent;     // index of the parent token, -1 for the root
+    } cmd_json_tok_t;
+
+    /* What the tokenizer accepts next (cmd_json_parser_t::expect), so members must be separated and keys followed by ':' */
+    #define CMD_JSON_EXPECT_VALUE   0x01    // a value: object, array, string or primitive
+    #define CMD_JSON_EXPECT_KEY     0x02    // an object key
+    #define CMD_JSON_EXPECT_COLON   0x04    // the ':' after a key
+    #define CMD_JSON_EXPECT_COMMA   0x08    // the ',' before the next member / element
+    #define CMD_JSON_EXPECT_CLOSE   0x10    // the closing brace / bracket of the innermost container
+
+    #define CMD_JSON_MAX_DEPTH      32      // deepest nesting of objects / arrays (one bit each in cmd_json_parser_t::arrays)
+
+    /* Tokenizer state, so a message can be parsed in several calls */
+    typedef struct _cmd_json_parser_t
+    {
+        uint16_t pos;       // offset of the next character to parse
+        int16_t toknext;    // next token to allocate
+        int16_t toksuper;   // parent token of the value being parsed (-1 at the root)
+        uint8_t expect;     // CMD_JSON_EXPECT_x flags, 0 once the root value is complete
+        uint8_t depth;      // number of objects / arrays currently open
+        uint32_t arrays;    // bit n set: the container open at depth n is an array
+    } cmd_json_parser_t;
+
+    /**
+     * @brief Reset a tokenizer before parsing a new message
+    */
+    void cmd_json_init(cmd_json_parser_t *parser);
+
+    /**
+     * @brief Tokenize a JSON message in place (nothing is copied or allocated).  The structure is checked strictly
+     *          (separators, key / value order, one root value) and so are primitives: true, false, null or a number.
+     *          Numbers are more lenient than the JSON grammar in two ways, both understood by cmd_json_int(): leading
+     *          zeros are allowed, and so is a 0x.. hex integer.  Counting tokens only (toks == NULL) checks the
+     *          message just as strictly, so it also works as a validator that needs no token array.
+     * @param js JSON message
+     * @param len length of the message in bytes
+     * @param toks token array to fill (or NULL to only count the tokens required)
+     * @param num_toks number of entries in the token array
+     * @retval number of tokens used, or a negative CMD_JSON_ERROR_x code
+    */
+    int16_t cmd_json_parse(cmd_json_parser_t *parser, const char *js, uint16_t len, cmd_json_tok_t *toks, uint16_t num_toks);
+
+    /**
+     * @brief Compare a string / primitive token against a NULL terminated string
+     * @retval true if the token matches
+    */
+    uint8_t cmd_json_eq(const char *js, const cmd_json_tok_t *tok, const char *s);
+
+    /**
+     * @brief Index of the token following the subtree rooted at tok_idx (i.e. its next sibling)
+    */
+    int16_t cmd_json_skip(const cmd_json_tok_t *toks, int16_t tok_count, int16_t tok_idx);
+
+    /**
+     * @brief Look up a key in an object
+     * @param obj_idx index of the object token (0 for the root object)
+     * @retval index of the value token, or -1 if the key isn't present
+    */
+    int16_t cmd_json_find(const char *js, const cmd_json_tok_t *toks, int16_t tok_count, int16_t obj_idx, const char *key);
+
+    /**
+     * @brief Convert a primitive token to an integer (strtol() semantics, base auto-detected: 10, 0x.. hex, 0.. octal)
+    */
+    int32_t cmd_json_int(const char *js, const cmd_json_tok_t *tok);
+
+    /**
+     * @brief NULL terminate a token in place and return a pointer to it.
+     *          Note: this overwrites the character just past the token (a quote, comma or bracket). The tokens are
+     *          offsets, so the rest of the token array stays valid, but the buffer can no longer be re-tokenized.
+    */
+    char *cmd_json_str(char *js, const cmd_json_tok_t *tok);
+
+#endif //CMDJSON_H
@@ -0,0 +1,376 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdJsonWriter.cpp
+
+    Streaming JSON reply writer (see cmdJsonWriter.h)
+*/
+/**************************************************************************/
+#include "cmdArduino.h"
+
+/* Bit of the container at the current depth (containers nested deeper than CMD_JSON_OUT_MAX_DEPTH have none) */
+#define CMD_JSON_OUT_BIT(depth)     ((depth) && (depth) <= CMD_JSON_OUT_MAX_DEPTH ? (uint32_t)1 << ((depth) - 1) : 0)
+
+/**************************************************************************/
+/*!
+    constructor - reply on the given Print, or on the stream of the command being dispatched
+*/
+/**************************************************************************/
+CmdJsonWriter::CmdJsonWriter(Print *out) {
+    CmdBase *cmd = CmdBase::active();
+    if (out == NULL && cmd != NULL) {
+        out = CmdBase::stream();
+        _id = cmd->json_id();
+    }
+    if (out == NULL) {out = &Serial;}
+    _out = out;
+}
+
+/**************************************************************************/
+/*!
+    constructor - reply to a deferred request
+*/
+/**************************************************************************/
+CmdJsonWriter::CmdJsonWriter(CmdBase *cmd, uint8_t ticket) {
+    // on the worker, the reply travels back through poll() like the rest of the handler output
+    _out = CmdBase::in_worker() ? CmdBase::stream() : cmd->_Cereal;
+
+    #if CMD_JSON_PENDING
+        cmd_json_state_t *json = cmd->_json;
+        if (json != NULL && ticket < CMD_JSON_PENDING && (cmd_ring_load(&json->pending_used) & (1 << ticket))) {
+            _cmd = cmd;
+            _ticket = ticket;
+            if (json->pending[ticket][0]) {_id = json->pending[ticket];}
+        }
+    #endif
+}
+
+/**************************************************************************/
+/*!
+    destructor - anything left open is closed so the reply is still valid JSON
+*/
+/**************************************************************************/
+CmdJsonWriter::~CmdJsonWriter() {
+    end();
+}
+
+/* begin_object() - open an object */
+void CmdJsonWriter::begin_object(const char *key) {
+    open('{', key);
+}
+
+/* begin_array() - open an array */
+void CmdJsonWriter::begin_array(const char *key) {
+    open('[', key);
+}
+
+/* end_object() - close the innermost container, which should be an object */
+void CmdJsonWriter::end_object() {
+    close(false);
+}
+
+/* end_array() - close the innermost container, which should be an array */
+void CmdJsonWriter::end_array() {
+    close(true);
+}
+
+/* key() - name of the next value (only valid inside an object) */
+void CmdJsonWriter::key(const char *name) {
+    uint32_t bit = CMD_JSON_OUT_BIT(_depth);
+    if (!_depth || _after_key || (_is_array & bit)) {_error = true;}
+
+    separator();
+    string(name, false);
+    write(':');
+    _after_key = true;
+}
+
+/* value() - string from RAM */
+void CmdJsonWriter::value(const char *str) {
+    separator();
+    if (str == NULL) {
+        print(F("null"));
+    } else {
+        string(str, false);
+    }
+    done();
+}
+
+/* value() - string from flash (F("...")) */
+void CmdJsonWriter::value(const __FlashStringHelper *str) {
+    separator();
+    string((const char *)str, true);
+    done();
+}
+
+/* value() - true / false */
+void CmdJsonWriter::value(bool b) {
+    separator();
+    print(b ? F("true") : F("false"));
+    done();
+}
+
+/* value() - integers, formatted by Print straight into the buffer */
+void CmdJsonWriter::value(int n) {
+    separator();
+    print(n);
+    done();
+}
+
+void CmdJsonWriter::value(unsigned int n) {
+    separator();
+    print(n);
+    done();
+}
+
+void CmdJsonWriter::value(long n) {
+    separator();
+    print(n);
+    done();
+}
+
+void CmdJsonWriter::value(unsigned long n) {
+    separator();
+    print(n);
+    done();
+}
+
+/* value() - floating point, NaN / infinity have no JSON form and are written as null */
+void CmdJsonWriter::value(double n, uint8_t digits) {
+    separator();
+    if (isnan(n) || isinf(n)) {
+        print(F("null"));
+    } else {
+        print(n, digits);
+    }
+    done();
+}
+
+/* value_null() - a JSON null */
+void CmdJsonWriter::value_null() {
+    separator();
+    print(F("null"));
+    done();
+}
+
+/* raw() - pre-formatted JSON, copied as is */
+void CmdJsonWriter::raw(const char *json) {
+    separator();
+    write(json);
+    done();
+}
+
+/**************************************************************************/
+/*!
+    end() - close everything still open, terminate the reply and push it
+    out.  Also called by the destructor, so a handler that returns early
+    still sends well-formed JSON.
+*/
+/**************************************************************************/
+void CmdJsonWriter::end() {
+    // a key without its value
+    if (_after_key) {value_null();}
+
+    while (_depth) {
+        close((_is_array & CMD_JSON_OUT_BIT(_depth)) != 0);
+    }
+    flush_buf();
+}
+
+/* separator() - comma between the members of a container */
+void CmdJsonWriter::separator() {
+    if (_after_key) {
+        _after_key = false;
+        return;
+    }
+
+    uint32_t bit = CMD_JSON_OUT_BIT(_depth);
+    if (_has_items & bit) {write(',');}
+    _has_items |= bit;
+}
+
+/* done() - a value at the top level is the whole reply: terminate the line, flush, and close a deferred request */
+void CmdJsonWriter::done() {
+    if (_depth) {return;}
+
+    write('\r');
+    write('\n');
+    flush_buf();
+
+    #if CMD_JSON_PENDING
+        if (_cmd != NULL) {
+            _cmd->json_release(_ticket);
+            _cmd = NULL;
+            _id = NULL;
+        }
+    #endif
+}
+
+/* open() - write the bracket and push a level */
+void CmdJsonWriter::open(char bracket, const char *key) {
+    if (key != NULL) {
+        this->key(key);
+    }
+    separator();
+    write(bracket);
+
+    if (_depth == 0xFF) {
+        _error = true;
+        return;
+    }
+    _depth++;
+
+    uint32_t bit = CMD_JSON_OUT_BIT(_depth);
+    if (!bit) {
+        // too deep to track: brackets still balance, but commas at this level are missing
+        _error = true;
+        return;
+    }
+    _has_items &= ~bit;
+    if (bracket == '[') {
+        _is_array |= bit;
+    } else {
+        _is_array &= ~bit;
+    }
+
+    // a reply object starts with the id of the request it answers
+    if (_depth == 1 && bracket == '{' && _id != NULL) {
+        write("\"id\":");
+        write(_id);
+        _has_items |= bit;
+    }
+}
+
+/* close() - write the closing bracket of the innermost container and pop a level */
+void CmdJsonWriter::close(uint8_t is_array) {
+    if (!_depth) {
+        _error = true;
+        return;
+    }
+
+    // a key without its value
+    if (_after_key) {
+        _error = true;
+        value_null();
+    }
+
+    // always close what is actually open, so the output stays balanced
+    uint32_t bit = CMD_JSON_OUT_BIT(_depth);
+    if (bit) {
+        uint8_t open_array = (_is_array & bit) != 0;
+        if (open_array != (is_array != 0)) {_error = true;}
+        is_array = open_array;
+    }
+
+    write(is_array ? ']' : '}');
+    _depth--;
+    done();
+}
+
+/**************************************************************************/
+/*!
+    string() - write a quoted string, escaping quotes, backslashes and
+    control characters.  Runs of plain characters from RAM are copied in
+    one block.
+*/
+/**************************************************************************/
+void CmdJsonWriter::string(const char *str, uint8_t flash) {
+    write('"');
+
+    const char *run = str;
+    for (;;) {
+        char c = flash ? (char)pgm_read_byte(str) : *str;
+        uint8_t plain = ((uint8_t)c >= 0x20) && (c != '"') && (c != '\\');
+
+        if (plain) {
+            if (flash) {write((uint8_t)c);}
+            str++;
+            continue;
+        }
+
+        // flush the run of plain characters before this one
+        if (!flash && str > run) {write((const uint8_t *)run, str - run);}
+        if (!c) {break;}
+
+        write('\\');
+        switch (c) {
+            case '"':   write('"');  break;
+            case '\\':  write('\\'); break;
+            case '\n':  write('n');  break;
+            case '\r':  write('r');  break;
+            case '\t':  write('t');  break;
+            case '\b':  write('b');  break;
+            case '\f':  write('f');  break;
+            default:
+                // other control characters: \u00XX
+                write('u');
+                write('0');
+                write('0');
+                write('0' + (c >> 4));
+                write((c & 0x0F) < 10 ? '0' + (c & 0x0F) : 'a' + (c & 0x0F) - 10);
+                break;
+        }
+        run = ++str;
+    }
+
+    write('"');
+}
+
+/* write() - buffer a single character, flushing first if full */
+size_t CmdJsonWriter::write(uint8_t c) {
+    if (_len == CMD_JSON_OUT_BUF_SIZE) {flush_buf();}
+    _buf[_len++] = c;
+    return 1;
+}
+
+/* write() - buffer a block of characters (blocks larger than the buffer go straight to the stream) */
+size_t CmdJsonWriter::write(const uint8_t *buffer, size_t size) {
+    if (_len + size > CMD_JSON_OUT_BUF_SIZE) {flush_buf();}
+
+    if (size >= CMD_JSON_OUT_BUF_SIZE) {
+        return _out->write(buffer, size);
+    }
+
+    memcpy(_buf + _len, buffer, size);
+    _len += size;
+    return size;
+}
+
+/* flush_buf() - write out anything buffered */
+void CmdJsonWriter::flush_buf() {
+    if (_len) {
+        _out->write(_buf, _len);
+        _len = 0;
+    }
+}
@@ -0,0 +1,183 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdJsonWriter.h
+
+    Streaming JSON writer for replies in the JSON command line modes.
+    Objects, arrays, numbers and escaped strings are written straight into
+    a small fixed buffer that is flushed to the stream in chunks: there is
+    no heap, no String and no intermediate copy of the whole reply.
+
+    Commas and nesting are tracked by the writer, so a handler only says
+    what goes in the reply:
+
+        CmdJsonWriter out;                  // replies on Cmd::stream()
+        out.begin_object();
+        out.field("temp", 23);
+        out.begin_array("adc");
+        for (uint8_t i = 0; i < 4; i++) {out.value(analogRead(i));}
+        out.end_array();
+        out.end_object();                   // {"temp":23,"adc":[...]}\r\n
+
+    When the request carried an "id", the writer adds it to the reply
+    ({"id":7,"temp":23,...}), so the host can match replies to requests
+    that are still in flight.
+*/
+/**************************************************************************/
+#ifndef CMDJSONWRITER_H
+    #define CMDJSONWRITER_H
+
+    /* Include referenced libraries */
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <Print.h>
+
+    #ifndef CMD_JSON_OUT_BUF_SIZE
+        #define CMD_JSON_OUT_BUF_SIZE 32    // Size of the reply buffer, flushed to the stream each time it fills up
+                                            //If a different size is desired, user can #define CMD_JSON_OUT_BUF_SIZE prior to including this library
+    #endif
+
+    #ifndef CMD_JSON_OUT_MAX_DEPTH
+        #define CMD_JSON_OUT_MAX_DEPTH 8    // Maximum nesting of objects / arrays in a reply (32 at most)
+                                            //If deeper replies are desired, user can #define CMD_JSON_OUT_MAX_DEPTH prior to including this library
+    #endif
+
+    #if CMD_JSON_OUT_MAX_DEPTH > 32
+        #error "CMD_JSON_OUT_MAX_DEPTH must be 32 or less"
+    #endif
+
+    class CmdBase;
+
+    /**
+     * JSON reply writer.  Keep one on the stack in a handler: the buffer is CMD_JSON_OUT_BUF_SIZE bytes and
+     * nothing is allocated.  The reply is terminated with CR LF and flushed as soon as the outermost
+     * object / array is closed (or when the writer goes out of scope).
+    */
+    class CmdJsonWriter : private Print
+    {
+        public:
+            /**
+             * @brief Start a reply
+             * @param out where the reply goes.  NULL (default) = the stream of the command being dispatched
+             *          (Cmd::stream()), tagged with the id of the JSON request being handled (Cmd::json_id()), or
+             *          Serial when called outside of a command handler
+            */
+            CmdJsonWriter(Print *out = NULL);
+
+            /**
+             * @brief Reply to a request deferred with Cmd::json_defer(), on the stream it came from and tagged with its
+             *          id.  The ticket is released once the reply is complete.
+            */
+            CmdJsonWriter(CmdBase *cmd, uint8_t ticket);
+
+            /* destructor - closes whatever is still open and flushes */
+            ~CmdJsonWriter();
+
+            /* begin_object() / begin_array() - open a container, as a member of the enclosing object if a key is given */
+            void begin_object(const char *key = NULL);
+            void begin_array(const char *key = NULL);
+
+            /* end_object() / end_array() - close the innermost container */
+            void end_object();
+            void end_array();
+
+            /* key() - name of the next value in the enclosing object */
+            void key(const char *name);
+
+            /* value() - an array element, or the value of the last key() */
+            void value(const char *str);
+            void value(const __FlashStringHelper *str);
+            void value(bool b);
+            void value(int n);
+            void value(unsigned int n);
+            void value(long n);
+            void value(unsigned long n);
+            void value(double n, uint8_t digits = 2);
+
+            /* value_null() - a JSON null */
+            void value_null();
+
+            /* raw() - a value that is already formatted as JSON (copied as is) */
+            void raw(const char *json);
+
+            /* field() - key() + value() in one call */
+            template <typename T>
+            void field(const char *name, T v) {key(name); value(v);}
+            void field(const char *name, double n, uint8_t digits) {key(name); value(n, digits);}
+
+            /* end() - close everything still open, terminate the reply and flush */
+            void end();
+
+            /* depth() - number of containers currently open */
+            uint8_t depth() {return _depth;}
+
+            /* error() - true if the calls didn't nest (too deep, or closing something that isn't open) */
+            uint8_t error() {return _error;}
+
+        private:
+            /* Print interface - buffered, used for the number formatting */
+            size_t write(uint8_t c);
+            size_t write(const uint8_t *buffer, size_t size);
+            using Print::write;
+
+            /* separator() - the comma before a value, unless it follows a key or opens a container */
+            void separator();
+
+            /* done() - called after each complete value: a finished top level value ends the reply */
+            void done();
+
+            /* open() / close() - push / pop a container */
+            void open(char bracket, const char *key);
+            void close(uint8_t is_array);
+
+            /* string() - a quoted, escaped string from RAM or flash */
+            void string(const char *str, uint8_t flash);
+
+            /* flush_buf() - write out anything buffered */
+            void flush_buf();
+
+            Print *_out;
+            const char *_id = NULL;         // request id added to each reply, as written in the request
+            CmdBase *_cmd = NULL;           // deferred request: the Cmd holding it, and its ticket
+            uint8_t _ticket;
+            uint8_t _buf[CMD_JSON_OUT_BUF_SIZE];
+            uint16_t _len = 0;
+            uint8_t _depth = 0;
+            uint8_t _after_key = false;     // a key was written, its value comes next (no comma)
+            uint8_t _error = false;
+            uint32_t _has_items = 0;        // bit n: the container at depth n + 1 already has a member
+            uint32_t _is_array = 0;         // bit n: the container at depth n + 1 is an array
+    };
+
+#endif //CMDJSONWRITER_H
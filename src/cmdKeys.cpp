@@ -0,0 +1,199 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdKeys.cpp
+
+    Escape sequence state machine + default key bindings.
+*/
+/**************************************************************************/
+
+/* Included header file */
+#include <Arduino.h>
+#include "cmdKeys.h"
+
+/* Decoder states */
+#define CMD_ESC_ST_IDLE         0       // not inside a sequence
+#define CMD_ESC_ST_ESC          1       // ESC received
+#define CMD_ESC_ST_CSI          2       // ESC [ received, collecting parameters until the final byte
+#define CMD_ESC_ST_SS3          3       // ESC O received, the next final byte is the key
+#define CMD_ESC_ST_SKIP         4       // ESC [ [ (Linux console F1-F5): skip one more byte
+
+/* Byte classes (columns of the transition table) */
+#define CMD_ESC_CL_ESC          0       // ESC
+#define CMD_ESC_CL_CSI          1       // '['
+#define CMD_ESC_CL_SS3          2       // 'O'
+#define CMD_ESC_CL_DIGIT        3       // '0' - '9'
+#define CMD_ESC_CL_SEP          4       // ';' parameter separator
+#define CMD_ESC_CL_PARAM        5       // other parameter bytes ':' '<' '=' '>' '?'
+#define CMD_ESC_CL_INTER        6       // intermediate bytes 0x20 - 0x2F
+#define CMD_ESC_CL_FINAL        7       // final bytes 0x40 - 0x7E (other than '[' and 'O')
+#define CMD_ESC_CL_CTRL         8       // control characters, DEL and 8-bit bytes: abort the sequence
+#define CMD_ESC_CLASSES         9
+
+/* Transition actions */
+#define CMD_ESC_AC_NONE         0       // move to the next state
+#define CMD_ESC_AC_CLEAR        1       // start collecting parameters
+#define CMD_ESC_AC_DIGIT        2       // add a digit to the current parameter
+#define CMD_ESC_AC_SEP          3       // move to the next parameter
+#define CMD_ESC_AC_KEY          4       // final byte: decode the key
+#define CMD_ESC_AC_DOUBLE       5       // ESC ESC
+#define CMD_ESC_AC_DROP         6       // unknown / aborted sequence, consumed without a key
+
+/* Transition table entry: action in the high nibble, next state in the low nibble */
+#define T(action, next)         (uint8_t)(((CMD_ESC_AC_##action) << 4) | (CMD_ESC_ST_##next))
+
+static const uint8_t cmd_esc_table[][CMD_ESC_CLASSES] PROGMEM = {
+    /*             ESC             '['             'O'             digit           ';'             param           inter           final           ctrl */
+    /* IDLE */   { T(CLEAR, ESC),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE) },
+    /* ESC  */   { T(DOUBLE, IDLE),T(CLEAR, CSI),  T(CLEAR, SS3),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE) },
+    /* CSI  */   { T(CLEAR, ESC),  T(NONE, SKIP),  T(KEY, IDLE),   T(DIGIT, CSI),  T(SEP, CSI),    T(NONE, CSI),   T(NONE, CSI),   T(KEY, IDLE),   T(DROP, IDLE) },
+    /* SS3  */   { T(CLEAR, ESC),  T(KEY, IDLE),   T(KEY, IDLE),   T(DIGIT, SS3),  T(SEP, SS3),    T(NONE, SS3),   T(NONE, SS3),   T(KEY, IDLE),   T(DROP, IDLE) },
+    /* SKIP */   { T(CLEAR, ESC),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE),  T(DROP, IDLE) },
+};
+
+#undef T
+
+/* Keys of the letter finals ESC [ A .. H / ESC O A .. H (also rxvt's lowercase a .. d) */
+static const uint8_t cmd_esc_letter_keys[] PROGMEM = {
+    CMD_KEY_UP, CMD_KEY_DOWN, CMD_KEY_RIGHT, CMD_KEY_LEFT, CMD_KEY_NONE, CMD_KEY_END, CMD_KEY_NONE, CMD_KEY_HOME
+};
+
+/* Keys of the VT220 style ESC [ <n> ~ sequences, indexed by n */
+static const uint8_t cmd_esc_tilde_keys[] PROGMEM = {
+    CMD_KEY_NONE, CMD_KEY_HOME, CMD_KEY_INSERT, CMD_KEY_DELETE, CMD_KEY_END, CMD_KEY_PGUP, CMD_KEY_PGDN, CMD_KEY_HOME, CMD_KEY_END
+};
+
+/* Default action of each key without modifiers, indexed by CMD_KEY_x */
+static const uint8_t cmd_key_default_actions[] PROGMEM = {
+    CMD_ACT_NONE, CMD_ACT_HIST_PREV, CMD_ACT_HIST_NEXT, CMD_ACT_RIGHT, CMD_ACT_LEFT, CMD_ACT_HOME, CMD_ACT_END,
+    CMD_ACT_NONE, CMD_ACT_DELETE, CMD_ACT_NONE, CMD_ACT_NONE
+};
+
+/* cmd_esc_class() - column of the transition table for a byte */
+static uint8_t cmd_esc_class(uint8_t c) {
+    if (c == 0x1B) {return CMD_ESC_CL_ESC;}
+    if (c == '[') {return CMD_ESC_CL_CSI;}
+    if (c == 'O') {return CMD_ESC_CL_SS3;}
+    if (c >= '0' && c <= '9') {return CMD_ESC_CL_DIGIT;}
+    if (c == ';') {return CMD_ESC_CL_SEP;}
+    if (c >= 0x3A && c <= 0x3F) {return CMD_ESC_CL_PARAM;}
+    if (c >= 0x20 && c <= 0x2F) {return CMD_ESC_CL_INTER;}
+    if (c >= 0x40 && c <= 0x7E) {return CMD_ESC_CL_FINAL;}
+    return CMD_ESC_CL_CTRL;
+}
+
+/* cmd_esc_decode() - key of a complete sequence, from its final byte and parameters */
+static uint8_t cmd_esc_decode(const cmd_esc_t *esc, uint8_t ss3, uint8_t c) {
+    uint8_t key = CMD_KEY_NONE;
+    uint8_t mod = esc->params[1];
+
+    if (c == '~') {
+        /* ESC [ <n> ~ or ESC [ <n> ; <mod> ~ */
+        if (!ss3 && esc->params[0] < sizeof(cmd_esc_tilde_keys)) {key = pgm_read_byte(&cmd_esc_tilde_keys[esc->params[0]]);}
+    } else if (c >= 'A' && c <= 'H') {
+        /* ESC [ 1 ; <mod> C, or with a single parameter (ESC [ 5 C, ESC O 5 C) from older terminals */
+        key = pgm_read_byte(&cmd_esc_letter_keys[c - 'A']);
+        if (esc->nparams == 0) {mod = esc->params[0];}
+    } else if (c >= 'a' && c <= 'd') {
+        /* rxvt: ESC [ a-d is Shift + arrow, ESC O a-d is Ctrl + arrow */
+        key = pgm_read_byte(&cmd_esc_letter_keys[c - 'a']) | (ss3 ? CMD_KEY_CTRL : CMD_KEY_SHIFT);
+    }
+
+    /* xterm modifier parameter: 1 + (Shift 1 | Alt 2 | Ctrl 4) */
+    if (key != CMD_KEY_NONE && mod >= 2) {key |= ((mod - 1) & 0x07) << 4;}
+
+    return key;
+}
+
+/* cmd_esc_reset() - drop any partially received sequence */
+void cmd_esc_reset(cmd_esc_t *esc) {
+    esc->state = CMD_ESC_ST_IDLE;
+    esc->nparams = 0;
+    for (uint8_t i = 0; i < CMD_ESC_MAX_PARAMS; i++) {esc->params[i] = 0;}
+}
+
+/**************************************************************************/
+/*!
+    Feed one byte: one table lookup picks the action and the next state.
+*/
+/**************************************************************************/
+uint8_t cmd_esc_feed(cmd_esc_t *esc, uint8_t c) {
+    uint8_t entry = pgm_read_byte(&cmd_esc_table[esc->state][cmd_esc_class(c)]);
+    uint8_t state = esc->state;
+
+    esc->state = entry & 0x0F;
+
+    switch (entry >> 4) {
+        case CMD_ESC_AC_CLEAR:
+            esc->nparams = 0;
+            for (uint8_t i = 0; i < CMD_ESC_MAX_PARAMS; i++) {esc->params[i] = 0;}
+            return CMD_ESC_MORE;
+
+        case CMD_ESC_AC_DIGIT:
+            /* parameters saturate instead of wrapping, so huge numbers can't alias a known key */
+            if (esc->nparams < CMD_ESC_MAX_PARAMS) {
+                uint16_t p = esc->params[esc->nparams] * 10 + (c - '0');
+                esc->params[esc->nparams] = p > 0xFF ? 0xFF : p;
+            }
+            return CMD_ESC_MORE;
+
+        case CMD_ESC_AC_SEP:
+            if (esc->nparams < CMD_ESC_MAX_PARAMS) {esc->nparams++;}
+            return CMD_ESC_MORE;
+
+        case CMD_ESC_AC_KEY:
+            return cmd_esc_decode(esc, state == CMD_ESC_ST_SS3, c);
+
+        case CMD_ESC_AC_DOUBLE:
+            return CMD_ESC_DOUBLE;
+
+        case CMD_ESC_AC_DROP:
+            return CMD_KEY_NONE;
+
+        default:
+            return CMD_ESC_MORE;
+    }
+}
+
+/* cmd_key_action() - default editor action of a key */
+uint8_t cmd_key_action(uint8_t key) {
+    uint8_t base = CMD_KEY_BASE(key);
+
+    /* Ctrl / Alt + Left / Right move by words */
+    if ((key & (CMD_KEY_CTRL | CMD_KEY_ALT)) && (base == CMD_KEY_LEFT || base == CMD_KEY_RIGHT)) {
+        return base == CMD_KEY_LEFT ? CMD_ACT_WORD_LEFT : CMD_ACT_WORD_RIGHT;
+    }
+
+    return base < sizeof(cmd_key_default_actions) ? pgm_read_byte(&cmd_key_default_actions[base]) : CMD_ACT_NONE;
+}
@@ -0,0 +1,121 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdKeys.h
+
+    Escape sequence decoder for the terminal modes. A small state machine
+    takes one byte per step (a table lookup on the byte's class, no string
+    compares) and understands the sequences terminals send for special keys:
+
+        CSI     ESC [ <params> <final>      e.g. \e[A  \e[3~  \e[1;5C
+        SS3     ESC O <final>               e.g. \eOA  \eOH   \eOd (rxvt)
+
+    Decoded keys are CMD_KEY_x codes, plus CMD_KEY_SHIFT / ALT / CTRL for
+    xterm style modifiers, which Cmd maps to editor actions (CMD_ACT_x).
+    Sequences it doesn't know are consumed whole, so they never leak into
+    the command line.
+*/
+/**************************************************************************/
+#ifndef CMDKEYS_H
+    #define CMDKEYS_H
+
+    /* Include referenced libraries */
+    #include <stdint.h>
+
+    /* Keys decoded from escape sequences */
+    #define CMD_KEY_NONE            0       // unknown / unsupported sequence (consumed and ignored)
+    #define CMD_KEY_UP              1
+    #define CMD_KEY_DOWN            2
+    #define CMD_KEY_RIGHT           3
+    #define CMD_KEY_LEFT            4
+    #define CMD_KEY_HOME            5
+    #define CMD_KEY_END             6
+    #define CMD_KEY_INSERT          7
+    #define CMD_KEY_DELETE          8
+    #define CMD_KEY_PGUP            9
+    #define CMD_KEY_PGDN            10
+
+    /* Modifier bits or'ed into a key code */
+    #define CMD_KEY_SHIFT           0x10
+    #define CMD_KEY_ALT             0x20
+    #define CMD_KEY_CTRL            0x40
+    #define CMD_KEY_BASE(key)       ((key) & 0x0F)
+
+    /* cmd_esc_feed() results other than a key code */
+    #define CMD_ESC_MORE            0x80    // inside a sequence, keep feeding
+    #define CMD_ESC_DOUBLE          0x81    // ESC pressed twice in a row (exit request)
+
+    /* Editor actions a key can be bound to */
+    #define CMD_ACT_NONE            0       // key is ignored
+    #define CMD_ACT_LEFT            1       // cursor one character left
+    #define CMD_ACT_RIGHT           2       // cursor one character right
+    #define CMD_ACT_HIST_PREV       3       // recall the previous (older) history entry
+    #define CMD_ACT_HIST_NEXT       4       // recall the next (newer) history entry
+    #define CMD_ACT_HOME            5       // cursor to the start of the line
+    #define CMD_ACT_END             6       // cursor to the end of the line
+    #define CMD_ACT_DELETE          7       // delete the character under the cursor
+    #define CMD_ACT_WORD_LEFT       8       // cursor to the start of the previous word
+    #define CMD_ACT_WORD_RIGHT      9       // cursor past the end of the next word
+
+    #define CMD_ESC_MAX_PARAMS      2       // numeric CSI parameters kept (key number + modifier), further ones are ignored
+
+    /* Decoder state, zero it (or call cmd_esc_reset()) before use */
+    typedef struct _cmd_esc_t
+    {
+        uint8_t state;                          // CMD_ESC_ST_x (see cmdKeys.cpp), 0 = not inside a sequence
+        uint8_t nparams;                        // index of the parameter being collected
+        uint8_t params[CMD_ESC_MAX_PARAMS];     // numeric parameters (saturate at 255)
+    } cmd_esc_t;
+
+    /* cmd_esc_reset() - drop any partially received sequence */
+    void cmd_esc_reset(cmd_esc_t *esc);
+
+    /* cmd_esc_active() - true while inside a sequence (bytes must go to cmd_esc_feed()) */
+    inline uint8_t cmd_esc_active(const cmd_esc_t *esc) {return esc->state != 0;}
+
+    /**
+     * @brief Feed one byte to the decoder.  Start a sequence by feeding ESC, then keep feeding while it returns
+     *          CMD_ESC_MORE.
+     * @retval CMD_ESC_MORE while the sequence continues, CMD_ESC_DOUBLE for ESC ESC, otherwise the decoded key
+     *          (CMD_KEY_x | modifiers, CMD_KEY_NONE if unknown) - the decoder is then idle again
+    */
+    uint8_t cmd_esc_feed(cmd_esc_t *esc, uint8_t c);
+
+    /**
+     * @brief Default editor action of a key (Ctrl / Alt + Left / Right move by words, other modifiers are ignored)
+     * @retval CMD_ACT_x
+    */
+    uint8_t cmd_key_action(uint8_t key);
+
+#endif //CMDKEYS_H
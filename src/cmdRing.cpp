@@ -0,0 +1,106 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdRing.cpp
+
+    Lock-free single-producer / single-consumer receive ring (see cmdRing.h)
+*/
+/**************************************************************************/
+#include <string.h>
+#include "cmdRing.h"
+
+/**************************************************************************/
+/*!
+    cmd_ring_init() - set up an empty ring over buf
+*/
+/**************************************************************************/
+uint8_t cmd_ring_init(cmd_ring_t *ring, uint8_t *buf, uint16_t size) {
+    if (size < 2 || size > CMD_RING_MAX_SIZE || (size & (size - 1))) {return false;}
+
+    ring->buf = buf;
+    ring->mask = (cmd_ring_idx_t)(size - 1);
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    cmd_ring_write() - producer side bulk copy: at most two memcpy() (up to
+    the end of the buffer, then from the start), then a single release of
+    the new head
+*/
+/**************************************************************************/
+uint16_t cmd_ring_write(cmd_ring_t *ring, const uint8_t *data, uint16_t len) {
+    cmd_ring_idx_t head = ring->head;
+    uint16_t space = cmd_ring_free(ring);
+
+    if (len > space) {
+        ring->dropped += len - space;
+        len = space;
+    }
+
+    uint16_t pos = head & ring->mask;
+    uint16_t first = (uint16_t)ring->mask + 1 - pos;
+    if (first > len) {first = len;}
+
+    memcpy(ring->buf + pos, data, first);
+    memcpy(ring->buf, data + first, len - first);
+
+    cmd_ring_store(&ring->head, (cmd_ring_idx_t)(head + len));
+    return len;
+}
+
+/**************************************************************************/
+/*!
+    cmd_ring_read() - consumer side bulk copy, the mirror of cmd_ring_write()
+*/
+/**************************************************************************/
+uint16_t cmd_ring_read(cmd_ring_t *ring, uint8_t *dst, uint16_t len) {
+    cmd_ring_idx_t tail = ring->tail;
+    uint16_t avail = (cmd_ring_idx_t)(cmd_ring_load(&ring->head) - tail);
+
+    if (len > avail) {len = avail;}
+
+    uint16_t pos = tail & ring->mask;
+    uint16_t first = (uint16_t)ring->mask + 1 - pos;
+    if (first > len) {first = len;}
+
+    memcpy(dst, ring->buf + pos, first);
+    memcpy(dst + first, ring->buf, len - first);
+
+    cmd_ring_store(&ring->tail, (cmd_ring_idx_t)(tail + len));
+    return len;
+}
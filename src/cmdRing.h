@@ -0,0 +1,149 @@
+/*******************************************************************
+    Copyright (C) 2009 FreakLabs
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS'' AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+    OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+    SUCH DAMAGE.
+
+    Originally written by Christopher Wang aka Akiba.
+    Please post support questions to the FreakLabs forum.
+
+*******************************************************************/
+/*!
+    \file cmdRing.h
+
+    Lock-free single-producer / single-consumer receive ring. A receive
+    interrupt or callback (e.g. ESP32 HardwareSerial::onReceive()) pushes
+    bytes as they arrive, and Cmd::poll() drains them whenever loop() gets
+    around to it, so a busy loop() no longer overflows the core's small
+    RX buffer:
+
+        CmdRing<256> rx;                    // size must be a power of 2
+        cmd.attach_ring(&rx);
+
+        void on_receive() {                 // producer: ISR / RX callback
+            while (Serial.available()) {cmd_ring_push(&rx, Serial.read());}
+        }
+
+    The producer only writes head and the consumer only writes tail. Each
+    side publishes its index with a release store after touching the data
+    and reads the other side's index with an acquire load, so no lock or
+    interrupt masking is needed.
+*/
+/**************************************************************************/
+#ifndef CMDRING_H
+    #define CMDRING_H
+
+    /* Include referenced libraries */
+    #include <stdint.h>
+    #include <stddef.h>
+
+    /* Ring indices run freely and are masked on access. They must be loaded / stored in one access, so 8 bit on AVR */
+    #if defined(__AVR__)
+        typedef uint8_t cmd_ring_idx_t;
+        #define CMD_RING_MAX_SIZE   128
+    #else
+        typedef uint16_t cmd_ring_idx_t;
+        #define CMD_RING_MAX_SIZE   32768
+    #endif
+
+    #define cmd_ring_load(p)        __atomic_load_n((p), __ATOMIC_ACQUIRE)
+    #define cmd_ring_store(p, v)    __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+    /* SPSC ring state (see cmd_ring_init(), or CmdRing<Size> for one with its own storage) */
+    typedef struct _cmd_ring_t
+    {
+        uint8_t *buf;
+        cmd_ring_idx_t mask;        // size - 1
+        cmd_ring_idx_t head;        // next byte to write, only written by the producer
+        cmd_ring_idx_t tail;        // next byte to read, only written by the consumer
+        uint16_t dropped;           // bytes pushed while the ring was full, only written by the producer
+    } cmd_ring_t;
+
+    /**
+     * @brief Set up a ring over a buffer (before either side starts using it)
+     * @param size size of the buffer, a power of 2 up to CMD_RING_MAX_SIZE
+     * @retval true if the size is usable
+    */
+    uint8_t cmd_ring_init(cmd_ring_t *ring, uint8_t *buf, uint16_t size);
+
+    /**
+     * @brief Producer: add one byte, safe to call from an interrupt
+     * @retval true if stored, false if the ring was full (the byte is counted in dropped)
+    */
+    static inline uint8_t cmd_ring_push(cmd_ring_t *ring, uint8_t c) {
+        cmd_ring_idx_t head = ring->head;
+        if ((cmd_ring_idx_t)(head - cmd_ring_load(&ring->tail)) > ring->mask) {
+            ring->dropped++;
+            return false;
+        }
+        ring->buf[head & ring->mask] = c;
+        cmd_ring_store(&ring->head, (cmd_ring_idx_t)(head + 1));
+        return true;
+    }
+
+    /**
+     * @brief Producer: number of bytes that can be pushed without dropping any
+    */
+    static inline uint16_t cmd_ring_free(cmd_ring_t *ring) {
+        return (uint16_t)ring->mask + 1 - (cmd_ring_idx_t)(ring->head - cmd_ring_load(&ring->tail));
+    }
+
+    /**
+     * @brief Producer: add a block of bytes, whatever fits (the rest is counted in dropped)
+     * @retval number of bytes stored
+    */
+    uint16_t cmd_ring_write(cmd_ring_t *ring, const uint8_t *data, uint16_t len);
+
+    /**
+     * @brief Consumer: number of bytes waiting
+    */
+    static inline uint16_t cmd_ring_available(cmd_ring_t *ring) {
+        return (cmd_ring_idx_t)(cmd_ring_load(&ring->head) - ring->tail);
+    }
+
+    /**
+     * @brief Consumer: take up to len bytes out of the ring
+     * @retval number of bytes copied to dst
+    */
+    uint16_t cmd_ring_read(cmd_ring_t *ring, uint8_t *dst, uint16_t len);
+
+    #ifdef __cplusplus
+        /* A ring with its own storage: CmdRing<256> rx; */
+        template <uint16_t Size>
+        class CmdRing : public cmd_ring_t
+        {
+            static_assert(Size >= 2 && Size <= CMD_RING_MAX_SIZE && (Size & (Size - 1)) == 0,
+                "cmdArduino: CmdRing size must be a power of 2 (at most 128 on AVR)");
+
+            public:
+                CmdRing() {cmd_ring_init(this, _storage, Size);}
+
+            private:
+                uint8_t _storage[Size];
+        };
+    #endif
+
+#endif //CMDRING_H